@@ -0,0 +1,60 @@
+#include <stdint.h>
+#include <stdio.h>
+
+#include "./bench.h"
+#include "cartridge.h"
+#include "cpu.h"
+#include "emulator.h"
+
+#define INSTRUCTIONS 50000000
+
+// NOTE: ALU heavy inner loop, where almost every flag result is overwritten before being read.
+//  Only the DEC C / JR NZ pair at the end looks at a flag
+static uint8_t PROGRAM[] = {
+	0x0E, 0x40, // LD C, 0x40
+	0x80,       // ADD A, B
+	0x8A,       // ADC A, D
+	0x93,       // SUB E
+	0xA8,       // XOR B
+	0x04,       // INC B
+	0xB2,       // OR D
+	0x9B,       // SBC A, E
+	0x14,       // INC D
+	0xA3,       // AND E
+	0xBA,       // CP D
+	0x1D,       // DEC E
+	0xC6, 0x11, // ADD A, 0x11
+	0x0D,       // DEC C
+	0x20, 0x00, // JR NZ, loop
+	0x18, 0x00, // JR PROGRAM_START
+};
+#define LOOP_START 2
+#define JR_NZ_OFFSET (sizeof(PROGRAM) - 3)
+#define JR_OFFSET (sizeof(PROGRAM) - 1)
+
+
+int main(void) {
+	PROGRAM[JR_NZ_OFFSET] = (uint8_t)(LOOP_START - (int)(JR_NZ_OFFSET + 1));
+	PROGRAM[JR_OFFSET] = (uint8_t)(-(int)sizeof(PROGRAM));
+	Cartridge cart = bench_cartridge(PROGRAM, sizeof(PROGRAM));
+
+	Emulator emu = emulator_create();
+	emulator_insert_cartridge(&emu, &cart);
+	emu.cpu.pc = PROGRAM_START;
+
+	double start = now_seconds();
+	for (uint32_t i = 0; i < INSTRUCTIONS; i++)
+		cpu_step(&emu);
+	double elapsed = now_seconds() - start;
+
+#ifdef CPU_LAZY_FLAGS
+	const char *mode = "lazy";
+#else
+	const char *mode = "eager";
+#endif
+	printf("alu (%s flags): %.2f M instructions/s\n", mode, INSTRUCTIONS / elapsed / 1e6);
+
+	emulator_destroy(&emu);
+	cartridge_free(&cart);
+	return 0;
+}
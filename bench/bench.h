@@ -0,0 +1,32 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cartridge.h"
+
+#define PROGRAM_START 0x0100
+
+
+static inline double now_seconds() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+// NOTE: A 32KB ROM only cartridge, with the program placed at the entry point
+static inline Cartridge bench_cartridge(const uint8_t *program, size_t size) {
+	Cartridge cart = {0};
+	cart.is_load_success = true;
+	cart.size = 0x8000;
+	cart.content = calloc(cart.size, 1);
+	memcpy(&cart.content[PROGRAM_START], program, size);
+	return cart;
+}
+
+
+#endif // BENCH_H
@@ -0,0 +1,62 @@
+#include <stdint.h>
+#include <stdio.h>
+
+#include "./bench.h"
+#include "cartridge.h"
+#include "cpu.h"
+#include "emulator.h"
+#include "scheduler.h"
+
+#define INSTRUCTIONS 50000000
+
+// NOTE: A tight loop mixing loads, ALU, 16 bit arithmetic and CB prefixed ops,
+//  so the dispatch is spread over both opcode tables
+static uint8_t PROGRAM[] = {
+	0x06, 0x10,       // LD B, 0x10
+	0x0E, 0x20,       // LD C, 0x20
+	0x78,             // LD A, B
+	0x81,             // ADD A, C
+	0xA9,             // XOR C
+	0x3C,             // INC A
+	0x47,             // LD B, A
+	0x03,             // INC BC
+	0xCB, 0x11,       // RL C
+	0xCB, 0x78,       // BIT 7, B
+	0xCB, 0xC7,       // SET 0, A
+	0x21, 0x00, 0xC0, // LD HL, 0xC000
+	0x77,             // LD (HL), A
+	0x7E,             // LD A, (HL)
+	0xE6, 0x0F,       // AND 0x0F
+	0x18, 0x00,       // JR PROGRAM_START
+};
+
+
+int main(void) {
+	PROGRAM[sizeof(PROGRAM) - 1] = (uint8_t)(-(int8_t)sizeof(PROGRAM));
+	Cartridge cart = bench_cartridge(PROGRAM, sizeof(PROGRAM));
+
+	Emulator emu = emulator_create();
+	emulator_insert_cartridge(&emu, &cart);
+	emu.cpu.pc = PROGRAM_START;
+	// NOTE: Nothing handles the timer and PPU events here, so without them the blocks only end
+	//  at the JR, and the handlers chain through the whole loop
+	for (EventType type = 0; type < EVENT_COUNT; type++)
+		scheduler_cancel(&emu.scheduler, type);
+
+	uint64_t instructions = 0;
+	double start = now_seconds();
+	while (instructions < INSTRUCTIONS)
+		instructions += cpu_run_block(&emu).steps;
+	double elapsed = now_seconds() - start;
+
+#ifdef OPCODE_DISPATCH_THREADED
+	const char *mode = "threaded";
+#else
+	const char *mode = "switch";
+#endif
+	printf("dispatch (%s): %.2f M instructions/s\n", mode, instructions / elapsed / 1e6);
+
+	emulator_destroy(&emu);
+	cartridge_free(&cart);
+	return 0;
+}
@@ -0,0 +1,54 @@
+#include <stdint.h>
+#include <stdio.h>
+
+#include "./bench.h"
+#include "cartridge.h"
+#include "emulator.h"
+#include "idle.h"
+
+#define FRAMES 600
+
+// NOTE: Spends the whole frame waiting on LY, the way most games wait for VBlank
+static const uint8_t PROGRAM[] = {
+	0xF0, 0x44, // LDH A, (LY)
+	0xFE, 0x90, // CP 144
+	0x20, 0xFA, // JR NZ, -6
+	0xF0, 0x44, // LDH A, (LY)
+	0xFE, 0x90, // CP 144
+	0x28, 0xFA, // JR Z, -6
+	0x18, 0xF2, // JR PROGRAM_START
+};
+
+
+static double frames_per_second(Cartridge *cart, bool is_idle_enabled, double *skipped) {
+	Emulator emu = emulator_create();
+	emulator_insert_cartridge(&emu, cart);
+	emu.cpu.pc = PROGRAM_START;
+	if (!is_idle_enabled) {
+		idle_destroy(emu.idle);
+		emu.idle = NULL;
+	}
+
+	double start = now_seconds();
+	for (uint32_t i = 0; i < FRAMES; i++)
+		emulator_run_frame(&emu);
+	double elapsed = now_seconds() - start;
+
+	if (is_idle_enabled)
+		*skipped = emu.idle->skipped_cycles / (double)(FRAMES * 70224ull);
+	emulator_destroy(&emu);
+	return FRAMES / elapsed;
+}
+
+
+int main(void) {
+	Cartridge cart = bench_cartridge(PROGRAM, sizeof(PROGRAM));
+
+	double skipped = 0;
+	printf("idle (off): %.2f frames/s\n", frames_per_second(&cart, false, &skipped));
+	printf("idle (on): %.2f frames/s\n", frames_per_second(&cart, true, &skipped));
+	printf("idle (on): %.1f%% of the cycles skipped\n", skipped * 100);
+
+	cartridge_free(&cart);
+	return 0;
+}
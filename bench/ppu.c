@@ -0,0 +1,51 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "./bench.h"
+#include "emulator.h"
+#include "ppu.h"
+
+#define FRAMES 300
+#define LINE_DOTS 456
+
+
+// NOTE: Random tiles with 40 objects, so every line has sprites to composite
+static Emulator emulator_with_scene() {
+	Emulator emu = emulator_create();
+	srand(42);
+	for (uint16_t i = 0; i < VRAM_SIZE; i++)
+		emu.ppu.vram[i] = rand() & 0xFF;
+	for (uint16_t i = 0; i < OAM_SIZE; i += 4) {
+		emu.ppu.oam[i + 0] = 16 + rand() % 144;
+		emu.ppu.oam[i + 1] = 8 + rand() % 160;
+		emu.ppu.oam[i + 2] = rand() & 0xFF;
+		emu.ppu.oam[i + 3] = 0;
+	}
+	return emu;
+}
+
+
+// NOTE: Stepping one dot at a time never covers a whole line, which forces the per-dot path
+static double frames_per_second(bool is_dot_by_dot, bool is_skipped) {
+	Emulator emu = emulator_with_scene();
+	emulator_set_render_on_demand(&emu, is_skipped);
+	uint16_t step = is_dot_by_dot ? 1 : LINE_DOTS;
+
+	double start = now_seconds();
+	for (uint32_t i = 0; i < FRAMES * 154 * (LINE_DOTS / step); i++)
+		ppu_step(&emu, step);
+	double elapsed = now_seconds() - start;
+
+	emulator_destroy(&emu);
+	return FRAMES / elapsed;
+}
+
+
+int main(void) {
+	printf("ppu (dot by dot): %.2f frames/s\n", frames_per_second(true, false));
+	printf("ppu (scanline): %.2f frames/s\n", frames_per_second(false, false));
+	printf("ppu (skipped): %.2f frames/s\n", frames_per_second(false, true));
+	return 0;
+}
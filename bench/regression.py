@@ -0,0 +1,139 @@
+#!/bin/python3
+
+import argparse
+import json
+import os
+import statistics
+import subprocess
+import sys
+import tempfile
+
+SUITE = "./bench/bin/suite"
+BASELINE = "./bench/baseline.json"
+
+# NOTE: Sections under this share of the frame are too noisy to gate on
+MIN_SHARE = 0.05
+# NOTE: A slowdown also has to stand out of the noise by this many MADs
+NOISE_MADS = 3
+
+formatted = "--no-format" not in sys.argv
+
+RED = "\033[1m\033[91m" if formatted else ""
+GREEN = "\033[1m\033[92m" if formatted else ""
+YELLOW = "\033[1m\033[93m" if formatted else ""
+RESET = "\033[0m" if formatted else ""
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(description="Compares the benchmark suite against a stored baseline")
+    parser.add_argument("--save", action="store_true", help="store the results as the new baseline")
+    parser.add_argument("--baseline", default=BASELINE, help=f"baseline file (default {BASELINE})")
+    parser.add_argument("--runs", type=int, default=5, help="suite runs to take the median of (default 5)")
+    parser.add_argument("--frames", type=int, default=600, help="frames per workload and run (default 600)")
+    parser.add_argument("--roms", default="./assets", help="directory with the ROM workloads")
+    parser.add_argument("--threshold", type=float, default=5.0, help="slowdown in percent that fails the check (default 5)")
+    parser.add_argument("--cpu", type=int, default=0, help="host CPU the suite is pinned to, -1 to not pin (default 0)")
+    parser.add_argument("--no-format", action="store_true", help="no colors in the output")
+    return parser.parse_args()
+
+
+def run_suite(args):
+    # NOTE: One core for every run, so the scheduler does not move the suite around between runs
+    if args.cpu >= 0 and hasattr(os, "sched_setaffinity"):
+        os.sched_setaffinity(0, {args.cpu})
+
+    runs = []
+    with tempfile.TemporaryDirectory() as directory:
+        output = os.path.join(directory, "results.json")
+        for run in range(args.runs):
+            command = [SUITE, "--frames", str(args.frames), "--roms", args.roms, "--output", output]
+            result = subprocess.run(command, capture_output=True, text=True)
+            if result.returncode != 0:
+                print(result.stderr)
+                sys.exit(2)
+            with open(output) as file:
+                runs.append(json.load(file))
+    return runs
+
+
+def median_and_mad(values):
+    median = statistics.median(values)
+    mad = statistics.median([abs(value - median) for value in values])
+    return {"median": median, "mad": mad}
+
+
+# NOTE: Per workload, the frame time, the time of every section and the instruction count.
+#  Lower is better for all of them
+def summarize(runs):
+    summary = {}
+    for workload in runs[0]["workloads"]:
+        name = workload["name"]
+        if workload.get("skipped"):
+            continue
+        samples = [next(w for w in run["workloads"] if w["name"] == name) for run in runs]
+        metrics = {"ns_per_frame": median_and_mad([s["ns_per_frame"] for s in samples])}
+        for section in workload["sections"]:
+            metrics[section] = median_and_mad([s["sections"][section]["ns_per_frame"] for s in samples])
+            metrics[section]["share"] = statistics.median([s["sections"][section]["share"] for s in samples])
+        summary[name] = {"instructions": workload["instructions"], "metrics": metrics}
+    return summary
+
+
+def compare(baseline, current, threshold):
+    regressions = 0
+    for name, workload in current.items():
+        if name not in baseline:
+            print(f"{YELLOW}[NEW]{RESET} {name} has no baseline")
+            continue
+        base = baseline[name]
+        # NOTE: Emulation is deterministic, a different count means the change altered behaviour
+        if base["instructions"] != workload["instructions"]:
+            print(f"{YELLOW}[NOTE]{RESET} {name} ran {workload['instructions']} instructions, the baseline {base['instructions']}")
+
+        for metric, value in workload["metrics"].items():
+            if metric not in base["metrics"]:
+                continue
+            old = base["metrics"][metric]
+            if metric != "ns_per_frame" and old.get("share", 0) < MIN_SHARE:
+                continue
+            change = (value["median"] - old["median"]) / old["median"] * 100 if old["median"] > 0 else 0
+            noise = NOISE_MADS * max(old["mad"], value["mad"])
+            is_regression = change > threshold and value["median"] - old["median"] > noise
+            if is_regression:
+                regressions += 1
+            status = f"{RED}[SLOWER]{RESET}" if is_regression else f"{GREEN}[OK]{RESET}"
+            print(f"{status} {name} {metric}: {old['median']:.0f} -> {value['median']:.0f} ns/frame ({change:+.1f}%)")
+    return regressions
+
+
+def main():
+    args = parse_args()
+    if not os.path.exists(SUITE):
+        print(f"{SUITE} is missing, build it with `make bench`")
+        sys.exit(2)
+
+    current = summarize(run_suite(args))
+    if args.save:
+        with open(args.baseline, "w") as file:
+            json.dump({"frames": args.frames, "runs": args.runs, "workloads": current}, file, indent=2)
+        print(f"Baseline written to {args.baseline}")
+        return
+
+    if not os.path.exists(args.baseline):
+        print(f"No baseline at {args.baseline}, store one with --save")
+        sys.exit(2)
+    with open(args.baseline) as file:
+        baseline = json.load(file)
+    if baseline["frames"] != args.frames:
+        print(f"The baseline ran {baseline['frames']} frames per workload, this run {args.frames}")
+        sys.exit(2)
+
+    regressions = compare(baseline["workloads"], current, args.threshold)
+    if regressions > 0:
+        print(f"{RED}{regressions} slowdown(s) above {args.threshold}%{RESET}")
+        sys.exit(1)
+    print(f"{GREEN}No slowdown above {args.threshold}%{RESET}")
+
+
+if __name__ == "__main__":
+    main()
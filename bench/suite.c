@@ -0,0 +1,284 @@
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./bench.h"
+#include "cartridge.h"
+#include "emulator.h"
+#include "ppu.h"
+#include "profile.h"
+
+#define DEFAULT_FRAMES 600
+#define CYCLES_PER_FRAME 70224
+
+// NOTE: Runs every workload headless for a number of frames and writes the results as JSON,
+//  so runs can be compared against each other. Each workload runs twice, once for the
+//  throughput numbers and once with the section timers on, which add their own overhead
+
+
+// NOTE: Arithmetic with a store to WRAM on every iteration, HL wraps inside C000-DFFF
+static const uint8_t CPU_ALU_PROGRAM[] = {
+	0x21, 0x00, 0xC0, // LD HL, 0xC000
+	0x80,             // ADD A, B
+	0xA9,             // XOR C
+	0x22,             // LD (HL+), A
+	0x04,             // INC B
+	0x07,             // RLCA
+	0x8A,             // ADC A, D
+	0x57,             // LD D, A
+	0x7C,             // LD A, H
+	0xE6, 0x1F,       // AND 0x1F
+	0xF6, 0xC0,       // OR 0xC0
+	0x67,             // LD H, A
+	0x7A,             // LD A, D
+	0x18, 0xF0,       // JR -16
+};
+
+// NOTE: Keeps writing tile data, OAM and SCX. The PPU syncs on every write,
+//  which forces the per-dot path for most of the frame
+static const uint8_t PPU_VRAM_PROGRAM[] = {
+	0x21, 0x00, 0x80, // LD HL, 0x8000
+	0x7D,             // LD A, L
+	0x22,             // LD (HL+), A
+	0xEA, 0x01, 0xFE, // LD (0xFE01), A
+	0xE0, 0x43,       // LDH (SCX), A
+	0x7C,             // LD A, H
+	0xE6, 0x0F,       // AND 0x0F
+	0xF6, 0x80,       // OR 0x80
+	0x67,             // LD H, A
+	0x18, 0xF1,       // JR -15
+};
+
+// NOTE: Waits on LY the way most games wait for VBlank
+static const uint8_t POLLING_PROGRAM[] = {
+	0xF0, 0x44, // LDH A, (LY)
+	0xFE, 0x90, // CP 144
+	0x20, 0xFA, // JR NZ, -6
+	0xF0, 0x44, // LDH A, (LY)
+	0xFE, 0x90, // CP 144
+	0x28, 0xFA, // JR Z, -6
+	0x18, 0xF2, // JR PROGRAM_START
+};
+
+// NOTE: Sleeps between VBlank and timer interrupts, both handlers only return
+static const uint8_t HALT_PROGRAM[] = {
+	0x31, 0xFE, 0xFF, // LD SP, 0xFFFE
+	0x3E, 0x05,       // LD A, 0x05
+	0xE0, 0xFF,       // LDH (IE), A
+	0x3E, 0x05,       // LD A, 0x05
+	0xE0, 0x07,       // LDH (TAC), A
+	0xFB,             // EI
+	0x76,             // HALT
+	0x18, 0xFD,       // JR -3
+};
+
+// NOTE: Every op after the first takes 4 cycles, so the clock gives the exact instruction count
+static const uint8_t COUNT_PROGRAM[] = {
+	0x21, 0x03, 0x01, // LD HL, 0x0103
+	0x3C, 0x3C, 0x3C, // INC A
+	0x3C, 0x3C, 0x3C, // INC A
+	0x04, 0x0C, 0x14, // INC B, INC C, INC D
+	0xE9,             // JP HL
+};
+
+static const struct {
+	const char *name;
+	const uint8_t *program;
+	size_t size;
+} SYNTHETIC_WORKLOADS[] = {
+	{"cpu_alu", CPU_ALU_PROGRAM, sizeof(CPU_ALU_PROGRAM)},
+	{"ppu_vram", PPU_VRAM_PROGRAM, sizeof(PPU_VRAM_PROGRAM)},
+	{"polling", POLLING_PROGRAM, sizeof(POLLING_PROGRAM)},
+	{"halt", HALT_PROGRAM, sizeof(HALT_PROGRAM)},
+};
+
+static const char *ROM_WORKLOADS[] = {
+	"tetris.gb",
+	"super_mario_land.gb",
+	"links_awakening.gb",
+};
+
+static const char *SECTION_NAMES[PROFILE_COUNT] = {
+	[PROFILE_OTHER] = "other",
+	[PROFILE_CPU] = "cpu_step",
+	[PROFILE_TIMER] = "timer_step",
+	[PROFILE_PPU] = "ppu_step",
+	[PROFILE_MEMORY] = "memory",
+};
+
+
+typedef struct {
+	double seconds;
+	uint64_t instructions;
+	double section_share[PROFILE_COUNT];
+	uint64_t section_calls[PROFILE_COUNT];
+} Result;
+
+
+// NOTE: There is no boot ROM, every workload starts at the entry point.
+//  VRAM and OAM start out as garbage, which changes the PPU timing from run to run
+static Emulator emulator_with(Cartridge *cart) {
+	Emulator emu = emulator_create();
+	emulator_insert_cartridge(&emu, cart);
+	emu.cpu.pc = PROGRAM_START;
+	memset(emu.ppu.vram, 0, VRAM_SIZE);
+	memset(emu.ppu.oam, 0, OAM_SIZE);
+	return emu;
+}
+
+
+static Result run(Cartridge *cart, uint32_t frames) {
+	Result result = {0};
+
+	Emulator emu = emulator_with(cart);
+	profile_reset();
+	double start = now_seconds();
+	for (uint32_t i = 0; i < frames; i++)
+		emulator_run_frame(&emu);
+	result.seconds = now_seconds() - start;
+	result.instructions = profile.calls[PROFILE_CPU];
+	emulator_destroy(&emu);
+
+	emu = emulator_with(cart);
+	profile_start();
+	for (uint32_t i = 0; i < frames; i++)
+		emulator_run_frame(&emu);
+	profile_stop();
+	emulator_destroy(&emu);
+
+	uint64_t total = 0;
+	for (uint8_t i = 0; i < PROFILE_COUNT; i++)
+		total += profile.ticks[i];
+	for (uint8_t i = 0; i < PROFILE_COUNT; i++) {
+		result.section_share[i] = total > 0 ? profile.ticks[i] / (double)total : 0;
+		result.section_calls[i] = profile.calls[i];
+	}
+	return result;
+}
+
+
+// NOTE: The CPU section is entered once per block, checks that it still reports instructions
+static bool check_instruction_count() {
+	Cartridge cart = bench_cartridge(COUNT_PROGRAM, sizeof(COUNT_PROGRAM));
+	Emulator emu = emulator_with(&cart);
+	profile_reset();
+	for (uint32_t i = 0; i < 10; i++)
+		emulator_run_frame(&emu);
+	uint64_t expected = 1 + (emu.scheduler.clock - 12) / 4;
+	uint64_t counted = profile.calls[PROFILE_CPU];
+	emulator_destroy(&emu);
+	cartridge_free(&cart);
+
+	if (counted != expected)
+		fprintf(stderr, "suite: counted %" PRIu64 " instructions, the loop ran %" PRIu64 "\n", counted, expected);
+	return counted == expected;
+}
+
+
+static void write_result(FILE *out, const char *name, const char *kind, Result *result, uint32_t frames) {
+	double ns_per_frame = result->seconds * 1e9 / frames;
+	fprintf(out, "    {\n");
+	fprintf(out, "      \"name\": \"%s\",\n", name);
+	fprintf(out, "      \"kind\": \"%s\",\n", kind);
+	fprintf(out, "      \"frames\": %u,\n", frames);
+	fprintf(out, "      \"seconds\": %.6f,\n", result->seconds);
+	fprintf(out, "      \"frames_per_second\": %.2f,\n", frames / result->seconds);
+	fprintf(out, "      \"instructions\": %lu,\n", (unsigned long)result->instructions);
+	fprintf(out, "      \"instructions_per_second\": %.0f,\n", result->instructions / result->seconds);
+	fprintf(out, "      \"ns_per_frame\": %.1f,\n", ns_per_frame);
+	fprintf(out, "      \"speed\": %.2f,\n", frames * (CYCLES_PER_FRAME / 4194304.0) / result->seconds);
+
+	// NOTE: The shares come from the profiled run, scaled to the unprofiled frame time
+	fprintf(out, "      \"sections\": {\n");
+	for (uint8_t i = 0; i < PROFILE_COUNT; i++) {
+		fprintf(out, "        \"%s\": {\"share\": %.4f, \"ns_per_frame\": %.1f, \"calls_per_frame\": %.1f}%s\n",
+			SECTION_NAMES[i], result->section_share[i], result->section_share[i] * ns_per_frame,
+			result->section_calls[i] / (double)frames, i + 1 < PROFILE_COUNT ? "," : "");
+	}
+	fprintf(out, "      }\n");
+	fprintf(out, "    }");
+}
+
+
+static void print_usage(const char *program) {
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  --frames <n>      frames to run per workload (default %d)\n"
+		"  --roms <dir>      directory with the ROM workloads (default ./assets)\n"
+		"  --output <file>   write the JSON there instead of stdout\n",
+		program, DEFAULT_FRAMES);
+}
+
+
+int main(int argc, char **argv) {
+	long frames = DEFAULT_FRAMES;
+	const char *rom_dir = "./assets";
+	const char *output = NULL;
+	for (int i = 1; i < argc; i++) {
+		bool has_value = i + 1 < argc;
+		if (strcmp(argv[i], "--frames") == 0 && has_value)
+			frames = strtol(argv[++i], NULL, 10);
+		else if (strcmp(argv[i], "--roms") == 0 && has_value)
+			rom_dir = argv[++i];
+		else if (strcmp(argv[i], "--output") == 0 && has_value)
+			output = argv[++i];
+		else {
+			print_usage(argv[0]);
+			return 1;
+		}
+	}
+	if (frames <= 0 || frames > UINT32_MAX) {
+		print_usage(argv[0]);
+		return 1;
+	}
+
+	if (!check_instruction_count())
+		return 1;
+
+	FILE *out = output != NULL ? fopen(output, "w") : stdout;
+	if (out == NULL) {
+		fprintf(stderr, "Could not write %s\n", output);
+		return 1;
+	}
+
+	fprintf(out, "{\n  \"frames\": %ld,\n  \"workloads\": [\n", frames);
+	bool is_first = true;
+	for (size_t i = 0; i < sizeof(SYNTHETIC_WORKLOADS) / sizeof(SYNTHETIC_WORKLOADS[0]); i++) {
+		Cartridge cart = bench_cartridge(SYNTHETIC_WORKLOADS[i].program, SYNTHETIC_WORKLOADS[i].size);
+		// NOTE: Interrupt handlers for the halt workload, RETI
+		cart.content[0x40] = 0xD9;
+		cart.content[0x50] = 0xD9;
+		Result result = run(&cart, frames);
+		cartridge_free(&cart);
+
+		fprintf(out, "%s", is_first ? "" : ",\n");
+		write_result(out, SYNTHETIC_WORKLOADS[i].name, "synthetic", &result, frames);
+		is_first = false;
+	}
+
+	for (size_t i = 0; i < sizeof(ROM_WORKLOADS) / sizeof(ROM_WORKLOADS[0]); i++) {
+		char path[4096];
+		snprintf(path, sizeof(path), "%s/%s", rom_dir, ROM_WORKLOADS[i]);
+		Cartridge cart = cartridge_load(path);
+		fprintf(out, "%s", is_first ? "" : ",\n");
+		is_first = false;
+		if (!cart.is_load_success) {
+			fprintf(stderr, "suite: %s not found, skipped\n", path);
+			fprintf(out, "    {\n      \"name\": \"%s\",\n      \"kind\": \"rom\",\n      \"skipped\": true\n    }", ROM_WORKLOADS[i]);
+			continue;
+		}
+		Result result = run(&cart, frames);
+		cartridge_free(&cart);
+		write_result(out, ROM_WORKLOADS[i], "rom", &result, frames);
+	}
+	fprintf(out, "\n  ]\n}\n");
+
+	if (output != NULL && fclose(out) != 0) {
+		fprintf(stderr, "Could not write %s\n", output);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,46 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "./bench.h"
+#include "ppu.h"
+#include "tile_decode.h"
+
+#define ROWS_PER_CALL 8
+#define CALLS 4000000
+
+
+// NOTE: One tile per call, the way the tile cache decodes
+static double rows_per_second(TileDecodeFn decode) {
+	static uint8_t planes[4096][16];
+	static uint8_t out[ROWS_PER_CALL * 8];
+	srand(7);
+	for (uint16_t i = 0; i < 4096; i++)
+		for (uint8_t j = 0; j < 16; j++)
+			planes[i][j] = rand() & 0xFF;
+
+	uint64_t checksum = 0;
+	double start = now_seconds();
+	for (uint32_t i = 0; i < CALLS; i++) {
+		decode(planes[i & 4095], ROWS_PER_CALL, PALETTE_IDENTITY ^ (i & 0xFF), out);
+		checksum += out[i & 63];
+	}
+	double elapsed = now_seconds() - start;
+
+	// NOTE: Keeps the decoded rows alive
+	if (checksum == 0)
+		printf(" ");
+	return CALLS * (double)ROWS_PER_CALL / elapsed / 1e6;
+}
+
+
+int main(void) {
+	for (uint8_t kernel = 0; kernel < TILE_DECODE_KERNEL_COUNT; kernel++) {
+		TileDecodeFn decode = tile_decode_kernel(kernel);
+		if (decode == NULL)
+			printf("tile_decode (%s): unsupported\n", tile_decode_kernel_name(kernel));
+		else
+			printf("tile_decode (%s): %.2f M rows/s\n", tile_decode_kernel_name(kernel), rows_per_second(decode));
+	}
+	return 0;
+}
@@ -0,0 +1,59 @@
+#ifndef BLOCK_CACHE_H
+#define BLOCK_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "memory.h"
+
+#define BLOCK_CACHE_SIZE 1024
+#define BLOCK_MAX_OPS 32
+
+
+typedef struct {
+	uint8_t opcode;
+	uint8_t length;
+	uint16_t operand;
+} DecodedOp;
+
+
+// NOTE: A straight-line run of instructions, ending at the first jump, call, return or halt
+typedef struct {
+	bool is_valid;
+	uint16_t bank;
+	uint16_t start;
+	uint16_t end;
+	uint8_t size;
+	DecodedOp ops[BLOCK_MAX_OPS];
+} Block;
+
+
+typedef struct {
+	Block blocks[BLOCK_CACHE_SIZE];
+
+	// NOTE: Number of cached blocks covering each byte of RAM, so writes to data can skip invalidation
+	uint8_t wram_code[WRAM_SIZE];
+	uint8_t highram_code[HIGHRAM_SIZE];
+	// NOTE: Bytes of each WRAM page covered by a block, the memory map write-protects pages with code
+	uint16_t wram_page_code[WRAM_SIZE / MEMORY_PAGE_SIZE];
+
+	Block *current;
+	uint8_t next_op;
+	uint16_t next_pc;
+
+	DecodedOp uncached;
+} BlockCache;
+
+
+BlockCache* block_cache_create();
+void block_cache_destroy(BlockCache *cache);
+
+struct emulator;
+DecodedOp block_cache_decode(struct emulator *emu, uint16_t address);
+// NOTE: The block starting at pc, decoded on a miss. NULL when pc is not in cacheable memory
+Block* block_cache_lookup(struct emulator *emu, uint16_t pc);
+const DecodedOp* block_cache_fetch(struct emulator *emu, uint16_t pc);
+void block_cache_invalidate(struct emulator *emu, uint16_t address);
+
+
+#endif // BLOCK_CACHE_H
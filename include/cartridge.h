@@ -8,6 +8,22 @@
 
 typedef enum {
 	CARTRIDGE_TYPE_0_ROM_ONLY = 0x00,
+	CARTRIDGE_TYPE_1_MBC1 = 0x01,
+	CARTRIDGE_TYPE_2_MBC1_RAM = 0x02,
+	CARTRIDGE_TYPE_3_MBC1_RAM_BATTERY = 0x03,
+	CARTRIDGE_TYPE_5_MBC2 = 0x05,
+	CARTRIDGE_TYPE_6_MBC2_BATTERY = 0x06,
+	CARTRIDGE_TYPE_F_MBC3_TIMER_BATTERY = 0x0F,
+	CARTRIDGE_TYPE_10_MBC3_TIMER_RAM_BATTERY = 0x10,
+	CARTRIDGE_TYPE_11_MBC3 = 0x11,
+	CARTRIDGE_TYPE_12_MBC3_RAM = 0x12,
+	CARTRIDGE_TYPE_13_MBC3_RAM_BATTERY = 0x13,
+	CARTRIDGE_TYPE_19_MBC5 = 0x19,
+	CARTRIDGE_TYPE_1A_MBC5_RAM = 0x1A,
+	CARTRIDGE_TYPE_1B_MBC5_RAM_BATTERY = 0x1B,
+	CARTRIDGE_TYPE_1C_MBC5_RUMBLE = 0x1C,
+	CARTRIDGE_TYPE_1D_MBC5_RUMBLE_RAM = 0x1D,
+	CARTRIDGE_TYPE_1E_MBC5_RUMBLE_RAM_BATTERY = 0x1E,
 } CartridgeType;
 
 typedef enum {
@@ -30,6 +46,7 @@ typedef enum {
 	RAM_SIZE_64KBIT= 2,
 	RAM_SIZE_256KBIT = 3,
 	RAM_SIZE_1MBIT = 4,
+	RAM_SIZE_512KBIT = 5,
 } RAMSize;
 
 typedef enum {
@@ -46,8 +63,10 @@ typedef enum {
 
 typedef struct {
 	bool is_load_success;
+	// NOTE: Mapped read only when loaded from a regular file, writing to it crashes
 	uint8_t *content;
 	size_t size;
+	bool is_mapped;
 	char title[17];
 	uint16_t licensee;
 	bool is_color;
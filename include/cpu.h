@@ -17,8 +17,19 @@ typedef struct {
 	uint16_t pc;
 	uint16_t sp;
 
+	// NOTE: Last 8 bit ALU operation, whose flags are not written to f yet (see CPU_LAZY_FLAGS)
+	struct {
+		uint8_t op;
+		uint8_t lhs;
+		uint8_t rhs;
+		uint8_t carry;
+		uint8_t result;
+	} lazy_flags;
+
 	uint8_t opcode_length;
 	uint8_t cycles;
+	// NOTE: Immediate d8/a8/r8/d16/a16 of the instruction being executed
+	uint16_t operand;
 
 	bool ime_scheduled;
 
@@ -30,8 +41,23 @@ typedef struct {
 
 CPU cpu_create();
 
+// NOTE: What cpu_run_block went through, so the frame loop can still do its checks per block
+typedef struct {
+	uint32_t cycles;
+	// NOTE: Calls to cpu_step it stands for, an interrupt dispatch counts as one
+	uint16_t steps;
+	// NOTE: Address of the last instruction run, a jump back from it closes a loop
+	uint16_t last_pc;
+} BlockRun;
+
+
 struct emulator;
 uint8_t cpu_step(struct emulator *emu);
+// NOTE: Whether the next op can skip the checks at the top of cpu_step
+bool cpu_can_run_ahead(struct emulator *emu);
+// NOTE: Steps once, then runs the rest of the cached block without leaving the loop, up to the
+//  scheduler deadline. The clock is advanced after every instruction
+BlockRun cpu_run_block(struct emulator *emu);
 
 
 #endif // CPU_H
@@ -0,0 +1,27 @@
+#ifndef DIFF_H
+#define DIFF_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+// NOTE: Differential mode runs a shadow copy of the machine on the plain interpreter (no block cache)
+//  next to the real one, and stops at the first block run where the two disagree
+typedef struct {
+	struct emulator *shadow;
+	uint64_t instructions;
+	uint16_t last_pc;
+	bool has_diverged;
+} Diff;
+
+
+struct emulator;
+bool diff_enable(struct emulator *emu);
+void diff_disable(struct emulator *emu);
+
+// NOTE: Steps the shadow as many times as the real machine did, then compares them
+void diff_step(struct emulator *emu, uint16_t steps, uint32_t cycles);
+void diff_end_frame(struct emulator *emu);
+
+
+#endif // DIFF_H
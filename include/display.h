@@ -1,22 +1,42 @@
 #ifndef DISPLAY_H
 #define DISPLAY_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #define DISPLAY_WIDTH 160
 #define DISPLAY_HEIGHT 144
 
+// NOTE: Color index, 0 to 3
 typedef uint16_t GBColor;
 
+// NOTE: R, G, B and A bytes in memory order, the layout of PIXELFORMAT_UNCOMPRESSED_R8G8B8A8
+typedef uint32_t RGBA;
+
 typedef struct {
-	GBColor screen[DISPLAY_HEIGHT][DISPLAY_WIDTH];
+	// NOTE: Uploaded as is by the frontend
+	RGBA framebuffer[DISPLAY_HEIGHT][DISPLAY_WIDTH];
+	RGBA palette[4];
+
+	// NOTE: Lines whose pixels changed since the consumer last called display_clear_dirty
+	uint64_t dirty[(DISPLAY_HEIGHT + 63) / 64];
+	uint8_t dirty_lines;
 } Display;
 
 
 Display display_create();
+RGBA display_rgba(uint8_t r, uint8_t g, uint8_t b, uint8_t a);
+void display_set_palette(Display *display, const RGBA palette[4]);
+
+static inline bool display_is_changed(Display *display) { return display->dirty_lines > 0; }
+bool display_is_line_dirty(Display *display, uint8_t y);
+// NOTE: Finds the next run of dirty lines [start, end) from `start`. Returns false when there is none
+bool display_next_dirty_range(Display *display, uint8_t *start, uint8_t *end);
+void display_clear_dirty(Display *display);
 
 struct emulator;
 void display_set(struct emulator *emu, uint8_t x, uint8_t y, GBColor color);
+void display_set_line(struct emulator *emu, uint8_t y, const uint8_t colors[DISPLAY_WIDTH]);
 void display_dump(struct emulator *emu);
 
 #endif // DISPLAY_H
@@ -1,32 +1,73 @@
 #ifndef EMULATOR_H
 #define EMULATOR_H
 
+#include "block_cache.h"
 #include "cpu.h"
+#include "diff.h"
 #include "display.h"
+#include "idle.h"
 #include "interrupts.h"
+#include "io.h"
+#include "jit.h"
 #include "joypad.h"
+#include "mbc.h"
 #include "memory.h"
 #include "cartridge.h"
 #include "ppu.h"
+#include "scheduler.h"
 #include "timer.h"
 
 
 typedef struct emulator {
 	CPU cpu;
 	Memory *memory;
+	MemoryMap memory_map;
+	// NOTE: Set with emulator_insert_cartridge, so the ROM pages get mapped
 	Cartridge *cartridge;
+	MBC mbc;
 	Timer timer;
 	Interrupt interrupt;
+	IOBus io;
 	Display display;
 	PPU ppu;
 	Joypad joypad;
+	Scheduler scheduler;
+	BlockCache *block_cache;
+	IdleDetector *idle;
+	Diff *diff;
+	// NOTE: Only set with jit_enable
+	Jit *jit;
+
+	// NOTE: Which frames the PPU draws pixels for, see emulator_set_frameskip
+	struct {
+		uint32_t frameskip;
+		uint32_t skipped;
+		bool is_on_demand;
+		bool is_requested;
+		// NOTE: Frames drawn from line 0 to VBlank, the framebuffer holds a whole one when it changes
+		uint64_t frames_drawn;
+	} render;
 } Emulator;
 
 
 Emulator emulator_create();
 void emulator_destroy(Emulator* emulator);
+Emulator emulator_clone(Emulator* emulator);
+void emulator_insert_cartridge(Emulator* emulator, Cartridge* cartridge);
 
 void emulator_run_frame(Emulator* emulator);
+void emulator_advance(Emulator* emulator, uint32_t cycles);
+
+// NOTE: Draws one frame, then skips the pixels of the next `frameskip` ones. Skipped frames
+//  keep the exact PPU timing, registers and interrupts, the framebuffer keeps the last drawn frame
+void emulator_set_frameskip(Emulator* emulator, uint32_t frameskip);
+// NOTE: Only draws the frames asked for with emulator_request_frame
+void emulator_set_render_on_demand(Emulator* emulator, bool is_on_demand);
+void emulator_request_frame(Emulator* emulator);
+// NOTE: Asked by the PPU when it starts a frame
+bool emulator_should_render(Emulator* emulator);
+// NOTE: Told by the PPU when it enters VBlank after drawing a frame
+void emulator_frame_drawn(Emulator* emulator);
 
 
 #endif // EMULATOR_H
@@ -0,0 +1,30 @@
+#ifndef IDLE_H
+#define IDLE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define IDLE_MAX_OPS 16
+
+
+// NOTE: Detects polling loops (e.g. LDH A,(FF44) / CP / JR NZ) that only read registers and
+//  known memory, and skips the iterations that would read the same values again
+typedef struct {
+	// NOTE: Loop heads that can not idle, cleared every frame in case the code changed
+	uint8_t rejected[0x10000 / 8];
+	// NOTE: Loop heads whose last iteration changed registers, e.g. right after LY moved on.
+	//  A second such iteration in a row means the loop is counting and gets rejected
+	uint8_t unsettled[0x10000 / 8];
+	uint64_t skipped_cycles;
+} IdleDetector;
+
+
+IdleDetector* idle_create();
+void idle_destroy(IdleDetector *idle);
+void idle_reset(IdleDetector *idle);
+
+struct emulator;
+uint32_t idle_skip(struct emulator *emu, uint32_t max_cycles);
+
+
+#endif // IDLE_H
@@ -4,6 +4,8 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "io.h"
+
 
 typedef enum {
 	INTERRUPT_STATE_IDLE,
@@ -48,6 +50,11 @@ uint8_t interrupt_step(struct emulator *emu);
 void interrupt_trigger(struct emulator *emu, InterruptFlag flag);
 uint8_t interrupt_pending(struct emulator *emu);
 bool is_interrupt_handler_running(struct emulator *emu);
+// NOTE: Lower bound on the cycles until an enabled interrupt gets requested by the hardware
+uint32_t interrupt_cycles_until_pending(struct emulator *emu);
+
+// NOTE: IF only, IE lives outside the I/O range
+void interrupt_register_io(IOBus *io);
 
 
 #endif // INTERRUPT_H
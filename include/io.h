@@ -0,0 +1,45 @@
+#ifndef IO_H
+#define IO_H
+
+#include <stdint.h>
+
+#define IO_START 0xFF00
+#define IO_REGISTER_COUNT 0x80
+
+
+struct emulator;
+typedef uint8_t (*IORead)(struct emulator *emu, uint16_t address);
+typedef void (*IOWrite)(struct emulator *emu, uint16_t address, uint8_t value);
+
+
+// NOTE: Which lagging subsystem catches up before the register is accessed, see Scheduler.
+//  Writes to timer and PPU registers also reschedule their next event
+typedef enum {
+	IO_SYNC_NONE,
+	IO_SYNC_TIMER,
+	IO_SYNC_PPU,
+	IO_SYNC_ALL,
+} IOSync;
+
+typedef struct {
+	IORead read;
+	IOWrite write;
+	IOSync sync;
+} IORegister;
+
+
+// NOTE: The registers at 0xFF00-0xFF7F. Each subsystem registers its own at init,
+//  the rest read 0xFF and ignore writes
+typedef struct {
+	IORegister registers[IO_REGISTER_COUNT];
+} IOBus;
+
+
+IOBus io_create();
+void io_register(IOBus *io, uint16_t address, IORead read, IOWrite write, IOSync sync);
+
+uint8_t io_read(struct emulator *emu, uint16_t address);
+void io_write(struct emulator *emu, uint16_t address, uint8_t value);
+
+
+#endif // IO_H
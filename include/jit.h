@@ -0,0 +1,53 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "block_cache.h"
+#include "cpu.h"
+
+// NOTE: Runs of a ROM block before it gets translated
+#define JIT_HOT_RUNS 8
+#define JIT_ARENA_SIZE (4 * 1024 * 1024)
+// NOTE: Upper bound on the native code of one block, the arena is flushed when less is left
+#define JIT_BLOCK_CODE_SIZE (16 * 1024)
+
+
+// NOTE: Native code for the block in the same slot of the block cache, tagged like the block
+typedef struct {
+	void *code;
+	uint16_t start;
+	uint16_t bank;
+	uint8_t runs;
+} JitEntry;
+
+
+// NOTE: Translates hot blocks from the cartridge ROM to x86-64, built with JIT=on. The SM83
+//  registers live in host registers while a block runs, and it leaves through an exit that
+//  stores them back with the exact cycles taken. RAM code, which may modify itself, stays on
+//  the block cache. Without JIT=on, or on other hosts, jit_enable fails
+typedef struct {
+	JitEntry entries[BLOCK_CACHE_SIZE];
+	uint8_t *arena;
+	size_t arena_used;
+
+	uint64_t blocks_translated;
+	uint64_t blocks_run;
+} Jit;
+
+
+struct emulator;
+bool jit_enable(struct emulator *emu);
+void jit_disable(struct emulator *emu);
+// NOTE: Drops all native code, e.g. when another cartridge goes in
+void jit_flush(Jit *jit);
+
+// NOTE: Runs the block at pc natively, from its first op up to its end, the scheduler deadline,
+//  or the first op after which cpu_step has to check for interrupts again.
+//  Returns false when the block is not translated (yet), and nothing was run
+bool jit_run(struct emulator *emu, BlockRun *run);
+
+
+#endif // JIT_H
@@ -4,6 +4,8 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "io.h"
+
 
 typedef enum {
 	GB_BUTTON_RIGHT,
@@ -33,4 +35,6 @@ struct emulator;
 void joypad_press(struct emulator *emu, JoypadButton button);
 void joypad_release(struct emulator *emu, JoypadButton button);
 
+void joypad_register_io(IOBus *io);
+
 #endif // JOYPAD_H
@@ -0,0 +1,84 @@
+#ifndef MBC_H
+#define MBC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cartridge.h"
+#include "rtc.h"
+#include "save.h"
+
+#define ROM_BANK_SIZE 0x4000
+#define RAM_BANK_SIZE 0x2000
+#define MBC2_RAM_SIZE 0x200
+
+
+typedef enum {
+	MBC_NONE,
+	MBC_1,
+	MBC_2,
+	MBC_3,
+	MBC_5,
+} MBCType;
+
+
+// NOTE: The bank controller of the inserted cartridge. Writes to 0x0000-0x7FFF set its registers,
+//  which only move the ROM and RAM windows of the memory map
+typedef struct {
+	MBCType type;
+	bool has_battery;
+	bool has_timer;
+	bool has_rumble;
+
+	// NOTE: External RAM, MBC2 keeps its 512 nibbles here with the upper 4 bits set
+	uint8_t *ram;
+	size_t ram_size;
+	// NOTE: Set when the RAM is mapped from a .sav file, RAM pages then only become writable once dirty
+	SaveFile *save;
+	uint16_t rom_bank_count;
+	// NOTE: MBC3 clock, its trailer follows the RAM in the save
+	RTC rtc;
+
+	// NOTE: Registers as written
+	bool is_ram_enabled;
+	uint16_t rom_bank_register;
+	uint8_t ram_bank_register;
+	bool is_advanced_mode;
+
+	// NOTE: Banks currently in the 0x0000-0x3FFF, 0x4000-0x7FFF and 0xA000-0xBFFF windows
+	uint16_t rom_bank_low;
+	uint16_t rom_bank_high;
+	uint8_t ram_bank;
+} MBC;
+
+
+MBC mbc_create(Cartridge *cartridge);
+MBC mbc_clone(MBC *mbc);
+void mbc_destroy(MBC *mbc);
+
+// NOTE: Offset into the ROM of a 0x0000-0x7FFF address
+static inline size_t mbc_rom_offset(MBC *mbc, uint16_t address) {
+	uint16_t bank = address < ROM_BANK_SIZE ? mbc->rom_bank_low : mbc->rom_bank_high;
+	return (size_t)bank * ROM_BANK_SIZE + (address % ROM_BANK_SIZE);
+}
+
+// NOTE: Host memory behind a 0xA000-0xBFFF page, NULL when it has to go through mbc_ram_read/write
+uint8_t* mbc_ram_page(MBC *mbc, uint16_t address, bool is_write);
+
+struct emulator;
+void mbc_write(struct emulator *emu, uint16_t address, uint8_t value);
+uint8_t mbc_ram_read(struct emulator *emu, uint16_t address);
+void mbc_ram_write(struct emulator *emu, uint16_t address, uint8_t value);
+
+// NOTE: Moves battery backed RAM into `filename`, loading what is already saved there
+bool mbc_attach_save(struct emulator *emu, const char *filename);
+// NOTE: Queues the pages written during the frame for the flush thread
+void mbc_end_frame(struct emulator *emu);
+// NOTE: Stores the clock in the save, before the cartridge is pulled out
+void mbc_eject(struct emulator *emu);
+// NOTE: Runs the clock on host seconds instead of emulated cycles
+void mbc_set_clock_source(struct emulator *emu, bool is_host_time);
+
+
+#endif // MBC_H
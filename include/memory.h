@@ -4,10 +4,16 @@
 
 #include <stdint.h>
 
+#define WRAM_SIZE 0x2000
+#define HIGHRAM_SIZE 0x7F
+
+#define MEMORY_PAGE_SIZE 0x100
+#define MEMORY_PAGE_COUNT 0x100
+
 
 typedef struct {
-	uint8_t wram[8191];
-	uint8_t highram[127];
+	uint8_t wram[WRAM_SIZE];
+	uint8_t highram[HIGHRAM_SIZE];
 	// NOTE: This is here temporarily
 	//  This should be moved somewhere else
 	uint8_t interrupt_enabled;
@@ -15,6 +21,15 @@ typedef struct {
 	uint8_t temp_vram[0x2000];
 } Memory;
 
+// NOTE: Host pointers to the start of every 256 byte page of the address space, separate for
+//  reads and writes. NULL sends the access to the handlers in memory_map.c, which covers I/O,
+//  VRAM and OAM, anything unmapped, and WRAM pages holding cached code for writes
+typedef struct {
+	uint8_t *read[MEMORY_PAGE_COUNT];
+	uint8_t *write[MEMORY_PAGE_COUNT];
+} MemoryMap;
+
+
 Memory* memory_create();
 void memory_destroy(Memory *memory);
 
@@ -4,9 +4,35 @@
 #include <stdint.h>
 
 #include "emulator.h"
+#include "profile.h"
 
-uint8_t memory_read(Emulator *emu, uint16_t address);
-void memory_write(Emulator *emu, uint16_t address, uint8_t value);
+// NOTE: The slow path, for pages without a host pointer
+uint8_t memory_read_handler(Emulator *emu, uint16_t address);
+void memory_write_handler(Emulator *emu, uint16_t address, uint8_t value);
+
+// NOTE: Has to be called whenever what backs a page changes, e.g. a bank switch or a new cartridge.
+//  Updating a WRAM page also updates its echo
+void memory_map_update_page(Emulator *emu, uint8_t page);
+void memory_map_rebuild(Emulator *emu);
+
+
+static inline uint8_t memory_read(Emulator *emu, uint16_t address) {
+	PROFILE_ENTER(PROFILE_MEMORY);
+	uint8_t *page = emu->memory_map.read[address >> 8];
+	uint8_t value = page != NULL ? page[address & 0xFF] : memory_read_handler(emu, address);
+	PROFILE_LEAVE();
+	return value;
+}
+
+static inline void memory_write(Emulator *emu, uint16_t address, uint8_t value) {
+	PROFILE_ENTER(PROFILE_MEMORY);
+	uint8_t *page = emu->memory_map.write[address >> 8];
+	if (page != NULL)
+		page[address & 0xFF] = value;
+	else
+		memory_write_handler(emu, address, value);
+	PROFILE_LEAVE();
+}
 
 void memory_write_16(Emulator *emu, uint16_t address, uint16_t value);
 uint16_t memory_read_16(Emulator *emu, uint16_t address);
@@ -3,9 +3,18 @@
 
 
 #include "emulator.h"
+#include <stdbool.h>
 #include <stdint.h>
 
 void opcode_execute(Emulator* emulator, uint8_t opcode);
+// NOTE: Runs the rest of the current cached block into run, the handlers chain from one op to
+//  the next without coming back here. Stops where cpu_run_block would stop
+void opcode_run(Emulator* emulator, BlockRun *run);
+
+void opcode_sync_flags(Emulator *emulator);
+
+uint8_t opcode_length(uint8_t opcode);
+bool opcode_ends_block(uint8_t opcode);
 
 
 #endif // OPCODE_H
@@ -1,14 +1,16 @@
 #ifndef PPU_H
 #define PPU_H
 
-#include <assert.h>
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "io.h"
+
 #define VRAM_SIZE 0x2000
 #define TILEMAP_SIZE 0x400
 #define OAM_SIZE 0xA0
 #define SPRITE_OBJECT_SIZE 40
+#define TILE_COUNT 384
 
 typedef enum {
 	PPU_MODE_HBLANK,
@@ -18,16 +20,40 @@ typedef enum {
 } PPUMode;
 
 
+// NOTE: Tiles of VRAM expanded to one color index per pixel, by [tile][y][x]. Objects flipped
+//  on X read the mirrored copy. A write to the tile data marks the tile to decode again
+typedef struct {
+	uint8_t pixels[TILE_COUNT][8][8];
+	uint8_t flipped[TILE_COUNT][8][8];
+	bool dirty[TILE_COUNT];
+} TileCache;
+
+
+// NOTE: Objects on each LY, as a mask of their OAM index. Follows the Y bytes written to OAM,
+//  and is rebuilt when the object size changes
+typedef struct {
+	uint64_t lines[256];
+	bool is_tall;
+	bool is_dirty;
+} ObjectIndex;
+
+
 typedef struct {
 	PPUMode mode;
 
 	uint8_t *vram;
 	uint8_t *oam;
+	TileCache *tile_cache;
+	// NOTE: Objects of the line, sorted by priority, and the pixels they cover
 	uint8_t objects_to_render[10];
+	uint64_t object_coverage[3];
+	ObjectIndex object_index;
 
 	uint32_t dot_clock;
 	uint8_t line;
 	uint8_t x;
+	// NOTE: Drawing still takes its dots, but no pixels are computed
+	bool is_frame_skipped;
 
 	uint8_t stat;
 	uint8_t bgp;
@@ -49,6 +75,7 @@ typedef struct {
 
 
 PPU ppu_create();
+PPU ppu_clone(PPU *ppu);
 void ppu_destroy(PPU *ppu);
 
 uint8_t ppu_vram_read(PPU *ppu, uint16_t address);
@@ -61,10 +88,18 @@ void ppu_oam_write(PPU *ppu, uint16_t address, uint8_t value);
 uint8_t ppu_lcdc_read(PPU *ppu);
 void ppu_lcdc_write(PPU *ppu, uint8_t value);
 
+// NOTE: Lower bounds on the dots until the PPU changes LY, its mode, or raises VBlank
+uint32_t ppu_cycles_until_line_change(PPU *ppu);
+uint32_t ppu_cycles_until_mode_change(PPU *ppu);
+uint32_t ppu_cycles_until_vblank(PPU *ppu);
+
 struct emulator;
-void ppu_step(struct emulator *emu, uint8_t cycles);
+void ppu_step(struct emulator *emu, uint16_t cycles);
 void ppu_oam_dma_write(struct emulator *emu, uint16_t value);
 
+// NOTE: LCDC, STAT, SCY, SCX, LY, DMA and BGP
+void ppu_register_io(IOBus *io);
+
 
 typedef union {
 	struct {
@@ -82,9 +117,9 @@ typedef struct {
 } SpriteObject;
 
 
-static_assert(sizeof(TileData) == 16, "Tiledata should be 16 bytes long");
-static_assert(sizeof(SpriteObject) == 4, "SpriteObject should be 4 bytes long");
-static_assert(sizeof(SpriteObject) * SPRITE_OBJECT_SIZE == OAM_SIZE, "OAM should contain 40 objects");
+_Static_assert(sizeof(TileData) == 16, "Tiledata should be 16 bytes long");
+_Static_assert(sizeof(SpriteObject) == 4, "SpriteObject should be 4 bytes long");
+_Static_assert(sizeof(SpriteObject) * SPRITE_OBJECT_SIZE == OAM_SIZE, "OAM should contain 40 objects");
 
 
 #define OBJ_ATTR_PRIO		(1 << 7)
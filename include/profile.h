@@ -0,0 +1,99 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+// NOTE: Sections nest at most as CPU, memory, then the timer or PPU catching up
+#define PROFILE_MAX_DEPTH 16
+
+
+typedef enum {
+	// NOTE: Everything outside the other sections, e.g. the frame loop and idle detection
+	PROFILE_OTHER,
+	PROFILE_CPU,
+	PROFILE_TIMER,
+	PROFILE_PPU,
+	PROFILE_MEMORY,
+	PROFILE_COUNT,
+} ProfileSection;
+
+
+// NOTE: Exclusive time of each section, a memory access inside cpu_step is only counted as memory.
+//  Calls are counted all the time, ticks only between profile_start and profile_stop
+typedef struct {
+	uint64_t calls[PROFILE_COUNT];
+	uint64_t ticks[PROFILE_COUNT];
+
+	bool is_enabled;
+	uint64_t last;
+	uint8_t depth;
+	ProfileSection stack[PROFILE_MAX_DEPTH];
+} Profile;
+
+extern Profile profile;
+
+
+// NOTE: The TSC where there is one, only ratios between sections matter
+static inline uint64_t profile_now() {
+#if defined(__GNUC__) && defined(__x86_64__)
+	return __rdtsc();
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+static inline ProfileSection profile_current() {
+	return profile.depth > 0 ? profile.stack[profile.depth - 1] : PROFILE_OTHER;
+}
+
+static inline void profile_enter(ProfileSection section) {
+	profile.calls[section]++;
+	if (!profile.is_enabled)
+		return;
+	uint64_t now = profile_now();
+	profile.ticks[profile_current()] += now - profile.last;
+	profile.last = now;
+	profile.stack[profile.depth++] = section;
+}
+
+static inline void profile_leave() {
+	if (!profile.is_enabled)
+		return;
+	uint64_t now = profile_now();
+	profile.ticks[profile_current()] += now - profile.last;
+	profile.last = now;
+	profile.depth--;
+}
+
+// NOTE: Counts calls without entering the section, for work that ran inside one PROFILE_ENTER
+static inline void profile_count(ProfileSection section, uint64_t calls) {
+	profile.calls[section] += calls;
+}
+
+void profile_reset();
+void profile_start();
+void profile_stop();
+
+
+// NOTE: The hooks only exist in builds with PROFILE_SECTIONS, which `make bench` turns on
+#ifdef PROFILE_SECTIONS
+#define PROFILE_ENTER(section) profile_enter(section)
+#define PROFILE_LEAVE() profile_leave()
+#define PROFILE_COUNT_CALLS(section, calls) profile_count(section, calls)
+#else
+#define PROFILE_ENTER(section) ((void)0)
+#define PROFILE_LEAVE() ((void)0)
+#define PROFILE_COUNT_CALLS(section, calls) ((void)0)
+#endif
+
+
+#endif // PROFILE_H
@@ -0,0 +1,49 @@
+#ifndef RTC_H
+#define RTC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define RTC_CYCLES_PER_SECOND 4194304
+// NOTE: The trailer emulators append to the RAM in .sav files
+#define RTC_SAVE_SIZE 48
+
+typedef enum {
+	RTC_SECONDS,
+	RTC_MINUTES,
+	RTC_HOURS,
+	RTC_DAY_LOW,
+	RTC_DAY_HIGH,
+	RTC_REGISTER_COUNT,
+} RTCRegister;
+
+#define RTC_DAY_HIGH_BIT 0b00000001
+#define RTC_HALT_BIT 0b01000000
+#define RTC_CARRY_BIT 0b10000000
+
+
+// NOTE: The MBC3 clock never ticks on its own. The registers hold the time at `base`,
+//  and only catch up to the elapsed cycles, or host seconds, when they are latched or written
+typedef struct {
+	uint8_t registers[RTC_REGISTER_COUNT];
+	uint8_t latched[RTC_REGISTER_COUNT];
+	uint64_t base;
+	bool is_host_time;
+	bool is_latch_armed;
+} RTC;
+
+
+RTC rtc_create();
+
+// NOTE: Advances the registers to `now`, in cycles or host seconds depending on the source
+void rtc_sync(RTC *rtc, uint64_t now);
+void rtc_latch(RTC *rtc, uint64_t now);
+void rtc_write(RTC *rtc, RTCRegister reg, uint8_t value, uint64_t now);
+
+// NOTE: The trailer keeps the registers with the host time they were stored at. Loading it
+//  on host time adds the time that passed since, like the battery would have
+void rtc_store(RTC *rtc, uint8_t *trailer, uint64_t now);
+void rtc_load(RTC *rtc, const uint8_t *trailer, uint64_t now);
+
+
+#endif // RTC_H
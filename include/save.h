@@ -0,0 +1,65 @@
+#ifndef SAVE_H
+#define SAVE_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "memory.h"
+
+// NOTE: The largest RAM, with a page for the clock after it
+#define SAVE_MAX_SIZE (0x20000 + MEMORY_PAGE_SIZE)
+#define SAVE_DIRTY_WORDS ((SAVE_MAX_SIZE / MEMORY_PAGE_SIZE + 63) / 64)
+#define SAVE_FLUSH_INTERVAL_MS 1000
+
+
+// NOTE: Battery backed RAM mapped straight from the .sav file, shared with the file. Dirty tracking is
+//  per page of the memory map: the emulation thread marks pages in `dirty`, hands them over through
+//  `pending` at the end of a frame, and the flush thread syncs them. Only the flush thread waits on disk
+typedef struct {
+	uint8_t *data;
+	size_t size;
+#ifdef _WIN32
+	// NOTE: HANDLEs, windows.h stays out of the header since it clashes with raylib
+	void *file;
+	void *mapping;
+#endif
+
+	// NOTE: Only touched by the emulation thread
+	uint64_t dirty[SAVE_DIRTY_WORDS];
+	_Atomic uint64_t pending[SAVE_DIRTY_WORDS];
+
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	bool is_running;
+	bool is_flush_requested;
+} SaveFile;
+
+
+// NOTE: Creates or extends the file to at least `size` bytes. A new file starts out as `initial`
+SaveFile* save_open(const char *filename, size_t size, const uint8_t *initial);
+// NOTE: Flushes everything left and unmaps the file
+void save_close(SaveFile *save);
+
+static inline bool save_is_dirty(SaveFile *save, size_t offset) {
+	size_t chunk = offset / MEMORY_PAGE_SIZE;
+	return (save->dirty[chunk / 64] >> (chunk % 64)) & 0b1;
+}
+
+static inline void save_mark_dirty(SaveFile *save, size_t offset) {
+	size_t chunk = offset / MEMORY_PAGE_SIZE;
+	save->dirty[chunk / 64] |= 1ull << (chunk % 64);
+}
+
+// NOTE: Queues the dirty pages for the next flush, returns false when there were none
+bool save_hand_over(SaveFile *save);
+// NOTE: Wakes the flush thread up without waiting for the interval
+void save_request_flush(SaveFile *save);
+// NOTE: msyncs the queued pages on the calling thread
+void save_flush(SaveFile *save);
+
+
+#endif // SAVE_H
@@ -0,0 +1,62 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+typedef enum {
+	EVENT_FRAME_END,
+	// NOTE: Next TIMA overflow interrupt
+	EVENT_TIMER,
+	// NOTE: Next VBlank interrupt, the only one the PPU raises
+	EVENT_PPU,
+	EVENT_COUNT,
+} EventType;
+
+
+typedef struct {
+	uint64_t deadline;
+	EventType type;
+} Event;
+
+
+// NOTE: The CPU runs freely up to the earliest deadline, while the timer and PPU lag behind the
+//  master clock. Each catches up when its event is due, or when the CPU touches its registers
+//  (or VRAM and OAM for the PPU), so everything the CPU observes is the same as when stepping
+//  them every instruction
+typedef struct {
+	uint64_t clock;
+	// NOTE: Where the last frame was meant to end, the CPU usually runs a few cycles past it
+	uint64_t frame_end;
+	// NOTE: Cycle the timer and PPU have been brought up to
+	uint64_t timer_synced;
+	uint64_t ppu_synced;
+
+	// NOTE: Min-heap on the deadline, with at most one entry per event type
+	Event heap[EVENT_COUNT];
+	uint8_t size;
+	// NOTE: Heap index + 1 of each event type, 0 when not scheduled
+	uint8_t position[EVENT_COUNT];
+} Scheduler;
+
+
+void scheduler_schedule(Scheduler *scheduler, EventType type, uint64_t deadline);
+void scheduler_cancel(Scheduler *scheduler, EventType type);
+bool scheduler_pop_due(Scheduler *scheduler, Event *event);
+
+static inline uint64_t scheduler_next_deadline(Scheduler *scheduler) {
+	return scheduler->size > 0 ? scheduler->heap[0].deadline : UINT64_MAX;
+}
+
+struct emulator;
+void scheduler_sync_timer(struct emulator *emu);
+void scheduler_sync_ppu(struct emulator *emu);
+void scheduler_sync(struct emulator *emu);
+
+// NOTE: Sync, then move the event to the next deadline of the new state
+void scheduler_reschedule_timer(struct emulator *emu);
+void scheduler_reschedule_ppu(struct emulator *emu);
+
+
+#endif // SCHEDULER_H
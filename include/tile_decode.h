@@ -0,0 +1,33 @@
+#ifndef TILE_DECODE_H
+#define TILE_DECODE_H
+
+#include <stdint.h>
+
+#include "ppu.h"
+
+// NOTE: BGP value mapping every color index to itself
+#define PALETTE_IDENTITY 0b11100100
+
+
+typedef enum {
+	TILE_DECODE_SCALAR,
+	TILE_DECODE_BMI2,
+	TILE_DECODE_SSE2,
+	TILE_DECODE_AVX2,
+	TILE_DECODE_KERNEL_COUNT,
+} TileDecodeKernel;
+
+
+// NOTE: Expands `rows` tile rows, each a lower and a higher bitplane byte as laid out in TileData,
+//  into 8 color indices per row, mapped through a BGP style `palette`
+typedef void (*TileDecodeFn)(const uint8_t *planes, uint16_t rows, uint8_t palette, uint8_t *out);
+
+// NOTE: NULL when the CPU does not support the kernel's instructions
+TileDecodeFn tile_decode_kernel(TileDecodeKernel kernel);
+const char* tile_decode_kernel_name(TileDecodeKernel kernel);
+
+// NOTE: Runs the fastest kernel the CPU supports
+void tile_decode(const uint8_t *planes, uint16_t rows, uint8_t palette, uint8_t *out);
+
+
+#endif // TILE_DECODE_H
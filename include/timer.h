@@ -4,6 +4,8 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "io.h"
+
 typedef enum {
 	TIMA_STATE_COUNTING,
 	TIMA_STATE_WILL_OVERFLOW,
@@ -25,7 +27,6 @@ typedef struct {
 
 	// NOTE: Used for timer quirks
 	bool is_cgb;
-	bool debug;
 } Timer;
 
 
@@ -41,4 +42,12 @@ uint8_t timer_div_read(struct emulator *emu);
 void timer_tac_write(struct emulator *emu, uint8_t value);
 uint8_t timer_tac_read(struct emulator *emu);
 
+// NOTE: Lower bounds, UINT32_MAX when the event can not happen without a register write
+uint32_t timer_cycles_until_div_change(struct emulator *emu);
+uint32_t timer_cycles_until_tima_change(struct emulator *emu);
+uint32_t timer_cycles_until_interrupt(struct emulator *emu);
+
+// NOTE: DIV, TIMA, TMA and TAC
+void timer_register_io(IOBus *io);
+
 #endif // TIMER_H
@@ -0,0 +1,191 @@
+#include "block_cache.h"
+#include "emulator.h"
+#include "memory_map.h"
+#include "opcode.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+BlockCache* block_cache_create() {
+	BlockCache *cache = malloc(sizeof(BlockCache));
+	assert(cache);
+	memset(cache, 0, sizeof(BlockCache));
+	return cache;
+}
+
+void block_cache_destroy(BlockCache *cache) { free(cache); }
+
+
+DecodedOp block_cache_decode(Emulator *emu, uint16_t address) {
+	DecodedOp op = {0};
+	op.opcode = memory_read(emu, address);
+	op.length = opcode_length(op.opcode);
+	if (op.length == 2)
+		op.operand = memory_read(emu, address + 1);
+	else if (op.length == 3)
+		op.operand = memory_read_16(emu, address + 1);
+	return op;
+}
+
+
+// NOTE: Only memory without side effects on read can be decoded ahead of time.
+//  Returns the last address of the region, or 0 when the address is not cacheable
+static inline uint16_t region_end(uint16_t address) {
+	if (address <= 0x3FFF) return 0x3FFF;
+	if (address <= 0x7FFF) return 0x7FFF;
+	if (address >= 0xC000 && address <= 0xDFFF) return 0xDFFF;
+	if (address >= 0xFF80 && address <= 0xFFFE) return 0xFFFE;
+	return 0;
+}
+
+// NOTE: Blocks in ROM are tagged with the bank they were decoded from
+static inline uint16_t current_bank(Emulator *emu, uint16_t address) {
+	if (address <= 0x3FFF)
+		return emu->mbc.rom_bank_low;
+	if (address <= 0x7FFF)
+		return emu->mbc.rom_bank_high;
+	return 0;
+}
+
+static inline uint8_t* code_counter(BlockCache *cache, uint16_t address) {
+	if (address >= 0xC000 && address <= 0xDFFF)
+		return &cache->wram_code[address - 0xC000];
+	if (address >= 0xFF80 && address <= 0xFFFE)
+		return &cache->highram_code[address - 0xFF80];
+	return NULL;
+}
+
+static inline Block* block_slot(BlockCache *cache, uint16_t pc, uint16_t bank) {
+	return &cache->blocks[(pc ^ (bank << 6)) & (BLOCK_CACHE_SIZE - 1)];
+}
+
+
+// NOTE: The first and the last code byte of a WRAM page flip its write protection
+static inline void page_code_add(Emulator *emu, uint16_t address, int8_t delta) {
+	if (address < 0xC000 || address > 0xDFFF)
+		return;
+	uint16_t *count = &emu->block_cache->wram_page_code[(address - 0xC000) / MEMORY_PAGE_SIZE];
+	*count += delta;
+	if (*count == (delta > 0 ? 1 : 0))
+		memory_map_update_page(emu, address / MEMORY_PAGE_SIZE);
+}
+
+static inline void code_mark(Emulator *emu, uint16_t address) {
+	uint8_t *counter = code_counter(emu->block_cache, address);
+	if (counter == NULL || *counter == UINT8_MAX)
+		return;
+	if ((*counter)++ == 0)
+		page_code_add(emu, address, 1);
+}
+
+static inline void code_unmark(Emulator *emu, uint16_t address) {
+	uint8_t *counter = code_counter(emu->block_cache, address);
+	if (counter == NULL || *counter == 0)
+		return;
+	if (--(*counter) == 0)
+		page_code_add(emu, address, -1);
+}
+
+
+static inline void block_evict(Emulator *emu, Block *block) {
+	BlockCache *cache = emu->block_cache;
+	if (!block->is_valid)
+		return;
+	block->is_valid = false;
+	for (uint32_t address = block->start; address < block->end; address++)
+		code_unmark(emu, address);
+	if (cache->current == block)
+		cache->current = NULL;
+}
+
+
+static inline bool block_compile(Emulator *emu, Block *block, uint16_t pc, uint16_t bank) {
+	uint16_t last = region_end(pc);
+	if (last == 0)
+		return false;
+
+	block_evict(emu, block);
+	block->start = pc;
+	block->bank = bank;
+	block->size = 0;
+
+	uint32_t address = pc;
+	while (block->size < BLOCK_MAX_OPS) {
+		uint8_t length = opcode_length(memory_read(emu, address));
+		if (address + length - 1 > last)
+			break;
+		DecodedOp op = block_cache_decode(emu, address);
+		block->ops[block->size++] = op;
+		address += op.length;
+		if (opcode_ends_block(op.opcode))
+			break;
+	}
+	block->end = address;
+	if (block->size == 0)
+		return false;
+	block->is_valid = true;
+
+	for (address = block->start; address < block->end; address++)
+		code_mark(emu, address);
+	return true;
+}
+
+
+Block* block_cache_lookup(Emulator *emu, uint16_t pc) {
+	uint16_t bank = current_bank(emu, pc);
+	Block *block = block_slot(emu->block_cache, pc, bank);
+	bool is_hit = block->is_valid && block->start == pc && block->bank == bank;
+	if (!is_hit && !block_compile(emu, block, pc, bank))
+		return NULL;
+	return block;
+}
+
+
+const DecodedOp* block_cache_fetch(Emulator *emu, uint16_t pc) {
+	BlockCache *cache = emu->block_cache;
+
+	Block *block = cache->current;
+	if (block != NULL && pc == cache->next_pc && cache->next_op < block->size) {
+		const DecodedOp *op = &block->ops[cache->next_op++];
+		cache->next_pc += op->length;
+		return op;
+	}
+
+	block = block_cache_lookup(emu, pc);
+	if (block == NULL) {
+		cache->current = NULL;
+		cache->uncached = block_cache_decode(emu, pc);
+		return &cache->uncached;
+	}
+
+	cache->current = block;
+	cache->next_op = 1;
+	cache->next_pc = pc + block->ops[0].length;
+	return &block->ops[0];
+}
+
+
+void block_cache_invalidate(Emulator *emu, uint16_t address) {
+	BlockCache *cache = emu->block_cache;
+	if (cache == NULL)
+		return;
+
+	uint8_t *counter = code_counter(cache, address);
+	if (counter == NULL || *counter == 0)
+		return;
+
+	for (uint16_t i = 0; i < BLOCK_CACHE_SIZE; i++) {
+		Block *block = &cache->blocks[i];
+		if (block->is_valid && block->start <= address && address < block->end)
+			block_evict(emu, block);
+	}
+	// NOTE: A saturated counter may not have reached zero
+	if (*counter > 0) {
+		*counter = 1;
+		code_unmark(emu, address);
+	}
+}
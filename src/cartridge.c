@@ -6,18 +6,34 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
 
-static inline uint8_t* load_file(char *filename, size_t* size);
+// NOTE: Everything up to the end of the header has to be there
+#define HEADER_END 0x150
+
+
+static inline uint8_t* load_file(char *filename, size_t* size, bool *is_mapped);
 
 
 Cartridge cartridge_load(char* filename) {
 	Cartridge cartridge = {0};
-	cartridge.content = load_file(filename, &cartridge.size);
+	cartridge.content = load_file(filename, &cartridge.size, &cartridge.is_mapped);
 	if (cartridge.content == NULL) {
 		return (Cartridge){.is_load_success = false };
 	}
-	// NOTE: Titles with 16 chars will break this due to the missing \0. For now it should be fine though
-	strlcpy(cartridge.title, (char*)&cartridge.content[0x134], sizeof(cartridge.title));
+	if (cartridge.size < HEADER_END) {
+		cartridge_free(&cartridge);
+		return (Cartridge){.is_load_success = false };
+	}
+	cartridge.is_load_success = true;
+	// NOTE: The content has no \0 after it, a title can fill all 16 bytes
+	memcpy(cartridge.title, &cartridge.content[0x134], sizeof(cartridge.title) - 1);
+	cartridge.title[sizeof(cartridge.title) - 1] = '\0';
 	cartridge.is_color = cartridge.content[0x143];
 	cartridge.licensee = cartridge.content[0x144] << 8 | cartridge.content[0x145];
 	cartridge.is_super_gb = cartridge.content[0x0146] != 0;
@@ -34,8 +50,14 @@ Cartridge cartridge_load(char* filename) {
 
 
 void cartridge_free(Cartridge *cartridge) {
-	free(cartridge->content);
+#ifndef _WIN32
+	if (cartridge->is_mapped)
+		munmap(cartridge->content, cartridge->size);
+	else
+#endif
+		free(cartridge->content);
 	cartridge->content = NULL;
+	cartridge->is_mapped = false;
 	cartridge->title[0] = '\0';
 	cartridge->size = 0;
 }
@@ -75,8 +97,23 @@ static inline void print_flag(char* label, bool value) {
 
 static inline void print_cartridge_type(CartridgeType type) {
 	switch (type) {
-	case CARTRIDGE_TYPE_0_ROM_ONLY:
-		printf("ROM ONLY (0)"); return;
+	case CARTRIDGE_TYPE_0_ROM_ONLY: printf("ROM ONLY (0)"); return;
+	case CARTRIDGE_TYPE_1_MBC1: printf("MBC1 (1)"); return;
+	case CARTRIDGE_TYPE_2_MBC1_RAM: printf("MBC1+RAM (2)"); return;
+	case CARTRIDGE_TYPE_3_MBC1_RAM_BATTERY: printf("MBC1+RAM+BATTERY (3)"); return;
+	case CARTRIDGE_TYPE_5_MBC2: printf("MBC2 (5)"); return;
+	case CARTRIDGE_TYPE_6_MBC2_BATTERY: printf("MBC2+BATTERY (6)"); return;
+	case CARTRIDGE_TYPE_F_MBC3_TIMER_BATTERY: printf("MBC3+TIMER+BATTERY (F)"); return;
+	case CARTRIDGE_TYPE_10_MBC3_TIMER_RAM_BATTERY: printf("MBC3+TIMER+RAM+BATTERY (10)"); return;
+	case CARTRIDGE_TYPE_11_MBC3: printf("MBC3 (11)"); return;
+	case CARTRIDGE_TYPE_12_MBC3_RAM: printf("MBC3+RAM (12)"); return;
+	case CARTRIDGE_TYPE_13_MBC3_RAM_BATTERY: printf("MBC3+RAM+BATTERY (13)"); return;
+	case CARTRIDGE_TYPE_19_MBC5: printf("MBC5 (19)"); return;
+	case CARTRIDGE_TYPE_1A_MBC5_RAM: printf("MBC5+RAM (1A)"); return;
+	case CARTRIDGE_TYPE_1B_MBC5_RAM_BATTERY: printf("MBC5+RAM+BATTERY (1B)"); return;
+	case CARTRIDGE_TYPE_1C_MBC5_RUMBLE: printf("MBC5+RUMBLE (1C)"); return;
+	case CARTRIDGE_TYPE_1D_MBC5_RUMBLE_RAM: printf("MBC5+RUMBLE+RAM (1D)"); return;
+	case CARTRIDGE_TYPE_1E_MBC5_RUMBLE_RAM_BATTERY: printf("MBC5+RUMBLE+RAM+BATTERY (1E)"); return;
 	default:
 		printf("UNSUPPORTED (%x)", type); return;
 	}
@@ -105,6 +142,7 @@ static inline void print_ram_size(RAMSize type) {
 	case RAM_SIZE_64KBIT: printf("64KBIT"); return;
 	case RAM_SIZE_256KBIT: printf("256KBIT"); return;
 	case RAM_SIZE_1MBIT: printf("1MBIT"); return;
+	case RAM_SIZE_512KBIT: printf("512KBIT"); return;
 	default: printf("UNDEFINED (%x)", type); return;
 	}
 }
@@ -126,20 +164,69 @@ static inline void print_licensee_code(LicenseeCode code) {
 	}
 }
 
-static inline uint8_t* load_file(char *filename, size_t* size) {
-	FILE *file = fopen(filename, "r");
-	if (file == NULL)  { return NULL; }
+// NOTE: Read only and backed by the page cache, so every instance running the same ROM
+//  shares one copy. Returns NULL when the file can not be mapped
+static inline uint8_t* map_file(int fd, size_t size) {
+#ifdef _WIN32
+	(void)fd;
+	(void)size;
+	return NULL;
+#else
+	int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+	flags |= MAP_POPULATE;
+#endif
+	uint8_t *content = mmap(NULL, size, PROT_READ, flags, fd, 0);
+	if (content == MAP_FAILED)
+		return NULL;
+	// NOTE: Bank switches jump all over the ROM, read it in whole instead of faulting page by page
+	madvise(content, size, MADV_WILLNEED);
+	return content;
+#endif
+}
 
-	fseek(file, 0, SEEK_END);
-	*size = ftell(file);
-	fseek(file, 0, SEEK_SET);
 
-	uint8_t *buffer = malloc(*size + 1);
+// NOTE: For pipes and other files without a size, read until the end
+static inline uint8_t* read_file(int fd, size_t* size) {
+	size_t capacity = 0x8000;
+	uint8_t *buffer = malloc(capacity);
+	*size = 0;
+	while (buffer != NULL) {
+		if (*size == capacity) {
+			capacity *= 2;
+			uint8_t *grown = realloc(buffer, capacity);
+			if (grown == NULL)
+				break;
+			buffer = grown;
+		}
+		ssize_t count = read(fd, &buffer[*size], capacity - *size);
+		if (count == 0)
+			return buffer;
+		if (count < 0)
+			break;
+		*size += count;
+	}
+	free(buffer);
+	return NULL;
+}
 
-	fread(buffer, 1, *size, file);
-	buffer[*size] = '\0';
-	fclose(file);
 
-	return buffer;
-}
+static inline uint8_t* load_file(char *filename, size_t* size, bool *is_mapped) {
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0)
+		return NULL;
 
+	uint8_t *content = NULL;
+	struct stat info;
+	*is_mapped = false;
+	if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+		*size = info.st_size;
+		content = map_file(fd, *size);
+		*is_mapped = content != NULL;
+	}
+	if (content == NULL)
+		content = read_file(fd, size);
+
+	close(fd);
+	return content;
+}
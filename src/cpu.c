@@ -1,7 +1,10 @@
 #include "cpu.h"
+#include "block_cache.h"
 #include "interrupts.h"
+#include "jit.h"
 #include "memory_map.h"
 #include "opcode.h"
+#include "scheduler.h"
 #include <stdint.h>
 
 CPU cpu_create() {
@@ -29,8 +32,14 @@ uint8_t cpu_step(Emulator* emu) {
 
 	emu->cpu.opcode_length = 0;
 	emu->cpu.cycles = 0;
-	uint8_t opcode = memory_read(emu, emu->cpu.pc);
-	opcode_execute(emu, opcode);
+	DecodedOp op;
+	if (emu->block_cache != NULL) {
+		op = *block_cache_fetch(emu, emu->cpu.pc);
+	} else {
+		op = block_cache_decode(emu, emu->cpu.pc);
+	}
+	emu->cpu.operand = op.operand;
+	opcode_execute(emu, op.opcode);
 
 	emu->cpu.pc += emu->cpu.opcode_length;
 	if (was_halt_bugged) {
@@ -45,3 +54,34 @@ uint8_t cpu_step(Emulator* emu) {
 	return emu->cpu.cycles;
 }
 
+
+bool cpu_can_run_ahead(Emulator *emu) {
+	CPU *cpu = &emu->cpu;
+	if (cpu->ime_scheduled || cpu->is_halted || cpu->is_halt_bugged)
+		return false;
+	if (is_interrupt_handler_running(emu))
+		return false;
+	return !emu->interrupt.ime || !interrupt_pending(emu);
+}
+
+
+BlockRun cpu_run_block(Emulator *emu) {
+	Scheduler *scheduler = &emu->scheduler;
+	BlockCache *cache = emu->block_cache;
+	CPU *cpu = &emu->cpu;
+
+	BlockRun run = { .steps = 1, .last_pc = cpu->pc };
+	// NOTE: Native code only starts at the top of a block, one left midway is finished here
+	bool is_in_block = cache != NULL && cache->current != NULL &&
+		cpu->pc == cache->next_pc && cache->next_op < cache->current->size;
+	if (emu->jit != NULL && !is_in_block && cpu_can_run_ahead(emu) && jit_run(emu, &run))
+		return run;
+
+	run.cycles = cpu_step(emu);
+	scheduler->clock += run.cycles;
+	if (cache == NULL)
+		return run;
+
+	opcode_run(emu, &run);
+	return run;
+}
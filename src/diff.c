@@ -0,0 +1,124 @@
+#include "diff.h"
+#include "block_cache.h"
+#include "cpu.h"
+#include "emulator.h"
+#include "interrupts.h"
+#include "opcode.h"
+#include "ppu.h"
+#include "scheduler.h"
+#include "timer.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+bool diff_enable(Emulator *emu) {
+	if (emu->diff != NULL)
+		return true;
+
+	Diff *diff = malloc(sizeof(Diff));
+	if (diff == NULL)
+		return false;
+	memset(diff, 0, sizeof(Diff));
+
+	// NOTE: The shadow steps its timer and PPU every instruction, so it starts from a synced machine
+	scheduler_sync(emu);
+	diff->shadow = malloc(sizeof(Emulator));
+	if (diff->shadow == NULL) {
+		free(diff);
+		return false;
+	}
+	*diff->shadow = emulator_clone(emu);
+	block_cache_destroy(diff->shadow->block_cache);
+	diff->shadow->block_cache = NULL;
+	diff->last_pc = emu->cpu.pc;
+
+	emu->diff = diff;
+	return true;
+}
+
+
+void diff_disable(Emulator *emu) {
+	if (emu->diff == NULL)
+		return;
+	emulator_destroy(emu->diff->shadow);
+	free(emu->diff->shadow);
+	free(emu->diff);
+	emu->diff = NULL;
+}
+
+
+static inline void dump_cpu(const char *label, CPU *cpu, uint32_t cycles) {
+	fprintf(stderr, "  %-12s PC=%04X SP=%04X AF=%04X BC=%04X DE=%04X HL=%04X cycles=%u halted=%d\n",
+		label, cpu->pc, cpu->sp, cpu->af, cpu->bc, cpu->de, cpu->hl, cycles, cpu->is_halted);
+}
+
+
+static inline bool is_cpu_equal(CPU *lhs, CPU *rhs) {
+	return  lhs->pc == rhs->pc && lhs->sp == rhs->sp &&
+		lhs->af == rhs->af && lhs->bc == rhs->bc &&
+		lhs->de == rhs->de && lhs->hl == rhs->hl &&
+		lhs->is_halted == rhs->is_halted &&
+		lhs->ime_scheduled == rhs->ime_scheduled;
+}
+
+
+void diff_step(Emulator *emu, uint16_t steps, uint32_t cycles) {
+	Diff *diff = emu->diff;
+	if (diff->has_diverged)
+		return;
+
+	Emulator *shadow = diff->shadow;
+	// NOTE: Inputs only ever reach the real machine
+	shadow->joypad = emu->joypad;
+
+	uint32_t shadow_cycles = 0;
+	for (uint16_t step = 0; step < steps; step++) {
+		uint8_t t_cycle = cpu_step(shadow);
+		timer_step(shadow, t_cycle);
+		ppu_step(shadow, t_cycle);
+		shadow_cycles += t_cycle;
+	}
+	diff->instructions += steps;
+
+	scheduler_sync(emu);
+	opcode_sync_flags(emu);
+	opcode_sync_flags(shadow);
+	bool is_equal = cycles == shadow_cycles &&
+		is_cpu_equal(&emu->cpu, &shadow->cpu) &&
+		emu->interrupt.ime == shadow->interrupt.ime &&
+		emu->interrupt.flag == shadow->interrupt.flag;
+
+	if (!is_equal) {
+		diff->has_diverged = true;
+		fprintf(stderr, "[DIFF] Diverged after %llu instructions, in the block at %04X\n",
+			(unsigned long long)diff->instructions, diff->last_pc);
+		dump_cpu("cached:", &emu->cpu, cycles);
+		dump_cpu("interpreter:", &shadow->cpu, shadow_cycles);
+	}
+	diff->last_pc = emu->cpu.pc;
+}
+
+
+static inline bool is_memory_equal(Emulator *lhs, Emulator *rhs) {
+	return  memcmp(lhs->memory, rhs->memory, sizeof(Memory)) == 0 &&
+		memcmp(lhs->ppu.vram, rhs->ppu.vram, VRAM_SIZE) == 0 &&
+		memcmp(lhs->ppu.oam, rhs->ppu.oam, OAM_SIZE) == 0;
+}
+
+
+void diff_end_frame(Emulator *emu) {
+	Diff *diff = emu->diff;
+	if (diff->has_diverged)
+		return;
+
+	interrupt_trigger(diff->shadow, INTERRUPT_VBLANK);
+	if (!is_memory_equal(emu, diff->shadow)) {
+		diff->has_diverged = true;
+		fprintf(stderr, "[DIFF] Memory diverged by the end of the frame, after %llu instructions\n",
+			(unsigned long long)diff->instructions);
+	}
+}
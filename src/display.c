@@ -1,33 +1,113 @@
 #include "display.h"
 #include "emulator.h"
 #include "memory_map.h"
+#include "tile_decode.h"
+#include <assert.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 
 
 Display display_create() {
 	Display d = {0};
+	const RGBA palette[4] = {
+		display_rgba(255, 255, 255, 255),
+		display_rgba(200, 200, 200, 255),
+		display_rgba(130, 130, 130, 255),
+		display_rgba(0, 0, 0, 255),
+	};
+	display_set_palette(&d, palette);
+	// NOTE: The screen starts out blank, in the lightest shade
+	for (uint8_t y = 0; y < DISPLAY_HEIGHT; y++)
+		for (uint8_t x = 0; x < DISPLAY_WIDTH; x++)
+			d.framebuffer[y][x] = palette[0];
 	return d;
 }
 
+
+RGBA display_rgba(uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
+	const uint8_t bytes[4] = { r, g, b, a };
+	RGBA color;
+	memcpy(&color, bytes, sizeof(color));
+	return color;
+}
+
+
+void display_set_palette(Display *display, const RGBA palette[4]) {
+	memcpy(display->palette, palette, sizeof(display->palette));
+}
+
+
+bool display_is_line_dirty(Display *display, uint8_t y) {
+	assert(y < DISPLAY_HEIGHT);
+	return (display->dirty[y / 64] >> (y % 64)) & 0b1;
+}
+
+
+static inline void mark_dirty(Display *display, uint8_t y) {
+	if (display_is_line_dirty(display, y))
+		return;
+	display->dirty[y / 64] |= 1ull << (y % 64);
+	display->dirty_lines++;
+}
+
+
+bool display_next_dirty_range(Display *display, uint8_t *start, uint8_t *end) {
+	uint8_t y = *start;
+	while (y < DISPLAY_HEIGHT && !display_is_line_dirty(display, y))
+		y++;
+	if (y >= DISPLAY_HEIGHT)
+		return false;
+	*start = y;
+	while (y < DISPLAY_HEIGHT && display_is_line_dirty(display, y))
+		y++;
+	*end = y;
+	return true;
+}
+
+
+void display_clear_dirty(Display *display) {
+	memset(display->dirty, 0, sizeof(display->dirty));
+	display->dirty_lines = 0;
+}
+
+
 void display_set(Emulator *emu, uint8_t x, uint8_t y, GBColor color) {
 	if (x >= DISPLAY_WIDTH || y >= DISPLAY_HEIGHT) return;
-	emu->display.screen[y][x] = color;
+	assert(color < 4);
+	RGBA rgba = emu->display.palette[color];
+	if (emu->display.framebuffer[y][x] == rgba)
+		return;
+	emu->display.framebuffer[y][x] = rgba;
+	mark_dirty(&emu->display, y);
 }
 
 
-static inline void dump_tile(Emulator *emu, uint8_t tx, uint8_t ty, uint16_t start_address) {
-	for (uint8_t line = 0; line < 8; line++) {
-		uint8_t lower = memory_read(emu, start_address + (line * 2));
-		uint8_t higher = memory_read(emu, start_address + (line * 2) + 1);
-		for (uint8_t x = 0; x < 8; x++) {
-			uint8_t offset = 7 - x;
-			uint8_t lower_bit = (lower >> offset) & 0b1;
-			uint8_t higher_bit = (higher >> offset) & 0b1;
-			GBColor color = lower_bit | (higher_bit << 1);
-			display_set(emu, tx * 8 + x, ty * 8 + line, color);
-		}
+void display_set_line(Emulator *emu, uint8_t y, const uint8_t colors[DISPLAY_WIDTH]) {
+	if (y >= DISPLAY_HEIGHT) return;
+	RGBA *line = emu->display.framebuffer[y];
+	RGBA changed = 0;
+	for (uint8_t x = 0; x < DISPLAY_WIDTH; x++) {
+		assert(colors[x] < 4);
+		RGBA rgba = emu->display.palette[colors[x]];
+		changed |= line[x] ^ rgba;
+		line[x] = rgba;
 	}
+	if (changed != 0)
+		mark_dirty(&emu->display, y);
+}
+
+
+static inline void dump_tile(Emulator *emu, uint8_t tx, uint8_t ty, uint16_t start_address) {
+	TileData tile;
+	for (uint8_t i = 0; i < sizeof(TileData); i++)
+		tile.data[i] = memory_read(emu, start_address + i);
+
+	uint8_t pixels[8][8];
+	tile_decode(tile.data, 8, PALETTE_IDENTITY, &pixels[0][0]);
+	for (uint8_t line = 0; line < 8; line++)
+		for (uint8_t x = 0; x < 8; x++)
+			display_set(emu, tx * 8 + x, ty * 8 + line, pixels[line][x]);
 }
 
 void display_dump(Emulator *emu) {
@@ -1,43 +1,185 @@
 #include "emulator.h"
 
+#include "block_cache.h"
 #include "cpu.h"
+#include "diff.h"
 #include "display.h"
+#include "idle.h"
 #include "interrupts.h"
+#include "jit.h"
 #include "joypad.h"
 #include "logger.h"
+#include "mbc.h"
 #include "memory.h"
+#include "memory_map.h"
 #include "ppu.h"
+#include "profile.h"
+#include "scheduler.h"
 #include "timer.h"
 
+#include <string.h>
+
 
 Emulator emulator_create() {
 	Emulator emu = {0};
 	emu.memory = memory_create();
 	emu.cpu = cpu_create();
 	emu.interrupt = interrupt_create();
+	emu.io = io_create();
+	joypad_register_io(&emu.io);
+	timer_register_io(&emu.io);
+	interrupt_register_io(&emu.io);
+	ppu_register_io(&emu.io);
 	emu.ppu = ppu_create();
+	emu.display = display_create();
 	emu.joypad = joypad_create();
+	emu.block_cache = block_cache_create();
+	emu.idle = idle_create();
+	emu.mbc = mbc_create(NULL);
+	memory_map_rebuild(&emu);
 	return emu;
 }
 
 
 void emulator_destroy(Emulator* emulator) {
+	diff_disable(emulator);
+	jit_disable(emulator);
 	memory_destroy(emulator->memory);
 	ppu_destroy(&emulator->ppu);
+	block_cache_destroy(emulator->block_cache);
+	idle_destroy(emulator->idle);
+	mbc_eject(emulator);
+	mbc_destroy(&emulator->mbc);
 	emulator->memory = NULL;
+	emulator->block_cache = NULL;
+	emulator->idle = NULL;
+}
+
+
+Emulator emulator_clone(Emulator* emulator) {
+	Emulator clone = *emulator;
+	clone.memory = memory_create();
+	memcpy(clone.memory, emulator->memory, sizeof(Memory));
+	clone.ppu = ppu_clone(&emulator->ppu);
+	clone.block_cache = block_cache_create();
+	clone.idle = idle_create();
+	clone.diff = NULL;
+	clone.jit = NULL;
+	clone.mbc = mbc_clone(&emulator->mbc);
+	memory_map_rebuild(&clone);
+	return clone;
+}
+
+
+void emulator_insert_cartridge(Emulator* emu, Cartridge* cartridge) {
+	emu->cartridge = cartridge;
+	mbc_eject(emu);
+	mbc_destroy(&emu->mbc);
+	emu->mbc = mbc_create(cartridge);
+	// NOTE: The clock starts counting from the moment the cartridge goes in
+	emu->mbc.rtc.base = emu->scheduler.clock;
+	memory_map_rebuild(emu);
+	if (emu->jit != NULL)
+		jit_flush(emu->jit);
+}
+
+
+void emulator_set_frameskip(Emulator* emu, uint32_t frameskip) {
+	emu->render.frameskip = frameskip;
+	emu->render.skipped = 0;
+}
+
+void emulator_set_render_on_demand(Emulator* emu, bool is_on_demand) {
+	emu->render.is_on_demand = is_on_demand;
+	// NOTE: Nobody asked for the frame already under way
+	if (is_on_demand)
+		emu->ppu.is_frame_skipped = true;
+}
+
+void emulator_request_frame(Emulator* emu) { emu->render.is_requested = true; }
+
+
+// NOTE: A request lasts until a whole frame has been drawn for it, it may come in after line 0
+bool emulator_should_render(Emulator* emu) {
+	if (emu->render.is_on_demand)
+		return emu->render.is_requested;
+	bool should_render = emu->render.skipped == 0;
+	emu->render.skipped = emu->render.skipped < emu->render.frameskip ? emu->render.skipped + 1 : 0;
+	return should_render;
+}
+
+
+void emulator_frame_drawn(Emulator* emu) {
+	emu->render.frames_drawn++;
+	emu->render.is_requested = false;
+}
+
+
+// NOTE: Moves the master clock past a CPU that is known to do nothing observable for `cycles`.
+//  The timer and PPU catch up at the next event, or when the CPU reads them
+void emulator_advance(Emulator* emu, uint32_t cycles) {
+	emu->scheduler.clock += cycles;
+}
+
+
+// NOTE: Only an interrupt request wakes up a halted CPU, which checks for one every 4 cycles.
+//  Requests only show up at scheduled events, so jump to the first check at or after the next one
+static inline void halt_fast_forward(Emulator* emu) {
+	static const uint32_t HALT_CYCLES = 4;
+	uint64_t cycles = scheduler_next_deadline(&emu->scheduler) - emu->scheduler.clock;
+	emulator_advance(emu, (cycles + HALT_CYCLES - 1) / HALT_CYCLES * HALT_CYCLES);
 }
 
 
 void emulator_run_frame(Emulator* emu) {
 	static const uint32_t MAX_CYCLES = 70224;
-	uint32_t cycles = 0;
-	while (cycles < MAX_CYCLES) {
-		uint8_t t_cycle = cpu_step(emu);
-		timer_step(emu, t_cycle);
-		ppu_step(emu, t_cycle);
-		
-		cycles += t_cycle;
+	Scheduler *scheduler = &emu->scheduler;
+	// NOTE: The next frame gives back what the CPU ran past the last one, so frames stay in step
+	//  with the PPU and each starts right at its line 0
+	uint64_t frame_end = scheduler->frame_end + MAX_CYCLES;
+	if (frame_end <= scheduler->clock)
+		frame_end = scheduler->clock + MAX_CYCLES;
+	scheduler->frame_end = frame_end;
+	scheduler_reschedule_timer(emu);
+	scheduler_reschedule_ppu(emu);
+	scheduler_schedule(scheduler, EVENT_FRAME_END, frame_end);
+	if (emu->idle != NULL)
+		idle_reset(emu->idle);
+
+	bool is_frame_over = false;
+	while (!is_frame_over) {
+		while (scheduler->clock < scheduler_next_deadline(scheduler)) {
+			if (emu->cpu.is_halted && emu->diff == NULL && !interrupt_pending(emu)) {
+				halt_fast_forward(emu);
+				continue;
+			}
+
+			PROFILE_ENTER(PROFILE_CPU);
+			BlockRun run = cpu_run_block(emu);
+			PROFILE_LEAVE();
+			// NOTE: The CPU section is entered once per block, but counts instructions
+			PROFILE_COUNT_CALLS(PROFILE_CPU, run.steps - 1);
+			if (emu->diff != NULL)
+				diff_step(emu, run.steps, run.cycles);
+
+			// NOTE: A polling loop closes with a jump back, the shadow of the diff can not skip ahead
+			if (emu->idle != NULL && emu->diff == NULL && emu->cpu.pc <= run.last_pc && scheduler->clock < frame_end)
+				idle_skip(emu, frame_end - scheduler->clock);
+		}
+
+		Event event;
+		while (scheduler_pop_due(scheduler, &event)) {
+			switch (event.type) {
+			case EVENT_FRAME_END: is_frame_over = true; break;
+			case EVENT_TIMER: scheduler_reschedule_timer(emu); break;
+			case EVENT_PPU: scheduler_reschedule_ppu(emu); break;
+			case EVENT_COUNT: break;
+			}
+		}
 	}
+	scheduler_sync(emu);
 	interrupt_trigger(emu, INTERRUPT_VBLANK);
+	mbc_end_frame(emu);
+	if (emu->diff != NULL)
+		diff_end_frame(emu);
 }
-
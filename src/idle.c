@@ -0,0 +1,210 @@
+#include "idle.h"
+#include "block_cache.h"
+#include "cpu.h"
+#include "emulator.h"
+#include "interrupts.h"
+#include "opcode.h"
+#include "ppu.h"
+#include "scheduler.h"
+#include "timer.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+IdleDetector* idle_create() {
+	IdleDetector *idle = malloc(sizeof(IdleDetector));
+	assert(idle);
+	memset(idle, 0, sizeof(IdleDetector));
+	return idle;
+}
+
+void idle_destroy(IdleDetector *idle) { free(idle); }
+
+void idle_reset(IdleDetector *idle) {
+	memset(idle->rejected, 0, sizeof(idle->rejected));
+	memset(idle->unsettled, 0, sizeof(idle->unsettled));
+}
+
+
+static inline bool bit_get(uint8_t *bits, uint16_t pc) { return (bits[pc >> 3] >> (pc & 7)) & 0b1; }
+static inline void bit_set(uint8_t *bits, uint16_t pc) { bits[pc >> 3] |= 1 << (pc & 7); }
+static inline void bit_clear(uint8_t *bits, uint16_t pc) { bits[pc >> 3] &= ~(1 << (pc & 7)); }
+
+
+static inline uint32_t min_cycles(uint32_t lhs, uint32_t rhs) { return lhs < rhs ? lhs : rhs; }
+
+
+// NOTE: Code is only followed through memory that reads the same without the CPU writing to it
+static inline bool is_code_address(uint16_t address) {
+	return address <= 0x7FFF ||
+		(address >= 0xC000 && address <= 0xDFFF) ||
+		(address >= 0xFF80 && address <= 0xFFFE);
+}
+
+
+// NOTE: Cycles until a read from `address` may return something else, when only the hardware runs.
+//  Returns false for memory whose reads can not be predicted
+static inline bool read_horizon(Emulator *emu, uint16_t address, uint32_t *horizon) {
+	*horizon = UINT32_MAX;
+	if (address <= 0x7FFF || (address >= 0xC000 && address <= 0xFDFF) || (address >= 0xFF80 && address <= 0xFFFE))
+		return true;
+
+	switch (address) {
+	// NOTE: Only written by the CPU, or by the frontend between frames
+	case 0xFF00: case 0xFF06: case 0xFF07:
+	case 0xFF40: case 0xFF42: case 0xFF43: case 0xFF47:
+	case 0xFFFF:
+		return true;
+	case 0xFF04: *horizon = timer_cycles_until_div_change(emu); return true;
+	case 0xFF05: *horizon = timer_cycles_until_tima_change(emu); return true;
+	case 0xFF0F:
+		*horizon = min_cycles(ppu_cycles_until_vblank(&emu->ppu), timer_cycles_until_interrupt(emu));
+		return true;
+	case 0xFF41: *horizon = ppu_cycles_until_mode_change(&emu->ppu); return true;
+	case 0xFF44: *horizon = ppu_cycles_until_line_change(&emu->ppu); return true;
+	}
+	return false;
+}
+
+
+// NOTE: Whitelist of instructions that write nothing but registers.
+//  Sets `address` when the instruction also reads memory
+static inline bool is_side_effect_free(CPU *cpu, DecodedOp op, bool *is_read, uint16_t *address) {
+	*is_read = false;
+	uint8_t opcode = op.opcode;
+
+	// NOTE: LD r, r' and the 8 bit ALU, except LD (HL), r and HALT
+	if ((opcode >= 0x40 && opcode <= 0xBF && (opcode < 0x70 || opcode > 0x77))) {
+		*is_read = (opcode & 0b111) == 6;
+		*address = cpu->hl;
+		return true;
+	}
+
+	switch (opcode) {
+	case 0x00: // NOP
+	case 0x06: case 0x0E: case 0x16: case 0x1E: case 0x26: case 0x2E: case 0x3E: // LD r, d8
+	case 0x07: case 0x0F: case 0x17: case 0x1F: // RLCA, RRCA, RLA, RRA
+	case 0x2F: case 0x37: case 0x3F: // CPL, SCF, CCF
+	case 0xC6: case 0xCE: case 0xD6: case 0xDE: // ADD, ADC, SUB, SBC d8
+	case 0xE6: case 0xEE: case 0xF6: case 0xFE: // AND, XOR, OR, CP d8
+	case 0x18: case 0x20: case 0x28: case 0x30: case 0x38: // JR
+	case 0xC2: case 0xC3: case 0xCA: case 0xD2: case 0xDA: case 0xE9: // JP
+		return true;
+	case 0x0A: *is_read = true; *address = cpu->bc; return true;
+	case 0x1A: *is_read = true; *address = cpu->de; return true;
+	case 0xF0: *is_read = true; *address = 0xFF00 | (op.operand & 0xFF); return true;
+	case 0xF2: *is_read = true; *address = 0xFF00 | cpu->c; return true;
+	case 0xFA: *is_read = true; *address = op.operand; return true;
+	case 0xCB: {
+		// NOTE: BIT n, r
+		uint8_t prefixed = op.operand & 0xFF;
+		if (prefixed < 0x40 || prefixed > 0x7F)
+			return false;
+		*is_read = (prefixed & 0b111) == 6;
+		*address = cpu->hl;
+		return true;
+	}
+	}
+	return false;
+}
+
+
+static inline bool is_same_state(CPU *lhs, CPU *rhs) {
+	return  lhs->af == rhs->af && lhs->bc == rhs->bc &&
+		lhs->de == rhs->de && lhs->hl == rhs->hl &&
+		lhs->sp == rhs->sp && lhs->pc == rhs->pc;
+}
+
+
+typedef enum {
+	LOOP_REJECTED,
+	LOOP_NOT_IDLE,
+	LOOP_IDLE,
+} LoopKind;
+
+
+// NOTE: Runs one iteration from the loop head with the hardware frozen, then rolls the CPU back.
+//  The loop idles if it came back to the head with the same registers: until one of the values it
+//  read changes, every further iteration repeats this one exactly
+static inline LoopKind probe_loop(Emulator *emu, uint32_t *cycles, uint32_t *horizon) {
+	opcode_sync_flags(emu);
+	CPU start = emu->cpu;
+	LoopKind kind = LOOP_REJECTED;
+	*cycles = 0;
+	*horizon = UINT32_MAX;
+
+	for (uint8_t i = 0; i < IDLE_MAX_OPS; i++) {
+		uint16_t pc = emu->cpu.pc;
+		if (!is_code_address(pc))
+			break;
+		DecodedOp op = block_cache_decode(emu, pc);
+		if (!is_code_address(pc + op.length - 1))
+			break;
+
+		bool is_read;
+		uint16_t address;
+		if (!is_side_effect_free(&emu->cpu, op, &is_read, &address))
+			break;
+		uint32_t read_cycles = UINT32_MAX;
+		if (is_read && !read_horizon(emu, address, &read_cycles))
+			break;
+		*horizon = min_cycles(*horizon, read_cycles);
+
+		*cycles += cpu_step(emu);
+		if (emu->cpu.pc == start.pc) {
+			opcode_sync_flags(emu);
+			kind = is_same_state(&start, &emu->cpu) ? LOOP_IDLE : LOOP_NOT_IDLE;
+			break;
+		}
+	}
+
+	emu->cpu = start;
+	return kind;
+}
+
+
+static inline bool can_probe(Emulator *emu) {
+	return  !emu->cpu.is_halted && !emu->cpu.is_halt_bugged && !emu->cpu.ime_scheduled &&
+		!is_interrupt_handler_running(emu) &&
+		!(emu->interrupt.ime && interrupt_pending(emu));
+}
+
+
+uint32_t idle_skip(Emulator *emu, uint32_t max_cycles) {
+	IdleDetector *idle = emu->idle;
+	uint16_t head = emu->cpu.pc;
+	if (bit_get(idle->rejected, head))
+		return 0;
+	// NOTE: The clock may have passed an event, the interrupt flags and horizons need the current state
+	scheduler_sync(emu);
+	if (!can_probe(emu))
+		return 0;
+
+	uint32_t cycles;
+	uint32_t horizon;
+	switch (probe_loop(emu, &cycles, &horizon)) {
+	case LOOP_REJECTED:
+		bit_set(idle->rejected, head);
+		return 0;
+	case LOOP_NOT_IDLE:
+		if (bit_get(idle->unsettled, head))
+			bit_set(idle->rejected, head);
+		bit_set(idle->unsettled, head);
+		return 0;
+	case LOOP_IDLE:
+		bit_clear(idle->unsettled, head);
+		break;
+	}
+
+	if (emu->interrupt.ime)
+		horizon = min_cycles(horizon, interrupt_cycles_until_pending(emu));
+	horizon = min_cycles(horizon, max_cycles);
+	uint32_t skipped = (horizon / cycles) * cycles;
+	emulator_advance(emu, skipped);
+	idle->skipped_cycles += skipped;
+	return skipped;
+}
@@ -2,6 +2,8 @@
 #include "interrupts.h"
 #include "logger.h"
 #include "memory_map.h"
+#include "ppu.h"
+#include "timer.h"
 
 #include <stdint.h>
 
@@ -111,3 +113,25 @@ uint8_t interrupt_pending(struct emulator *emu) {
 bool is_interrupt_handler_running(struct emulator *emu) {
 	return emu->interrupt.state != INTERRUPT_STATE_IDLE;
 }
+
+uint32_t interrupt_cycles_until_pending(struct emulator *emu) {
+	uint32_t cycles = UINT32_MAX;
+	if (emu->interrupt.enable & INTERRUPT_VBLANK) {
+		uint32_t vblank = ppu_cycles_until_vblank(&emu->ppu);
+		cycles = vblank < cycles ? vblank : cycles;
+	}
+	if (emu->interrupt.enable & INTERRUPT_TIMER) {
+		uint32_t timer = timer_cycles_until_interrupt(emu);
+		cycles = timer < cycles ? timer : cycles;
+	}
+	return cycles;
+}
+
+
+static uint8_t if_read(Emulator *emu, uint16_t address) { (void)address; return interrupt_flag_read(&emu->interrupt); }
+static void if_write(Emulator *emu, uint16_t address, uint8_t value) { (void)address; interrupt_flag_write(&emu->interrupt, value); }
+
+// NOTE: The timer and the PPU can both request interrupts
+void interrupt_register_io(IOBus *io) {
+	io_register(io, 0xFF0F, if_read, if_write, IO_SYNC_ALL);
+}
@@ -0,0 +1,69 @@
+#include "io.h"
+
+#include <assert.h>
+#include <stdint.h>
+
+#include "emulator.h"
+#include "logger.h"
+#include "scheduler.h"
+
+
+static uint8_t unmapped_read(Emulator *emu, uint16_t address) {
+	(void)emu;
+	(void)address;
+	DEBUG("Reading unmapped address: %x", address);
+	return 0xFF;
+}
+
+static void unmapped_write(Emulator *emu, uint16_t address, uint8_t value) {
+	(void)emu;
+	(void)address;
+	(void)value;
+	DEBUG("Writing to unmapped address: [%x] = %x", address, value);
+}
+
+
+IOBus io_create() {
+	IOBus io;
+	for (uint8_t i = 0; i < IO_REGISTER_COUNT; i++)
+		io.registers[i] = (IORegister){ .read = unmapped_read, .write = unmapped_write, .sync = IO_SYNC_NONE };
+	return io;
+}
+
+
+void io_register(IOBus *io, uint16_t address, IORead read, IOWrite write, IOSync sync) {
+	assert(address >= IO_START && address < IO_START + IO_REGISTER_COUNT);
+	IORegister *reg = &io->registers[address - IO_START];
+	reg->read = read != NULL ? read : unmapped_read;
+	reg->write = write != NULL ? write : unmapped_write;
+	reg->sync = sync;
+}
+
+
+static inline void io_sync(Emulator *emu, IOSync sync) {
+	switch (sync) {
+	case IO_SYNC_NONE: break;
+	case IO_SYNC_TIMER: scheduler_sync_timer(emu); break;
+	case IO_SYNC_PPU: scheduler_sync_ppu(emu); break;
+	case IO_SYNC_ALL: scheduler_sync(emu); break;
+	}
+}
+
+
+uint8_t io_read(Emulator *emu, uint16_t address) {
+	IORegister *reg = &emu->io.registers[(address - IO_START) & (IO_REGISTER_COUNT - 1)];
+	io_sync(emu, reg->sync);
+	return reg->read(emu, address);
+}
+
+
+void io_write(Emulator *emu, uint16_t address, uint8_t value) {
+	IORegister *reg = &emu->io.registers[(address - IO_START) & (IO_REGISTER_COUNT - 1)];
+	io_sync(emu, reg->sync);
+	reg->write(emu, address, value);
+	// NOTE: The write may have moved the next timer or PPU event
+	if (reg->sync == IO_SYNC_TIMER)
+		scheduler_reschedule_timer(emu);
+	else if (reg->sync == IO_SYNC_PPU)
+		scheduler_reschedule_ppu(emu);
+}
@@ -0,0 +1,949 @@
+#include "jit.h"
+#include "block_cache.h"
+#include "cpu.h"
+#include "emulator.h"
+#include "memory_map.h"
+#include "opcode.h"
+#include "scheduler.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// NOTE: The native code follows the System V calling convention, Windows is left out
+#if defined(JIT_X86_64) && defined(__x86_64__) && !defined(_WIN32)
+	#define JIT_NATIVE
+#endif
+
+
+#ifdef JIT_NATIVE
+
+#include <sys/mman.h>
+
+
+typedef uint8_t (*NativeBlock)(Emulator *emu);
+
+
+// NOTE: Host registers. The SM83 A, F, BC, DE and HL live in the callee saved ones,
+//  so the memory handlers can be called without saving them
+typedef enum {
+	RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+	R8, R9, R10, R11, R12, R13, R14, R15,
+} HostRegister;
+
+#define HOST_EMU RBX
+#define HOST_A R12
+#define HOST_F RBP
+#define HOST_BC R13
+#define HOST_DE R14
+#define HOST_HL R15
+
+// NOTE: Register codes of the SM83 encoding, as in the low 3 bits of LD r, r'
+typedef enum { SM83_B, SM83_C, SM83_D, SM83_E, SM83_H, SM83_L, SM83_HL_INDIRECT, SM83_A } Sm83Register;
+
+#define EMU_OFFSET(FIELD) ((int32_t)offsetof(Emulator, FIELD))
+#define DEADLINE_OFFSET (EMU_OFFSET(scheduler) + (int32_t)offsetof(Scheduler, heap) + (int32_t)offsetof(Event, deadline))
+
+// NOTE: Condition codes of Jcc
+#define CC_C 0x2
+#define CC_NC 0x3
+#define CC_Z 0x4
+#define CC_NZ 0x5
+
+// NOTE: The SM83 Z, H and C of the host flags after an 8 bit operation, where ZF, AF and CF
+//  are bits 6, 4 and 0. They come out the same for ADD, ADC, SUB, SBC, CP, INC and DEC
+static uint8_t HOST_FLAGS[256];
+
+
+typedef struct {
+	uint8_t *code;
+	size_t size;
+	size_t capacity;
+} Emitter;
+
+static inline void emit8(Emitter *e, uint8_t value) {
+	if (e->size < e->capacity)
+		e->code[e->size] = value;
+	e->size++;
+}
+
+static inline void emit16(Emitter *e, uint16_t value) {
+	emit8(e, value & 0xFF);
+	emit8(e, value >> 8);
+}
+
+static inline void emit32(Emitter *e, uint32_t value) {
+	emit16(e, value & 0xFFFF);
+	emit16(e, value >> 16);
+}
+
+static inline void emit64(Emitter *e, uint64_t value) {
+	emit32(e, value & 0xFFFFFFFF);
+	emit32(e, value >> 32);
+}
+
+
+// NOTE: A REX prefix is needed for R8-R15, and for SPL, BPL, SIL and DIL as byte registers
+static inline void emit_rex(Emitter *e, bool is_wide, uint8_t reg, uint8_t rm, bool is_byte) {
+	uint8_t rex = 0x40 | (is_wide << 3) | ((reg >> 3) << 2) | (rm >> 3);
+	bool is_new_byte = is_byte && ((reg >= RSP && reg <= RDI) || (rm >= RSP && rm <= RDI));
+	if (rex != 0x40 || is_new_byte)
+		emit8(e, rex);
+}
+
+static inline void emit_modrm_reg(Emitter *e, uint8_t reg, uint8_t rm) {
+	emit8(e, 0xC0 | (reg & 7) << 3 | (rm & 7));
+}
+
+// NOTE: Every memory operand is a field of the Emulator, [rbx + disp32]
+static inline void emit_modrm_emu(Emitter *e, uint8_t reg, int32_t offset) {
+	emit8(e, 0x80 | (reg & 7) << 3 | HOST_EMU);
+	emit32(e, (uint32_t)offset);
+}
+
+
+static inline void emit_mov(Emitter *e, uint8_t dst, uint8_t src) {
+	emit_rex(e, false, src, dst, false);
+	emit8(e, 0x89);
+	emit_modrm_reg(e, src, dst);
+}
+
+static inline void emit_mov64(Emitter *e, uint8_t dst, uint8_t src) {
+	emit_rex(e, true, src, dst, false);
+	emit8(e, 0x89);
+	emit_modrm_reg(e, src, dst);
+}
+
+static inline void emit_mov_imm(Emitter *e, uint8_t dst, uint32_t imm) {
+	emit_rex(e, false, 0, dst, false);
+	emit8(e, 0xB8 + (dst & 7));
+	emit32(e, imm);
+}
+
+static inline void emit_mov_imm64(Emitter *e, uint8_t dst, uint64_t imm) {
+	emit_rex(e, true, 0, dst, false);
+	emit8(e, 0xB8 + (dst & 7));
+	emit64(e, imm);
+}
+
+static inline void emit_movzx8(Emitter *e, uint8_t dst, uint8_t src) {
+	emit_rex(e, false, dst, src, true);
+	emit8(e, 0x0F);
+	emit8(e, 0xB6);
+	emit_modrm_reg(e, dst, src);
+}
+
+// NOTE: Extensions of the 0x81 group
+typedef enum { ALU_ADD = 0, ALU_OR = 1, ALU_AND = 4, ALU_XOR = 6 } AluExtension;
+
+static inline void emit_alu_imm(Emitter *e, AluExtension ext, uint8_t dst, uint32_t imm) {
+	emit_rex(e, false, 0, dst, false);
+	emit8(e, 0x81);
+	emit_modrm_reg(e, ext, dst);
+	emit32(e, imm);
+}
+
+static inline void emit_or(Emitter *e, uint8_t dst, uint8_t src) {
+	emit_rex(e, false, src, dst, false);
+	emit8(e, 0x09);
+	emit_modrm_reg(e, src, dst);
+}
+
+static inline void emit_shl(Emitter *e, uint8_t dst, uint8_t count) {
+	emit_rex(e, false, 0, dst, false);
+	emit8(e, 0xC1);
+	emit_modrm_reg(e, 4, dst);
+	emit8(e, count);
+}
+
+static inline void emit_shr(Emitter *e, uint8_t dst, uint8_t count) {
+	emit_rex(e, false, 0, dst, false);
+	emit8(e, 0xC1);
+	emit_modrm_reg(e, 5, dst);
+	emit8(e, count);
+}
+
+// NOTE: INC and DEC of a 16 bit register, the upper half stays zero
+static inline void emit_step16(Emitter *e, uint8_t dst, bool is_dec) {
+	emit8(e, 0x66);
+	emit_rex(e, false, 0, dst, false);
+	emit8(e, 0xFF);
+	emit_modrm_reg(e, is_dec, dst);
+}
+
+static inline void emit_test_imm(Emitter *e, uint8_t reg, uint32_t imm) {
+	emit_rex(e, false, 0, reg, false);
+	emit8(e, 0xF7);
+	emit_modrm_reg(e, 0, reg);
+	emit32(e, imm);
+}
+
+// NOTE: BT reg, bit, which leaves the bit in CF for ADC and SBB
+static inline void emit_bt(Emitter *e, uint8_t reg, uint8_t bit) {
+	emit_rex(e, false, 0, reg, false);
+	emit8(e, 0x0F);
+	emit8(e, 0xBA);
+	emit_modrm_reg(e, 4, reg);
+	emit8(e, bit);
+}
+
+
+static inline void emit_load8(Emitter *e, uint8_t dst, int32_t offset) {
+	emit_rex(e, false, dst, HOST_EMU, false);
+	emit8(e, 0x0F);
+	emit8(e, 0xB6);
+	emit_modrm_emu(e, dst, offset);
+}
+
+static inline void emit_load16(Emitter *e, uint8_t dst, int32_t offset) {
+	emit_rex(e, false, dst, HOST_EMU, false);
+	emit8(e, 0x0F);
+	emit8(e, 0xB7);
+	emit_modrm_emu(e, dst, offset);
+}
+
+static inline void emit_load64(Emitter *e, uint8_t dst, int32_t offset) {
+	emit_rex(e, true, dst, HOST_EMU, false);
+	emit8(e, 0x8B);
+	emit_modrm_emu(e, dst, offset);
+}
+
+static inline void emit_store8(Emitter *e, int32_t offset, uint8_t src) {
+	emit_rex(e, false, src, HOST_EMU, true);
+	emit8(e, 0x88);
+	emit_modrm_emu(e, src, offset);
+}
+
+static inline void emit_store16(Emitter *e, int32_t offset, uint8_t src) {
+	emit8(e, 0x66);
+	emit_rex(e, false, src, HOST_EMU, false);
+	emit8(e, 0x89);
+	emit_modrm_emu(e, src, offset);
+}
+
+static inline void emit_store16_imm(Emitter *e, int32_t offset, uint16_t imm) {
+	emit8(e, 0x66);
+	emit8(e, 0xC7);
+	emit_modrm_emu(e, 0, offset);
+	emit16(e, imm);
+}
+
+static inline void emit_step16_emu(Emitter *e, int32_t offset, bool is_dec) {
+	emit8(e, 0x66);
+	emit8(e, 0xFF);
+	emit_modrm_emu(e, is_dec, offset);
+}
+
+static inline void emit_add64_emu(Emitter *e, int32_t offset, uint8_t imm) {
+	emit_rex(e, true, 0, HOST_EMU, false);
+	emit8(e, 0x83);
+	emit_modrm_emu(e, 0, offset);
+	emit8(e, imm);
+}
+
+static inline void emit_cmp8_emu(Emitter *e, int32_t offset, uint8_t imm) {
+	emit8(e, 0x80);
+	emit_modrm_emu(e, 7, offset);
+	emit8(e, imm);
+}
+
+static inline void emit_cmp64_emu(Emitter *e, uint8_t reg, int32_t offset) {
+	emit_rex(e, true, reg, HOST_EMU, false);
+	emit8(e, 0x3B);
+	emit_modrm_emu(e, reg, offset);
+}
+
+
+// NOTE: Jumps are emitted with a zero rel32, and patched once the target is known
+static inline size_t emit_jcc(Emitter *e, uint8_t cc) {
+	emit8(e, 0x0F);
+	emit8(e, 0x80 | cc);
+	emit32(e, 0);
+	return e->size - 4;
+}
+
+static inline size_t emit_jmp(Emitter *e) {
+	emit8(e, 0xE9);
+	emit32(e, 0);
+	return e->size - 4;
+}
+
+static inline void patch_jump(Emitter *e, size_t rel, size_t target) {
+	uint32_t offset = (uint32_t)(int32_t)(target - (rel + 4));
+	for (uint8_t i = 0; i < 4 && rel + i < e->capacity; i++)
+		e->code[rel + i] = (offset >> (i * 8)) & 0xFF;
+}
+
+static inline void emit_call(Emitter *e, const void *function) {
+	emit_mov_imm64(e, RAX, (uint64_t)(uintptr_t)function);
+	emit8(e, 0xFF);
+	emit8(e, 0xD0);
+}
+
+
+// ===========================
+// ========== STATE ==========
+// ===========================
+
+static inline void emit_registers_load(Emitter *e) {
+	emit_load8(e, HOST_A, EMU_OFFSET(cpu.a));
+	emit_load8(e, HOST_F, EMU_OFFSET(cpu.f));
+	emit_load16(e, HOST_BC, EMU_OFFSET(cpu.bc));
+	emit_load16(e, HOST_DE, EMU_OFFSET(cpu.de));
+	emit_load16(e, HOST_HL, EMU_OFFSET(cpu.hl));
+}
+
+static inline void emit_registers_store(Emitter *e) {
+	emit_store8(e, EMU_OFFSET(cpu.a), HOST_A);
+	emit_store8(e, EMU_OFFSET(cpu.f), HOST_F);
+	emit_store16(e, EMU_OFFSET(cpu.bc), HOST_BC);
+	emit_store16(e, EMU_OFFSET(cpu.de), HOST_DE);
+	emit_store16(e, EMU_OFFSET(cpu.hl), HOST_HL);
+}
+
+// NOTE: Keeps the stack aligned to 16 for the calls, and leaves [rsp] for the result of the last one
+static inline void emit_prologue(Emitter *e) {
+	emit8(e, 0x53); // push rbx
+	emit8(e, 0x55); // push rbp
+	emit16(e, 0x5441); // push r12
+	emit16(e, 0x5541); // push r13
+	emit16(e, 0x5641); // push r14
+	emit16(e, 0x5741); // push r15
+	emit32(e, 0x08EC8348); // sub rsp, 8
+	emit_mov64(e, HOST_EMU, RDI);
+	emit_registers_load(e);
+}
+
+static inline void emit_epilogue(Emitter *e) {
+	emit_registers_store(e);
+	emit32(e, 0x08C48348); // add rsp, 8
+	emit16(e, 0x5F41); // pop r15
+	emit16(e, 0x5E41); // pop r14
+	emit16(e, 0x5D41); // pop r13
+	emit16(e, 0x5C41); // pop r12
+	emit8(e, 0x5D); // pop rbp
+	emit8(e, 0x5B); // pop rbx
+	emit8(e, 0xC3); // ret
+}
+
+
+static inline uint8_t pair_of(Sm83Register reg) { return HOST_BC + reg / 2; }
+
+// NOTE: Reads an 8 bit register into ecx, zero extended
+static inline void emit_get8(Emitter *e, Sm83Register reg) {
+	if (reg == SM83_A) {
+		emit_mov(e, RCX, HOST_A);
+	} else if (reg % 2 == 0) {
+		emit_mov(e, RCX, pair_of(reg));
+		emit_shr(e, RCX, 8);
+	} else {
+		emit_movzx8(e, RCX, pair_of(reg));
+	}
+}
+
+// NOTE: Writes ecx, zero extended, into an 8 bit register. Clobbers ecx
+static inline void emit_put8(Emitter *e, Sm83Register reg) {
+	if (reg == SM83_A) {
+		emit_mov(e, HOST_A, RCX);
+	} else if (reg % 2 == 0) {
+		emit_alu_imm(e, ALU_AND, pair_of(reg), 0x00FF);
+		emit_shl(e, RCX, 8);
+		emit_or(e, pair_of(reg), RCX);
+	} else {
+		emit_alu_imm(e, ALU_AND, pair_of(reg), 0xFF00);
+		emit_or(e, pair_of(reg), RCX);
+	}
+}
+
+
+// ============================
+// ========== MEMORY ==========
+// ============================
+
+// NOTE: Whether the native code has to give the next op back to cpu_step. A write may have
+//  switched the bank of the block, enabled an interrupt, or come from EI or HALT
+static inline bool should_stop(Emulator *emu) {
+	return emu->block_cache->current == NULL || !cpu_can_run_ahead(emu);
+}
+
+// NOTE: The handlers return whether to stop in bit 8. They never look at the CPU registers,
+//  which are only stored back for the fallback
+static uint32_t native_read(Emulator *emu, uint32_t address) {
+	uint8_t value = memory_read(emu, address);
+	return value | should_stop(emu) << 8;
+}
+
+static uint32_t native_write(Emulator *emu, uint32_t address, uint32_t value) {
+	memory_write(emu, address, value);
+	return should_stop(emu) << 8;
+}
+
+// NOTE: Ops without a translation run through opcode_execute, exactly like cpu_run_block runs them
+static uint32_t native_fallback(Emulator *emu, uint32_t op) {
+	CPU *cpu = &emu->cpu;
+	cpu->opcode_length = 0;
+	cpu->cycles = 0;
+	cpu->operand = op >> 16;
+	opcode_execute(emu, op & 0xFF);
+	cpu->pc += cpu->opcode_length;
+	emu->scheduler.clock += cpu->cycles;
+	opcode_sync_flags(emu);
+	return should_stop(emu) << 8;
+}
+
+
+static inline void emit_save_result(Emitter *e) {
+	emit8(e, 0x89); emit8(e, 0x04); emit8(e, 0x24); // mov [rsp], eax
+}
+
+// NOTE: The address goes in esi, set up by the caller. The value ends up in eax and ecx
+static inline void emit_read(Emitter *e) {
+	emit_mov64(e, RDI, HOST_EMU);
+	emit_call(e, (const void *)native_read);
+	emit_save_result(e);
+	emit_movzx8(e, RCX, RAX);
+}
+
+// NOTE: The address goes in esi and the value in edx, set up by the caller
+static inline void emit_write(Emitter *e) {
+	emit_mov64(e, RDI, HOST_EMU);
+	emit_call(e, (const void *)native_write);
+	emit_save_result(e);
+}
+
+// NOTE: (C) and (a8) are in the 0xFF00 page
+static inline void emit_high_address(Emitter *e, const DecodedOp *op) {
+	if (op->opcode == 0xE2 || op->opcode == 0xF2) {
+		emit_movzx8(e, RSI, HOST_BC);
+		emit_alu_imm(e, ALU_OR, RSI, 0xFF00);
+	} else if (op->opcode == 0xE0 || op->opcode == 0xF0) {
+		emit_mov_imm(e, RSI, 0xFF00 | (op->operand & 0xFF));
+	} else {
+		emit_mov_imm(e, RSI, op->operand);
+	}
+}
+
+
+// ===========================
+// ========== FLAGS ==========
+// ===========================
+
+typedef enum {
+	FLAGS_OUT_ADD,
+	FLAGS_OUT_SUB,
+	FLAGS_OUT_AND,
+	FLAGS_OUT_OR,
+	FLAGS_OUT_INC,
+	FLAGS_OUT_DEC,
+} FlagsOut;
+
+// NOTE: Turns the host flags of the last operation into f, keeps eax
+static inline void emit_flags(Emitter *e, FlagsOut out) {
+	emit8(e, 0x9C); // pushfq
+	emit8(e, 0x5A); // pop rdx
+	emit_movzx8(e, RDX, RDX);
+	emit_mov_imm64(e, RSI, (uint64_t)(uintptr_t)HOST_FLAGS);
+	emit32(e, 0x160CB60F); // movzx ecx, byte [rsi + rdx]
+
+	switch (out) {
+	case FLAGS_OUT_ADD:
+		emit_mov(e, HOST_F, RCX);
+		break;
+	case FLAGS_OUT_SUB:
+		emit_mov(e, HOST_F, RCX);
+		emit_alu_imm(e, ALU_OR, HOST_F, 0x40);
+		break;
+	case FLAGS_OUT_AND:
+		emit_mov(e, HOST_F, RCX);
+		emit_alu_imm(e, ALU_AND, HOST_F, 0x80);
+		emit_alu_imm(e, ALU_OR, HOST_F, 0x20);
+		break;
+	case FLAGS_OUT_OR:
+		emit_mov(e, HOST_F, RCX);
+		emit_alu_imm(e, ALU_AND, HOST_F, 0x80);
+		break;
+	// NOTE: INC and DEC keep the carry
+	case FLAGS_OUT_INC:
+	case FLAGS_OUT_DEC:
+		emit_alu_imm(e, ALU_AND, RCX, 0xA0);
+		emit_alu_imm(e, ALU_AND, HOST_F, 0x10);
+		emit_or(e, HOST_F, RCX);
+		if (out == FLAGS_OUT_DEC)
+			emit_alu_imm(e, ALU_OR, HOST_F, 0x40);
+		break;
+	}
+}
+
+
+// =========================
+// ========== OPS ==========
+// =========================
+
+// NOTE: How a translated op ends, so the block can check what it has to before the next one
+typedef enum {
+	OP_PLAIN,
+	// NOTE: Went through a handler, the result is in [rsp]
+	OP_CALLED,
+	// NOTE: Ran through native_fallback, which also moved pc and the clock
+	OP_FALLBACK,
+	// NOTE: A jump that already left the block
+	OP_LEFT,
+} OpEnd;
+
+
+typedef struct {
+	Emitter emitter;
+	size_t epilogue_jumps[BLOCK_MAX_OPS * 2 + 1];
+	uint8_t epilogue_jump_count;
+} Translation;
+
+// NOTE: Leaves the block after `count` ops, with pc at `pc`
+static inline void emit_leave(Translation *t, uint8_t count, int32_t pc) {
+	Emitter *e = &t->emitter;
+	if (pc >= 0)
+		emit_store16_imm(e, EMU_OFFSET(cpu.pc), pc);
+	emit_mov_imm(e, RAX, count);
+	t->epilogue_jumps[t->epilogue_jump_count++] = emit_jmp(e);
+}
+
+
+// NOTE: 8 bit loads, including the ones through (HL), (BC), (DE) and the 0xFF00 page
+static inline OpEnd emit_load_op(Emitter *e, const DecodedOp *op) {
+	uint8_t opcode = op->opcode;
+	if (opcode >= 0x40 && opcode <= 0x7F) {
+		Sm83Register dst = (opcode >> 3) & 7;
+		Sm83Register src = opcode & 7;
+		if (src == SM83_HL_INDIRECT) {
+			emit_mov(e, RSI, HOST_HL);
+			emit_read(e);
+			emit_put8(e, dst);
+			return OP_CALLED;
+		}
+		if (dst == SM83_HL_INDIRECT) {
+			emit_get8(e, src);
+			emit_mov(e, RDX, RCX);
+			emit_mov(e, RSI, HOST_HL);
+			emit_write(e);
+			return OP_CALLED;
+		}
+		if (dst != src) {
+			emit_get8(e, src);
+			emit_put8(e, dst);
+		}
+		return OP_PLAIN;
+	}
+
+	switch (opcode) {
+	case 0x36: // LD (HL), d8
+		emit_mov_imm(e, RDX, op->operand & 0xFF);
+		emit_mov(e, RSI, HOST_HL);
+		emit_write(e);
+		return OP_CALLED;
+	case 0x02: case 0x12: // LD (BC), A / LD (DE), A
+	case 0x22: case 0x32: // LD (HL+), A / LD (HL-), A
+		emit_mov(e, RDX, HOST_A);
+		emit_mov(e, RSI, opcode == 0x02 ? HOST_BC : opcode == 0x12 ? HOST_DE : HOST_HL);
+		emit_write(e);
+		if (opcode == 0x22 || opcode == 0x32)
+			emit_step16(e, HOST_HL, opcode == 0x32);
+		return OP_CALLED;
+	case 0x0A: case 0x1A: // LD A, (BC) / LD A, (DE)
+	case 0x2A: case 0x3A: // LD A, (HL+) / LD A, (HL-)
+		emit_mov(e, RSI, opcode == 0x0A ? HOST_BC : opcode == 0x1A ? HOST_DE : HOST_HL);
+		emit_read(e);
+		emit_mov(e, HOST_A, RCX);
+		if (opcode == 0x2A || opcode == 0x3A)
+			emit_step16(e, HOST_HL, opcode == 0x3A);
+		return OP_CALLED;
+	case 0xE0: case 0xE2: case 0xEA: // LDH (a8), A / LD (C), A / LD (a16), A
+		emit_high_address(e, op);
+		emit_mov(e, RDX, HOST_A);
+		emit_write(e);
+		return OP_CALLED;
+	case 0xF0: case 0xF2: case 0xFA: // LDH A, (a8) / LD A, (C) / LD A, (a16)
+		emit_high_address(e, op);
+		emit_read(e);
+		emit_mov(e, HOST_A, RCX);
+		return OP_CALLED;
+	default: { // LD r, d8
+		Sm83Register dst = (opcode >> 3) & 7;
+		emit_mov_imm(e, RCX, op->operand & 0xFF);
+		emit_put8(e, dst);
+		return OP_PLAIN;
+	}
+	}
+}
+
+
+// NOTE: ADD, ADC, SUB, SBC, AND, XOR, OR and CP, in the order of the opcode bits 3-5
+static inline OpEnd emit_alu_op(Emitter *e, const DecodedOp *op) {
+	static const uint8_t HOST_OPS[8] = { 0x00, 0x10, 0x28, 0x18, 0x20, 0x30, 0x08, 0x38 };
+	static const FlagsOut FLAGS_OUT[8] = {
+		FLAGS_OUT_ADD, FLAGS_OUT_ADD, FLAGS_OUT_SUB, FLAGS_OUT_SUB,
+		FLAGS_OUT_AND, FLAGS_OUT_OR, FLAGS_OUT_OR, FLAGS_OUT_SUB,
+	};
+	uint8_t kind = (op->opcode >> 3) & 7;
+
+	OpEnd end = OP_PLAIN;
+	if (op->opcode >= 0xC0) {
+		emit_mov_imm(e, RCX, op->operand & 0xFF);
+	} else if ((op->opcode & 7) == SM83_HL_INDIRECT) {
+		emit_mov(e, RSI, HOST_HL);
+		emit_read(e);
+		end = OP_CALLED;
+	} else {
+		emit_get8(e, op->opcode & 7);
+	}
+
+	emit_mov(e, RAX, HOST_A);
+	if (kind == 1 || kind == 3)
+		emit_bt(e, HOST_F, 4);
+	emit8(e, HOST_OPS[kind]);
+	emit8(e, 0xC8); // al, cl
+	emit_flags(e, FLAGS_OUT[kind]);
+	if (kind != 7)
+		emit_movzx8(e, HOST_A, RAX);
+	return end;
+}
+
+
+static inline void emit_inc_dec_op(Emitter *e, const DecodedOp *op) {
+	Sm83Register reg = (op->opcode >> 3) & 7;
+	bool is_dec = op->opcode & 1;
+	emit_get8(e, reg);
+	emit_mov(e, RAX, RCX);
+	emit8(e, 0xFE);
+	emit8(e, is_dec ? 0xC8 : 0xC0); // dec al / inc al
+	emit_flags(e, is_dec ? FLAGS_OUT_DEC : FLAGS_OUT_INC);
+	emit_movzx8(e, RCX, RAX);
+	emit_put8(e, reg);
+}
+
+
+// NOTE: JR and JP end the block, taken or not
+static inline void emit_jump_op(Translation *t, const DecodedOp *op, uint16_t pc, uint8_t count) {
+	Emitter *e = &t->emitter;
+	bool is_relative = op->opcode < 0x40;
+	uint16_t next = pc + op->length;
+	uint16_t target = is_relative ? next + (int8_t)(op->operand & 0xFF) : op->operand;
+	uint8_t taken_cycles = is_relative ? 12 : 16;
+	uint8_t skipped_cycles = is_relative ? 8 : 12;
+
+	bool is_conditional = op->opcode != 0x18 && op->opcode != 0xC3;
+	if (is_conditional) {
+		// NOTE: Bits 3-4 pick NZ, Z, NC or C
+		uint8_t condition = (op->opcode >> 3) & 3;
+		emit_test_imm(e, HOST_F, condition < 2 ? 0x80 : 0x10);
+		size_t skip = emit_jcc(e, condition % 2 == 0 ? CC_NZ : CC_Z);
+		emit_add64_emu(e, EMU_OFFSET(scheduler.clock), taken_cycles);
+		emit_leave(t, count, target);
+		patch_jump(e, skip, e->size);
+		emit_add64_emu(e, EMU_OFFSET(scheduler.clock), skipped_cycles);
+		emit_leave(t, count, next);
+		return;
+	}
+	emit_add64_emu(e, EMU_OFFSET(scheduler.clock), taken_cycles);
+	emit_leave(t, count, target);
+}
+
+
+static inline void emit_fallback_op(Emitter *e, const DecodedOp *op, uint16_t pc) {
+	emit_registers_store(e);
+	emit_store16_imm(e, EMU_OFFSET(cpu.pc), pc);
+	emit_mov64(e, RDI, HOST_EMU);
+	emit_mov_imm(e, RSI, op->opcode | (uint32_t)op->operand << 16);
+	emit_call(e, (const void *)native_fallback);
+	emit_save_result(e);
+	emit_registers_load(e);
+}
+
+
+// NOTE: Cycles of the ops translated to native code, 0 for the ones that fall back
+static inline uint8_t native_cycles(uint8_t opcode) {
+	if (opcode == 0x76)
+		return 0;
+	if (opcode >= 0x40 && opcode <= 0x7F)
+		return (opcode & 7) == SM83_HL_INDIRECT || ((opcode >> 3) & 7) == SM83_HL_INDIRECT ? 8 : 4;
+	if (opcode >= 0x80 && opcode <= 0xBF)
+		return (opcode & 7) == SM83_HL_INDIRECT ? 8 : 4;
+
+	switch (opcode) {
+	case 0x00: return 4; // NOP
+	case 0x2F: case 0x37: case 0x3F: return 4; // CPL, SCF, CCF
+	case 0x04: case 0x0C: case 0x14: case 0x1C: case 0x24: case 0x2C: case 0x3C: return 4; // INC r
+	case 0x05: case 0x0D: case 0x15: case 0x1D: case 0x25: case 0x2D: case 0x3D: return 4; // DEC r
+	case 0x03: case 0x13: case 0x23: case 0x33: return 8; // INC rr
+	case 0x0B: case 0x1B: case 0x2B: case 0x3B: return 8; // DEC rr
+	case 0x01: case 0x11: case 0x21: case 0x31: return 12; // LD rr, d16
+	case 0x06: case 0x0E: case 0x16: case 0x1E: case 0x26: case 0x2E: case 0x3E: return 8; // LD r, d8
+	case 0x36: return 12; // LD (HL), d8
+	case 0x02: case 0x12: case 0x22: case 0x32: return 8; // LD (rr), A
+	case 0x0A: case 0x1A: case 0x2A: case 0x3A: return 8; // LD A, (rr)
+	case 0xE2: case 0xF2: return 8; // LD (C), A / LD A, (C)
+	case 0xE0: case 0xF0: return 12; // LDH
+	case 0xEA: case 0xFA: return 16; // LD (a16), A / LD A, (a16)
+	case 0xC6: case 0xCE: case 0xD6: case 0xDE: case 0xE6: case 0xEE: case 0xF6: case 0xFE: return 8; // ALU d8
+	default: return 0;
+	}
+}
+
+static inline bool is_native_jump(uint8_t opcode) {
+	switch (opcode) {
+	case 0x18: case 0x20: case 0x28: case 0x30: case 0x38:
+	case 0xC2: case 0xC3: case 0xCA: case 0xD2: case 0xDA:
+		return true;
+	default:
+		return false;
+	}
+}
+
+
+static inline OpEnd emit_op(Translation *t, const DecodedOp *op, uint16_t pc, uint8_t count) {
+	Emitter *e = &t->emitter;
+	uint8_t opcode = op->opcode;
+	if (is_native_jump(opcode)) {
+		emit_jump_op(t, op, pc, count);
+		return OP_LEFT;
+	}
+	if (native_cycles(opcode) == 0) {
+		emit_fallback_op(e, op, pc);
+		return OP_FALLBACK;
+	}
+
+	OpEnd end = OP_PLAIN;
+	if (opcode >= 0x80 && opcode <= 0xBF) {
+		end = emit_alu_op(e, op);
+	} else if (opcode >= 0xC0) {
+		end = (opcode & 0x0F) == 0x06 || (opcode & 0x0F) == 0x0E ? emit_alu_op(e, op) : emit_load_op(e, op);
+	} else if (opcode >= 0x40) {
+		end = emit_load_op(e, op);
+	} else {
+		switch (opcode & 0x0F) {
+		case 0x00: break; // NOP
+		case 0x01: // LD rr, d16
+			if (opcode == 0x31)
+				emit_store16_imm(e, EMU_OFFSET(cpu.sp), op->operand);
+			else
+				emit_mov_imm(e, HOST_BC + (opcode >> 4), op->operand);
+			break;
+		case 0x03: case 0x0B: // INC rr / DEC rr
+			if (opcode >> 4 == 3)
+				emit_step16_emu(e, EMU_OFFSET(cpu.sp), opcode & 0x08);
+			else
+				emit_step16(e, HOST_BC + (opcode >> 4), opcode & 0x08);
+			break;
+		case 0x04: case 0x05: case 0x0C: case 0x0D:
+			emit_inc_dec_op(e, op);
+			break;
+		case 0x0F:
+			if (opcode == 0x2F) { // CPL
+				emit_alu_imm(e, ALU_XOR, HOST_A, 0xFF);
+				emit_alu_imm(e, ALU_AND, HOST_F, 0x90);
+				emit_alu_imm(e, ALU_OR, HOST_F, 0x60);
+			} else { // CCF
+				emit_alu_imm(e, ALU_XOR, HOST_F, 0x10);
+				emit_alu_imm(e, ALU_AND, HOST_F, 0x90);
+			}
+			break;
+		case 0x07: // SCF
+			emit_alu_imm(e, ALU_AND, HOST_F, 0x80);
+			emit_alu_imm(e, ALU_OR, HOST_F, 0x10);
+			break;
+		default:
+			end = emit_load_op(e, op);
+			break;
+		}
+	}
+	emit_add64_emu(e, EMU_OFFSET(scheduler.clock), native_cycles(opcode));
+	return end;
+}
+
+
+// NOTE: Checked between two ops, the deadline moves when an IO write reschedules an event
+static inline void emit_checks(Translation *t, OpEnd end, size_t *exit) {
+	Emitter *e = &t->emitter;
+	uint8_t count = 0;
+	if (end == OP_CALLED || end == OP_FALLBACK) {
+		emit8(e, 0xF6); emit8(e, 0x44); emit8(e, 0x24); emit8(e, 0x01); emit8(e, 0x01); // test byte [rsp + 1], 1
+		exit[count++] = emit_jcc(e, CC_NZ);
+	}
+	emit_load64(e, RAX, EMU_OFFSET(scheduler.clock));
+	emit_cmp8_emu(e, EMU_OFFSET(scheduler.size), 0);
+	size_t no_deadline = emit_jcc(e, CC_Z);
+	emit_cmp64_emu(e, RAX, DEADLINE_OFFSET);
+	exit[count++] = emit_jcc(e, CC_NC);
+	patch_jump(e, no_deadline, e->size);
+	exit[count] = SIZE_MAX;
+}
+
+
+static void *translate(Jit *jit, Block *block) {
+	if (JIT_ARENA_SIZE - jit->arena_used < JIT_BLOCK_CODE_SIZE)
+		jit_flush(jit);
+	if (mprotect(jit->arena, JIT_ARENA_SIZE, PROT_READ | PROT_WRITE) != 0)
+		return NULL;
+
+	Translation t = {0};
+	Emitter *e = &t.emitter;
+	e->code = jit->arena + jit->arena_used;
+	e->capacity = JIT_BLOCK_CODE_SIZE;
+	emit_prologue(e);
+
+	// NOTE: Exits in the middle of the block, with the count and pc to leave with
+	struct { size_t jumps[3]; uint8_t count; int32_t pc; } exits[BLOCK_MAX_OPS];
+	uint8_t exit_count = 0;
+
+	uint16_t pc = block->start;
+	for (uint8_t i = 0; i < block->size; i++) {
+		const DecodedOp *op = &block->ops[i];
+		OpEnd end = emit_op(&t, op, pc, i + 1);
+		if (end == OP_LEFT)
+			break;
+		pc += op->length;
+
+		// NOTE: pc was already moved by native_fallback, maybe to somewhere else
+		int32_t next_pc = end == OP_FALLBACK ? -1 : pc;
+		if (i + 1 == block->size) {
+			emit_leave(&t, i + 1, next_pc);
+			break;
+		}
+		emit_checks(&t, end, exits[exit_count].jumps);
+		exits[exit_count].count = i + 1;
+		exits[exit_count].pc = next_pc;
+		exit_count++;
+	}
+
+	for (uint8_t i = 0; i < exit_count; i++) {
+		for (uint8_t j = 0; exits[i].jumps[j] != SIZE_MAX; j++)
+			patch_jump(e, exits[i].jumps[j], e->size);
+		emit_leave(&t, exits[i].count, exits[i].pc);
+	}
+
+	size_t epilogue = e->size;
+	emit_epilogue(e);
+	for (uint8_t i = 0; i < t.epilogue_jump_count; i++)
+		patch_jump(e, t.epilogue_jumps[i], epilogue);
+
+	bool is_emitted = e->size <= e->capacity;
+	void *code = is_emitted ? e->code : NULL;
+	if (is_emitted)
+		jit->arena_used += (e->size + 15) & ~(size_t)15;
+	if (mprotect(jit->arena, JIT_ARENA_SIZE, PROT_READ | PROT_EXEC) != 0)
+		return NULL;
+	return code;
+}
+
+
+bool jit_enable(Emulator *emu) {
+	if (emu->jit != NULL)
+		return true;
+
+	Jit *jit = malloc(sizeof(Jit));
+	if (jit == NULL)
+		return false;
+	memset(jit, 0, sizeof(Jit));
+
+	void *arena = mmap(NULL, JIT_ARENA_SIZE, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (arena == MAP_FAILED) {
+		free(jit);
+		return false;
+	}
+	jit->arena = arena;
+
+	for (uint16_t host = 0; host < 256; host++) {
+		bool zf = (host >> 6) & 1, af = (host >> 4) & 1, cf = host & 1;
+		HOST_FLAGS[host] = zf << 7 | af << 5 | cf << 4;
+	}
+
+	emu->jit = jit;
+	return true;
+}
+
+
+void jit_disable(Emulator *emu) {
+	if (emu->jit == NULL)
+		return;
+	munmap(emu->jit->arena, JIT_ARENA_SIZE);
+	free(emu->jit);
+	emu->jit = NULL;
+}
+
+
+void jit_flush(Jit *jit) {
+	memset(jit->entries, 0, sizeof(jit->entries));
+	jit->arena_used = 0;
+}
+
+
+bool jit_run(Emulator *emu, BlockRun *run) {
+	Jit *jit = emu->jit;
+	BlockCache *cache = emu->block_cache;
+	uint16_t pc = emu->cpu.pc;
+	if (cache == NULL || pc > 0x7FFF)
+		return false;
+
+	Block *block = block_cache_lookup(emu, pc);
+	if (block == NULL)
+		return false;
+
+	JitEntry *entry = &jit->entries[block - cache->blocks];
+	if (entry->code == NULL || entry->start != pc || entry->bank != block->bank) {
+		if (entry->start != pc || entry->bank != block->bank) {
+			*entry = (JitEntry){ .start = pc, .bank = block->bank };
+		}
+		if (++entry->runs < JIT_HOT_RUNS)
+			return false;
+		entry->code = translate(jit, block);
+		entry->runs = 0;
+		if (entry->code == NULL)
+			return false;
+		jit->blocks_translated++;
+	}
+
+	opcode_sync_flags(emu);
+	uint64_t clock = emu->scheduler.clock;
+	// NOTE: A bank switch clears it, which the native code checks after every write
+	cache->current = block;
+	uint8_t count = ((NativeBlock)entry->code)(emu);
+	jit->blocks_run++;
+
+	run->steps = count;
+	run->cycles = emu->scheduler.clock - clock;
+	run->last_pc = pc;
+	uint16_t next_pc = pc;
+	for (uint8_t i = 0; i < count; i++) {
+		run->last_pc = next_pc;
+		next_pc += block->ops[i].length;
+	}
+
+	// NOTE: cpu_run_block finishes a block left midway on the block cache
+	if (cache->current == block) {
+		cache->next_op = count;
+		cache->next_pc = next_pc;
+	}
+	return true;
+}
+
+
+#else
+
+
+bool jit_enable(Emulator *emu) {
+	(void)emu;
+	return false;
+}
+
+void jit_disable(Emulator *emu) { (void)emu; }
+
+void jit_flush(Jit *jit) { (void)jit; }
+
+bool jit_run(Emulator *emu, BlockRun *run) {
+	(void)emu;
+	(void)run;
+	return false;
+}
+
+
+#endif
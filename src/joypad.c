@@ -57,3 +57,10 @@ void joypad_release(Emulator *emu, JoypadButton button) {
 	}
 }
 
+
+static uint8_t p1_read(Emulator *emu, uint16_t address) { (void)address; return joypad_read(&emu->joypad); }
+static void p1_write(Emulator *emu, uint16_t address, uint8_t value) { (void)address; joypad_write(&emu->joypad, value); }
+
+void joypad_register_io(IOBus *io) {
+	io_register(io, 0xFF00, p1_read, p1_write, IO_SYNC_NONE);
+}
@@ -1,5 +1,6 @@
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include <raylib.h>
 
 #include "cartridge.h"
@@ -16,19 +17,14 @@ char* gb_file = "./assets/tetris.gb";
 // test_header("./assets/pokemon_crystal.gbc");
 // test_header("./assets/super_mario_land.gb");
 
-void draw_display_to_image(Emulator *emu, Image *image) {
-	// static Color raylib_palette[] = { WHITE, LIGHTGRAY, GRAY, BLACK };
-	Color palette[4] = {
-		WHITE,
-		LIGHTGRAY,
-		GRAY,
-		BLACK
-	    };
-	for (int y = 0; y < DISPLAY_HEIGHT; y++){
-	for (int x = 0; x < DISPLAY_WIDTH; x++) {
-		GBColor idx = emu->display.screen[y][x];
-		ImageDrawPixel(image, x, y, palette[idx]);
-	}}
+// NOTE: The save sits next to the ROM, with its extension swapped for .sav
+static inline void save_filename(const char *rom, char *filename, size_t size) {
+	snprintf(filename, size, "%s", rom);
+	char *extension = strrchr(filename, '.');
+	char *directory = strrchr(filename, '/');
+	if (extension != NULL && (directory == NULL || extension > directory))
+		*extension = '\0';
+	strncat(filename, ".sav", size - strlen(filename) - 1);
 }
 
 static inline void update_inputs(Emulator *emu) {
@@ -59,19 +55,41 @@ int main(void) {
 	InitWindow(DISPLAY_WIDTH * SCALE, DISPLAY_HEIGHT * SCALE, cart.title);
 	SetTargetFPS(60);
 
-	Image screen = GenImageColor(DISPLAY_WIDTH, DISPLAY_HEIGHT, BLANK);
-	Texture2D screen_texture = LoadTextureFromImage(screen);
-
 	Emulator emu = emulator_create();
-	emu.cartridge = &cart;
+	emulator_insert_cartridge(&emu, &cart);
+	// NOTE: The clock follows the wall clock while playing
+	mbc_set_clock_source(&emu, true);
+	if (emu.mbc.has_battery) {
+		char filename[4096];
+		save_filename(gb_file, filename, sizeof(filename));
+		if (!mbc_attach_save(&emu, filename))
+			fprintf(stderr, "Could not open %s, the game will not be saved\n", filename);
+	}
+
+	// NOTE: The framebuffer is already in the texture's format, and is uploaded without a copy
+	Image screen = {
+		.data = emu.display.framebuffer,
+		.width = DISPLAY_WIDTH,
+		.height = DISPLAY_HEIGHT,
+		.mipmaps = 1,
+		.format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8,
+	};
+	Texture2D screen_texture = LoadTextureFromImage(screen);
 
 	while(!WindowShouldClose()) {
 		update_inputs(&emu);
 
 		emulator_run_frame(&emu);
 
-		draw_display_to_image(&emu, &screen);
-		UpdateTexture(screen_texture, screen.data);
+		// NOTE: Only uploads the runs of lines that changed
+		uint8_t start = 0;
+		uint8_t end;
+		while (display_next_dirty_range(&emu.display, &start, &end)) {
+			Rectangle lines = { 0, start, DISPLAY_WIDTH, end - start };
+			UpdateTextureRec(screen_texture, lines, emu.display.framebuffer[start]);
+			start = end;
+		}
+		display_clear_dirty(&emu.display);
 		BeginDrawing();
 		ClearBackground(BLACK);
 		DrawTextureEx(screen_texture, (Vector2){0, 0}, 0.0f, SCALE, WHITE);
@@ -79,7 +97,6 @@ int main(void) {
 	}
 	CloseWindow();
 	UnloadTexture(screen_texture);
-	UnloadImage(screen);
 
 	emulator_destroy(&emu);
 	cartridge_free(&cart);
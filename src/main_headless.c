@@ -0,0 +1,159 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cartridge.h"
+#include "diff.h"
+#include "display.h"
+#include "emulator.h"
+#include "jit.h"
+#include "memory.h"
+
+// NOTE: Runs a ROM without a window, as fast as the host allows.
+//  No raylib, GL or X11, so it works on servers without a display
+
+
+static void print_usage(const char *program) {
+	fprintf(stderr,
+		"Usage: %s <rom> <frames> [options]\n"
+		"  --dump-frames <dir>   write frames as PPM images to <dir>\n"
+		"  --every <n>           only draw and dump one frame out of n (default 1)\n"
+		"  --dump-ram <file>     write WRAM and HRAM to <file> at the end\n"
+		"  --save <file>         keep the battery backed RAM in <file>\n"
+		"  --rtc-host            run the cartridge clock on host time instead of emulated time\n"
+		"  --jit                 run ROM code as native code, needs a JIT=on build on x86-64\n"
+		"  --diff                check every block against the plain interpreter, and report\n"
+		"                        where they first disagree\n",
+		program);
+}
+
+
+static bool write_ppm(Display *display, const char *filename) {
+	FILE *file = fopen(filename, "wb");
+	if (file == NULL)
+		return false;
+
+	fprintf(file, "P6\n%d %d\n255\n", DISPLAY_WIDTH, DISPLAY_HEIGHT);
+	for (uint8_t y = 0; y < DISPLAY_HEIGHT; y++) {
+		uint8_t line[DISPLAY_WIDTH * 3];
+		for (uint8_t x = 0; x < DISPLAY_WIDTH; x++) {
+			uint8_t rgba[4];
+			memcpy(rgba, &display->framebuffer[y][x], sizeof(rgba));
+			memcpy(&line[x * 3], rgba, 3);
+		}
+		fwrite(line, sizeof(line), 1, file);
+	}
+	return fclose(file) == 0;
+}
+
+
+static bool write_ram(Memory *memory, const char *filename) {
+	FILE *file = fopen(filename, "wb");
+	if (file == NULL)
+		return false;
+	fwrite(memory->wram, sizeof(memory->wram), 1, file);
+	fwrite(memory->highram, sizeof(memory->highram), 1, file);
+	return fclose(file) == 0;
+}
+
+
+int main(int argc, char **argv) {
+	if (argc < 3) {
+		print_usage(argv[0]);
+		return 1;
+	}
+	char *rom_file = argv[1];
+	long frames = strtol(argv[2], NULL, 10);
+	const char *frames_dir = NULL;
+	const char *ram_file = NULL;
+	const char *save_file = NULL;
+	bool is_rtc_host = false;
+	bool is_jit = false;
+	bool is_diff = false;
+	long every = 1;
+
+	for (int i = 3; i < argc; i++) {
+		bool has_value = i + 1 < argc;
+		if (strcmp(argv[i], "--dump-frames") == 0 && has_value)
+			frames_dir = argv[++i];
+		else if (strcmp(argv[i], "--every") == 0 && has_value)
+			every = strtol(argv[++i], NULL, 10);
+		else if (strcmp(argv[i], "--dump-ram") == 0 && has_value)
+			ram_file = argv[++i];
+		else if (strcmp(argv[i], "--save") == 0 && has_value)
+			save_file = argv[++i];
+		else if (strcmp(argv[i], "--rtc-host") == 0)
+			is_rtc_host = true;
+		else if (strcmp(argv[i], "--jit") == 0)
+			is_jit = true;
+		else if (strcmp(argv[i], "--diff") == 0)
+			is_diff = true;
+		else {
+			print_usage(argv[0]);
+			return 1;
+		}
+	}
+	if (frames <= 0 || every <= 0) {
+		print_usage(argv[0]);
+		return 1;
+	}
+
+	Cartridge cart = cartridge_load(rom_file);
+	if (!cart.is_load_success) {
+		fprintf(stderr, "Could not load %s\n", rom_file);
+		return 1;
+	}
+
+	Emulator emu = emulator_create();
+	emulator_insert_cartridge(&emu, &cart);
+	mbc_set_clock_source(&emu, is_rtc_host);
+	if (save_file != NULL && !mbc_attach_save(&emu, save_file)) {
+		fprintf(stderr, "Could not keep the cartridge RAM in %s\n", save_file);
+		emulator_destroy(&emu);
+		cartridge_free(&cart);
+		return 1;
+	}
+	// NOTE: Pixels are only worth drawing for the frames that get dumped
+	emulator_set_render_on_demand(&emu, true);
+	if (is_jit && !jit_enable(&emu))
+		fprintf(stderr, "No JIT in this build, running on the interpreter\n");
+	if (is_diff && !diff_enable(&emu)) {
+		fprintf(stderr, "Could not start the differential mode\n");
+		emulator_destroy(&emu);
+		cartridge_free(&cart);
+		return 1;
+	}
+
+	int status = 0;
+	uint64_t frames_drawn = emu.render.frames_drawn;
+	for (long frame = 0; frame < frames; frame++) {
+		if (frames_dir != NULL && frame % every == 0)
+			emulator_request_frame(&emu);
+		emulator_run_frame(&emu);
+		// NOTE: Dumped once the PPU has drawn a whole frame for the request, never in between
+		if (emu.render.frames_drawn == frames_drawn)
+			continue;
+		frames_drawn = emu.render.frames_drawn;
+
+		char filename[4096];
+		snprintf(filename, sizeof(filename), "%s/frame_%06ld.ppm", frames_dir, frame);
+		if (!write_ppm(&emu.display, filename)) {
+			fprintf(stderr, "Could not write %s\n", filename);
+			status = 1;
+			break;
+		}
+	}
+
+	if (emu.diff != NULL && emu.diff->has_diverged)
+		status = 1;
+	if (status == 0 && ram_file != NULL && !write_ram(emu.memory, ram_file)) {
+		fprintf(stderr, "Could not write %s\n", ram_file);
+		status = 1;
+	}
+
+	emulator_destroy(&emu);
+	cartridge_free(&cart);
+	return status;
+}
@@ -0,0 +1,328 @@
+#include "mbc.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "emulator.h"
+#include "logger.h"
+#include "memory_map.h"
+
+#define RAM_START 0xA000
+
+
+static inline size_t header_ram_size(RAMSize ram_size) {
+	switch (ram_size) {
+	case RAM_SIZE_16KBIT: return 0x800;
+	case RAM_SIZE_64KBIT: return 0x2000;
+	case RAM_SIZE_256KBIT: return 0x8000;
+	case RAM_SIZE_1MBIT: return 0x20000;
+	case RAM_SIZE_512KBIT: return 0x10000;
+	default: return 0;
+	}
+}
+
+
+MBC mbc_create(Cartridge *cartridge) {
+	MBC mbc = {0};
+	mbc.rom_bank_register = 1;
+	mbc.rom_bank_high = 1;
+	mbc.rom_bank_count = 2;
+	mbc.rtc = rtc_create();
+	if (cartridge == NULL)
+		return mbc;
+	if (cartridge->size / ROM_BANK_SIZE > 2)
+		mbc.rom_bank_count = cartridge->size / ROM_BANK_SIZE;
+
+	bool has_ram = false;
+	switch (cartridge->type) {
+	case CARTRIDGE_TYPE_0_ROM_ONLY: break;
+	case CARTRIDGE_TYPE_3_MBC1_RAM_BATTERY: mbc.has_battery = true; // fall through
+	case CARTRIDGE_TYPE_2_MBC1_RAM: has_ram = true; // fall through
+	case CARTRIDGE_TYPE_1_MBC1: mbc.type = MBC_1; break;
+	case CARTRIDGE_TYPE_6_MBC2_BATTERY: mbc.has_battery = true; // fall through
+	case CARTRIDGE_TYPE_5_MBC2: mbc.type = MBC_2; has_ram = true; break;
+	case CARTRIDGE_TYPE_10_MBC3_TIMER_RAM_BATTERY: has_ram = true; // fall through
+	case CARTRIDGE_TYPE_F_MBC3_TIMER_BATTERY: mbc.has_timer = true; mbc.has_battery = true; mbc.type = MBC_3; break;
+	case CARTRIDGE_TYPE_13_MBC3_RAM_BATTERY: mbc.has_battery = true; // fall through
+	case CARTRIDGE_TYPE_12_MBC3_RAM: has_ram = true; // fall through
+	case CARTRIDGE_TYPE_11_MBC3: mbc.type = MBC_3; break;
+	case CARTRIDGE_TYPE_1E_MBC5_RUMBLE_RAM_BATTERY: mbc.has_battery = true; // fall through
+	case CARTRIDGE_TYPE_1D_MBC5_RUMBLE_RAM: has_ram = true; // fall through
+	case CARTRIDGE_TYPE_1C_MBC5_RUMBLE: mbc.has_rumble = true; mbc.type = MBC_5; break;
+	case CARTRIDGE_TYPE_1B_MBC5_RAM_BATTERY: mbc.has_battery = true; // fall through
+	case CARTRIDGE_TYPE_1A_MBC5_RAM: has_ram = true; // fall through
+	case CARTRIDGE_TYPE_19_MBC5: mbc.type = MBC_5; break;
+	default: DEBUG("Unsupported cartridge type: %x", cartridge->type); break;
+	}
+
+	if (has_ram)
+		mbc.ram_size = mbc.type == MBC_2 ? MBC2_RAM_SIZE : header_ram_size(cartridge->ram_size);
+	if (mbc.ram_size > 0) {
+		mbc.ram = malloc(mbc.ram_size);
+		assert(mbc.ram);
+		// NOTE: MBC2 only stores the lower nibble, the upper one reads as set
+		memset(mbc.ram, mbc.type == MBC_2 ? 0xF0 : 0x00, mbc.ram_size);
+	}
+	return mbc;
+}
+
+
+// NOTE: The clone keeps its RAM in memory, only the original writes to the file
+MBC mbc_clone(MBC *mbc) {
+	MBC clone = *mbc;
+	clone.save = NULL;
+	if (mbc->ram != NULL) {
+		clone.ram = malloc(mbc->ram_size);
+		assert(clone.ram);
+		memcpy(clone.ram, mbc->ram, mbc->ram_size);
+	}
+	return clone;
+}
+
+
+void mbc_destroy(MBC *mbc) {
+	if (mbc->save != NULL)
+		save_close(mbc->save);
+	else
+		free(mbc->ram);
+	mbc->save = NULL;
+	mbc->ram = NULL;
+	mbc->ram_size = 0;
+}
+
+
+// NOTE: MBC3 maps its clock registers instead of RAM for banks 0x08-0x0C
+static inline bool is_rtc_selected(MBC *mbc) { return mbc->type == MBC_3 && mbc->ram_bank >= 0x08; }
+
+static inline uint64_t clock_now(Emulator *emu) {
+	return emu->mbc.rtc.is_host_time ? (uint64_t)time(NULL) : emu->scheduler.clock;
+}
+
+// NOTE: Only worth the trip to the file when the clock is set or latched
+static inline void store_clock(Emulator *emu) {
+	MBC *mbc = &emu->mbc;
+	if (mbc->save == NULL || !mbc->has_timer)
+		return;
+	rtc_store(&mbc->rtc, &mbc->save->data[mbc->ram_size], clock_now(emu));
+	save_mark_dirty(mbc->save, mbc->ram_size);
+}
+
+static inline size_t ram_offset(MBC *mbc, uint16_t address) {
+	if (mbc->type == MBC_2)
+		return (address - RAM_START) % MBC2_RAM_SIZE;
+	return ((size_t)mbc->ram_bank * RAM_BANK_SIZE + (address - RAM_START)) % mbc->ram_size;
+}
+
+
+uint8_t* mbc_ram_page(MBC *mbc, uint16_t address, bool is_write) {
+	if (mbc->ram == NULL || !mbc->is_ram_enabled || is_rtc_selected(mbc))
+		return NULL;
+	// NOTE: MBC2 writes have to set the upper nibble
+	if (mbc->type == MBC_2 && is_write)
+		return NULL;
+	// NOTE: The first write to a clean page goes through mbc_ram_write to mark it
+	size_t offset = ram_offset(mbc, address);
+	if (is_write && mbc->save != NULL && !save_is_dirty(mbc->save, offset))
+		return NULL;
+	return &mbc->ram[offset];
+}
+
+
+uint8_t mbc_ram_read(Emulator *emu, uint16_t address) {
+	MBC *mbc = &emu->mbc;
+	if (!mbc->is_ram_enabled)
+		return 0xFF;
+	if (is_rtc_selected(mbc)) {
+		if (!mbc->has_timer || mbc->ram_bank > 0x0C)
+			return 0xFF;
+		return mbc->rtc.latched[mbc->ram_bank - 0x08];
+	}
+	if (mbc->ram == NULL)
+		return 0xFF;
+	return mbc->ram[ram_offset(mbc, address)];
+}
+
+
+void mbc_ram_write(Emulator *emu, uint16_t address, uint8_t value) {
+	MBC *mbc = &emu->mbc;
+	if (!mbc->is_ram_enabled)
+		return;
+	if (is_rtc_selected(mbc)) {
+		if (!mbc->has_timer || mbc->ram_bank > 0x0C)
+			return;
+		rtc_write(&mbc->rtc, mbc->ram_bank - 0x08, value, clock_now(emu));
+		store_clock(emu);
+		return;
+	}
+	if (mbc->ram == NULL)
+		return;
+	size_t offset = ram_offset(mbc, address);
+	mbc->ram[offset] = mbc->type == MBC_2 ? value | 0xF0 : value;
+	if (mbc->save != NULL && !save_is_dirty(mbc->save, offset)) {
+		save_mark_dirty(mbc->save, offset);
+		memory_map_update_page(emu, address / MEMORY_PAGE_SIZE);
+	}
+}
+
+
+static inline void update_banks(MBC *mbc) {
+	switch (mbc->type) {
+	case MBC_NONE: break;
+	case MBC_1: {
+		// NOTE: The 2 bit register extends the ROM bank, or in advanced mode also picks
+		//  the bank of 0x0000-0x3FFF and the RAM bank
+		uint8_t upper = mbc->ram_bank_register & 0b11;
+		mbc->rom_bank_high = (upper << 5) | mbc->rom_bank_register;
+		mbc->rom_bank_low = mbc->is_advanced_mode ? upper << 5 : 0;
+		mbc->ram_bank = mbc->is_advanced_mode ? upper : 0;
+		break;
+	}
+	case MBC_2:
+		mbc->rom_bank_high = mbc->rom_bank_register;
+		break;
+	case MBC_3:
+	case MBC_5:
+		mbc->rom_bank_high = mbc->rom_bank_register;
+		mbc->ram_bank = mbc->ram_bank_register;
+		break;
+	}
+	mbc->rom_bank_low %= mbc->rom_bank_count;
+	mbc->rom_bank_high %= mbc->rom_bank_count;
+}
+
+
+static inline void remap(Emulator *emu, uint16_t start, uint16_t end) {
+	for (uint16_t page = start / MEMORY_PAGE_SIZE; page <= end / MEMORY_PAGE_SIZE; page++)
+		memory_map_update_page(emu, page);
+}
+
+
+void mbc_write(Emulator *emu, uint16_t address, uint8_t value) {
+	MBC *mbc = &emu->mbc;
+	MBC old = *mbc;
+
+	switch (mbc->type) {
+	case MBC_NONE:
+		return;
+	case MBC_1:
+		if (address <= 0x1FFF)
+			mbc->is_ram_enabled = (value & 0x0F) == 0x0A;
+		else if (address <= 0x3FFF)
+			mbc->rom_bank_register = (value & 0x1F) != 0 ? value & 0x1F : 1;
+		else if (address <= 0x5FFF)
+			mbc->ram_bank_register = value & 0b11;
+		else
+			mbc->is_advanced_mode = value & 0b1;
+		break;
+	case MBC_2:
+		// NOTE: Bit 8 of the address picks the register
+		if (address > 0x3FFF)
+			return;
+		if (address & 0x100)
+			mbc->rom_bank_register = (value & 0x0F) != 0 ? value & 0x0F : 1;
+		else
+			mbc->is_ram_enabled = (value & 0x0F) == 0x0A;
+		break;
+	case MBC_3:
+		if (address <= 0x1FFF)
+			mbc->is_ram_enabled = (value & 0x0F) == 0x0A;
+		else if (address <= 0x3FFF)
+			mbc->rom_bank_register = (value & 0x7F) != 0 ? value & 0x7F : 1;
+		else if (address <= 0x5FFF)
+			mbc->ram_bank_register = value;
+		else if (mbc->has_timer) {
+			// NOTE: Writing 0x00 then 0x01 copies the clock into the registers the game reads
+			if (mbc->rtc.is_latch_armed && value == 0x01) {
+				rtc_latch(&mbc->rtc, clock_now(emu));
+				store_clock(emu);
+			}
+			mbc->rtc.is_latch_armed = value == 0x00;
+		}
+		break;
+	case MBC_5:
+		// NOTE: Bank 0 can be mapped to 0x4000-0x7FFF, there are 9 bits of ROM bank
+		if (address <= 0x1FFF)
+			mbc->is_ram_enabled = (value & 0x0F) == 0x0A;
+		else if (address <= 0x2FFF)
+			mbc->rom_bank_register = (mbc->rom_bank_register & 0x100) | value;
+		else if (address <= 0x3FFF)
+			mbc->rom_bank_register = (mbc->rom_bank_register & 0xFF) | (value & 0b1) << 8;
+		else if (address <= 0x5FFF)
+			mbc->ram_bank_register = value & (mbc->has_rumble ? 0x07 : 0x0F);
+		break;
+	}
+	update_banks(mbc);
+
+	// NOTE: Only the windows that moved get repointed
+	bool is_rom_switched = false;
+	if (mbc->rom_bank_low != old.rom_bank_low) {
+		remap(emu, 0x0000, 0x3FFF);
+		is_rom_switched = true;
+	}
+	if (mbc->rom_bank_high != old.rom_bank_high) {
+		remap(emu, 0x4000, 0x7FFF);
+		is_rom_switched = true;
+	}
+	if (mbc->ram_bank != old.ram_bank || mbc->is_ram_enabled != old.is_ram_enabled)
+		remap(emu, 0xA000, 0xBFFF);
+
+	// NOTE: Games disable the RAM once they are done saving, a good moment to write it out
+	if (mbc->save != NULL && old.is_ram_enabled && !mbc->is_ram_enabled && save_hand_over(mbc->save))
+		save_request_flush(mbc->save);
+
+	// NOTE: The rest of the running block may come from the bank that just left
+	if (is_rom_switched && emu->block_cache != NULL)
+		emu->block_cache->current = NULL;
+}
+
+
+bool mbc_attach_save(Emulator *emu, const char *filename) {
+	MBC *mbc = &emu->mbc;
+	if (!mbc->has_battery || (mbc->ram == NULL && !mbc->has_timer) || mbc->save != NULL)
+		return false;
+	// NOTE: A new file starts out as the current RAM and clock, so MBC2 keeps its upper nibbles set
+	size_t size = mbc->ram_size + (mbc->has_timer ? RTC_SAVE_SIZE : 0);
+	uint8_t *initial = calloc(size, 1);
+	assert(initial);
+	if (mbc->ram != NULL)
+		memcpy(initial, mbc->ram, mbc->ram_size);
+	if (mbc->has_timer)
+		rtc_store(&mbc->rtc, &initial[mbc->ram_size], clock_now(emu));
+	SaveFile *save = save_open(filename, size, initial);
+	free(initial);
+	if (save == NULL)
+		return false;
+
+	free(mbc->ram);
+	mbc->ram = mbc->ram_size > 0 ? save->data : NULL;
+	mbc->save = save;
+	if (mbc->has_timer)
+		rtc_load(&mbc->rtc, &save->data[mbc->ram_size], clock_now(emu));
+	remap(emu, 0xA000, 0xBFFF);
+	return true;
+}
+
+
+void mbc_end_frame(Emulator *emu) {
+	MBC *mbc = &emu->mbc;
+	// NOTE: The handed over pages are clean again, so their next write has to be caught
+	if (mbc->save != NULL && save_hand_over(mbc->save))
+		remap(emu, 0xA000, 0xBFFF);
+}
+
+
+void mbc_eject(Emulator *emu) {
+	store_clock(emu);
+}
+
+
+void mbc_set_clock_source(Emulator *emu, bool is_host_time) {
+	RTC *rtc = &emu->mbc.rtc;
+	rtc_sync(rtc, clock_now(emu));
+	rtc->is_host_time = is_host_time;
+	rtc->base = clock_now(emu);
+}
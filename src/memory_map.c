@@ -1,10 +1,13 @@
 #include "memory_map.h"
 
+#include "block_cache.h"
 #include "interrupts.h"
-#include "joypad.h"
+#include "io.h"
 #include "logger.h"
+#include "mbc.h"
 #include "ppu.h"
-#include "timer.h"
+#include "profile.h"
+#include "scheduler.h"
 
 uint16_t memory_read_16(Emulator *emu, uint16_t address) {
 	return memory_read(emu, address) | memory_read(emu, address + 1) << 8;
@@ -16,124 +19,145 @@ void memory_write_16(Emulator *emu, uint16_t address, uint16_t value) {
 }
 
 
-uint8_t memory_read(Emulator *emu, uint16_t address) {
-	// TODO: Will require a mapper!
-	if (address <= 0x7FFF)
-		return emu->cartridge->content[address];
+static inline bool is_code_page(Emulator *emu, uint16_t address) {
+	return emu->block_cache != NULL && emu->block_cache->wram_page_code[(address - 0xC000) / MEMORY_PAGE_SIZE] > 0;
+}
+
+void memory_map_update_page(Emulator *emu, uint8_t page) {
+	MemoryMap *map = &emu->memory_map;
+	uint16_t address = page * MEMORY_PAGE_SIZE;
+	map->read[page] = NULL;
+	map->write[page] = NULL;
+
+	// NOTE: ROM, through the banks of the MBC. Writes go to the handlers
+	if (address <= 0x7FFF) {
+		Cartridge *cart = emu->cartridge;
+		size_t offset = mbc_rom_offset(&emu->mbc, address);
+		if (cart != NULL && cart->content != NULL && offset + MEMORY_PAGE_SIZE <= cart->size)
+			map->read[page] = &cart->content[offset];
+		return;
+	}
+
+	// NOTE: External RAM of the current bank, when enabled
+	if (address >= 0xA000 && address <= 0xBFFF) {
+		map->read[page] = mbc_ram_page(&emu->mbc, address, false);
+		map->write[page] = mbc_ram_page(&emu->mbc, address, true);
+		return;
+	}
+
+	// NOTE: WRAM and its echo share their pages. Writes to a page with cached code
+	//  go through the handlers, which invalidate the blocks
+	if (address >= 0xC000 && address <= 0xFDFF && emu->memory != NULL) {
+		uint16_t wram = (address - 0xC000) % WRAM_SIZE + 0xC000;
+		uint8_t *host = &emu->memory->wram[wram - 0xC000];
+		map->read[page] = host;
+		map->write[page] = is_code_page(emu, wram) ? NULL : host;
+
+		uint8_t twin = page < 0xE0 ? page + 0x20 : page - 0x20;
+		if (twin <= 0xFD) {
+			map->read[twin] = map->read[page];
+			map->write[twin] = map->write[page];
+		}
+	}
+}
+
+void memory_map_rebuild(Emulator *emu) {
+	for (uint16_t page = 0; page < MEMORY_PAGE_COUNT; page++)
+		memory_map_update_page(emu, page);
+}
+
+
+// NOTE: VRAM and OAM never get a host pointer, the PPU has to catch up first to know
+//  whether they are blocked in its current mode
+uint8_t memory_read_handler(Emulator *emu, uint16_t address) {
+	// NOTE: ROM past the end of the file
+	if (address <= 0x7FFF) {
+		size_t offset = mbc_rom_offset(&emu->mbc, address);
+		if (emu->cartridge == NULL || offset >= emu->cartridge->size)
+			return 0xFF;
+		return emu->cartridge->content[offset];
+	}
 
 	// NOTE: VRAM
-	if (0x8000 <= address && address <= 0x9FFF)
+	if (0x8000 <= address && address <= 0x9FFF) {
+		scheduler_sync_ppu(emu);
 		return ppu_vram_read(&emu->ppu, address - 0x8000);
+	}
 	
-	// NOTE: SWITCH WRAM
-
-	// NOTE: WRAM
-	if (address >= 0xC000 && address <= 0xDFFF)
-		return emu->memory->wram[address - 0xC000];
+	// NOTE: External RAM that is disabled, missing, or not plain memory
+	if (address >= 0xA000 && address <= 0xBFFF)
+		return mbc_ram_read(emu, address);
 
-	// NOTE: Echo of WRAM
-	if (address >= 0xE000 && address <= 0xFDFF)
-		return memory_read(emu, address - 0x2000);
+	// NOTE: WRAM and its echo
+	if (address >= 0xC000 && address <= 0xFDFF)
+		return emu->memory->wram[(address - 0xC000) % WRAM_SIZE];
 	
 	// NOTE: OAM
-	if (address >= 0xFE00 && address <= 0xFE9F)
+	if (address >= 0xFE00 && address <= 0xFE9F) {
+		scheduler_sync_ppu(emu);
 		return ppu_oam_read(&emu->ppu, address - 0xFE00);
-	
-	// NOTE: Empty IO
-	
-	// NOTE: IO PORTS
-	
-	switch (address) {
-	case 0xFF00: return joypad_read(&emu->joypad);
-	// NOTE: Timers
-	case 0xFF04: return timer_div_read(emu);
-	case 0xFF05: return emu->timer.tima;
-	case 0xFF06: return emu->timer.tma;
-	case 0xFF07: return timer_tac_read(emu);
-	// NOTE: PPU Registers
-	case 0xFF40: return ppu_lcdc_read(&emu->ppu);
-	case 0xFF41: return emu->ppu.stat;
-	case 0xFF42: return emu->ppu.scy;
-	case 0xFF43: return emu->ppu.scx;
-	case 0xFF44: return emu->ppu.line;
-	case 0xFF46: return 0xFF; // NOTE: OAM DMA
-	case 0xFF47: return emu->ppu.bgp;
-	// NOTE: Interrupts
-	case 0xFF0F: return interrupt_flag_read(&emu->interrupt);
-	case 0xFFFF: return interrupt_enable_read(&emu->interrupt);
 	}
 
-	// NOTE: High WRAM
+	// NOTE: High WRAM shares its page with the I/O ports
 	if (address >= 0xFF80 && address <= 0xFFFE)
 		return emu->memory->highram[address - 0xFF80];
+	
+	// NOTE: IO PORTS
+	if (address >= IO_START && address < IO_START + IO_REGISTER_COUNT)
+		return io_read(emu, address);
 
+	// NOTE: Interrupt Enable
+	if (address == 0xFFFF)
+		return interrupt_enable_read(&emu->interrupt);
 
 	DEBUG("Reading unmapped address: %x", address);
 
 	return 0xFF;
 }
 
-void memory_write(Emulator *emu, uint16_t address, uint8_t value) {
-	// TODO: Will require a mapper!
-	if (address <= 0x7FFF) {
-		// TODO: Bank switching writes
-		return;
-	}
+void memory_write_handler(Emulator *emu, uint16_t address, uint8_t value) {
+	// NOTE: MBC registers
+	if (address <= 0x7FFF)
+		return mbc_write(emu, address, value);
 
 	// NOTE: VRAM
-	if (0x8000 <= address && address <= 0x9FFF)
+	if (0x8000 <= address && address <= 0x9FFF) {
+		scheduler_sync_ppu(emu);
 		return ppu_vram_write(&emu->ppu, address - 0x8000, value);
+	}
 	
-	// NOTE: SWITCH WRAM
-
-	// NOTE: WRAM
-	if (address >= 0xC000 && address <= 0xDFFF) {
-		emu->memory->wram[address - 0xC000] = value;
+	// NOTE: External RAM
+	if (address >= 0xA000 && address <= 0xBFFF)
+		return mbc_ram_write(emu, address, value);
+
+	// NOTE: WRAM and its echo, only pages with cached code end up here
+	if (address >= 0xC000 && address <= 0xFDFF) {
+		uint16_t wram = (address - 0xC000) % WRAM_SIZE + 0xC000;
+		emu->memory->wram[wram - 0xC000] = value;
+		block_cache_invalidate(emu, wram);
 		return;
 	}
-
-	// NOTE: Echo of WRAM
-	if (address >= 0xE000 && address <= 0xFDFF)
-		return memory_write(emu, address - 0x2000, value);
 	
 	// NOTE: OAM
-	if (address >= 0xFE00 && address <= 0xFE9F)
+	if (address >= 0xFE00 && address <= 0xFE9F) {
+		scheduler_sync_ppu(emu);
 		return ppu_oam_write(&emu->ppu, address - 0xFE00, value);
-	
-	// NOTE: Empty IO
-	
-	// NOTE: IO PORTS
-	switch (address) {
-	case 0xFF00: joypad_write(&emu->joypad, value); return;
-	case 0xFF04: timer_div_reset(emu); return;
-	case 0xFF05: timer_tima_write(emu, value); return;
-	case 0xFF06: timer_tma_write(emu, value); return;
-	case 0xFF07: timer_tac_write(emu, value); return;
-	// NOTE: PPU
-	case 0xFF40: return ppu_lcdc_write(&emu->ppu, value);
-	case 0xFF41: emu->ppu.stat = value; return;
-	case 0xFF42: emu->ppu.scy = value; return;
-	case 0xFF43: emu->ppu.scx = value; return;
-	case 0xFF44: emu->ppu.line = value; return;
-	case 0xFF46: ppu_oam_dma_write(emu, value);
-	case 0xFF47: emu->ppu.bgp = value; return;
-	// NOTE: Interrupts
-	case 0xFF0F: interrupt_flag_write(&emu->interrupt, value); return;
-	case 0xFFFF: interrupt_enable_write(&emu->interrupt, value); return;
 	}
-	
+
 	// NOTE: High WRAM
 	if (address >= 0xFF80 && address <= 0xFFFE) {
 		emu->memory->highram[address - 0xFF80] = value;
+		block_cache_invalidate(emu, address);
 		return;
 	}
+	
+	// NOTE: IO PORTS
+	if (address >= IO_START && address < IO_START + IO_REGISTER_COUNT)
+		return io_write(emu, address, value);
 
 	// NOTE: Interrupt Enable
-	if (address == 0xFFFF) {
-		emu->memory->interrupt_enabled = value;
-		return;
-	}
+	if (address == 0xFFFF)
+		return interrupt_enable_write(&emu->interrupt, value);
 
 	DEBUG("Writing to unmapped address: [%x] = %x", address, value);
 }
-
@@ -1,7 +1,10 @@
 #include "opcode.h"
+#include "block_cache.h"
+#include "cpu.h"
 #include "interrupts.h"
 #include "logger.h"
 #include "memory_map.h"
+#include "scheduler.h"
 #include "timer.h"
 #include <stdint.h>
 #include <stdio.h>
@@ -9,36 +12,206 @@
 #define LEN(c) emu->cpu.opcode_length = c
 #define CYCLE(c) emu->cpu.cycles = c
 
-#define MASK_FLAG emu->cpu.f &= 0xF0
+#define FLAGS(Z, N, H, C) (((Z) << 7) | ((N) << 6) | ((H) << 5) | ((C) << 4))
+
+
+// NOTE: The 8 bit ALU operations only describe how their flags are computed.
+//  With CPU_LAZY_FLAGS the operands are kept in cpu.lazy_flags, and f is only
+//  computed once something reads a flag (conditional jumps, PUSH AF, DAA, ...)
+typedef enum {
+	FLAGS_NONE = 0,
+	FLAGS_ADD,
+	FLAGS_SUB,
+	FLAGS_AND,
+	FLAGS_OR,
+	FLAGS_INC,
+	FLAGS_DEC,
+} FlagsOp;
+
+static inline uint8_t flags_eval(uint8_t op, uint8_t lhs, uint8_t rhs, uint8_t carry, uint8_t result) {
+	switch (op) {
+	case FLAGS_ADD: return FLAGS(result == 0, 0, (lhs & 0xF) + (rhs & 0xF) + carry > 0xF, lhs + rhs + carry > 0xFF);
+	case FLAGS_SUB: return FLAGS(result == 0, 1, (lhs & 0xF) < (rhs & 0xF) + carry, lhs < rhs + carry);
+	case FLAGS_AND: return FLAGS(result == 0, 0, 1, 0);
+	case FLAGS_OR: return FLAGS(result == 0, 0, 0, 0);
+	// NOTE: INC and DEC keep the carry, which is passed in as the carry
+	case FLAGS_INC: return FLAGS(result == 0, 0, (lhs & 0xF) == 0xF, carry);
+	case FLAGS_DEC: return FLAGS(result == 0, 1, (lhs & 0xF) == 0x0, carry);
+	default: return 0;
+	}
+}
 
-#define SET_FLAG(Z, N, H, C) emu->cpu.f = ((Z) << 7) | ((N) << 6) | ((H) << 5) | ((C) << 4)
+#ifdef CPU_LAZY_FLAGS
+	static inline uint8_t flags_sync(Emulator *emu) {
+		if (emu->cpu.lazy_flags.op != FLAGS_NONE) {
+			emu->cpu.f = flags_eval(
+				emu->cpu.lazy_flags.op, emu->cpu.lazy_flags.lhs, emu->cpu.lazy_flags.rhs,
+				emu->cpu.lazy_flags.carry, emu->cpu.lazy_flags.result
+			);
+			emu->cpu.lazy_flags.op = FLAGS_NONE;
+		}
+		return emu->cpu.f;
+	}
+
+	#define ALU_FLAGS(OP, LHS, RHS, CARRY, RESULT) \
+		emu->cpu.lazy_flags.op = (OP); emu->cpu.lazy_flags.lhs = (LHS); emu->cpu.lazy_flags.rhs = (RHS); \
+		emu->cpu.lazy_flags.carry = (CARRY); emu->cpu.lazy_flags.result = (RESULT)
+	#define SET_FLAG(Z, N, H, C) do { \
+		uint8_t flags = FLAGS(Z, N, H, C); \
+		emu->cpu.lazy_flags.op = FLAGS_NONE; \
+		emu->cpu.f = flags; \
+	} while (0)
+	#define SYNC_FLAGS flags_sync(emu)
+	#define MASK_FLAG emu->cpu.lazy_flags.op = FLAGS_NONE; emu->cpu.f &= 0xF0
+
+	// NOTE: Every tracked operation sets Z from its result, so it never needs the full evaluation
+	#define FLAG_Z (emu->cpu.lazy_flags.op != FLAGS_NONE ? emu->cpu.lazy_flags.result == 0 : (emu->cpu.f >> 7) & 1)
+	#define FLAG_C ((flags_sync(emu) >> 4) & 1)
+	#define FLAG_H ((flags_sync(emu) >> 5) & 1)
+	#define FLAG_N ((flags_sync(emu) >> 6) & 1)
+#else
+	#define ALU_FLAGS(OP, LHS, RHS, CARRY, RESULT) emu->cpu.f = flags_eval(OP, LHS, RHS, CARRY, RESULT)
+	#define SET_FLAG(Z, N, H, C) emu->cpu.f = FLAGS(Z, N, H, C)
+	#define SYNC_FLAGS (void)0
+	#define MASK_FLAG emu->cpu.f &= 0xF0
+
+	#define FLAG_C ((emu->cpu.f >> 4) & 1)
+	#define FLAG_H ((emu->cpu.f >> 5) & 1)
+	#define FLAG_N ((emu->cpu.f >> 6) & 1)
+	#define FLAG_Z ((emu->cpu.f >> 7) & 1)
+#endif
+
+// NOTE: Immediate operands are fetched together with the opcode, see block_cache_decode
+#define OPERAND8 ((uint8_t)emu->cpu.operand)
+#define OPERAND16 (emu->cpu.operand)
+
+
+// NOTE: Threaded dispatch jumps straight into the handler through a table of label addresses,
+//  instead of going through the bounds check and jump table of the switch.
+//  Labels as values are a GNU extension, other compilers always get the switch.
+#if defined(OPCODE_DISPATCH_THREADED) && defined(__GNUC__)
+	#define THREADED_DISPATCH
+#endif
+
+#ifdef THREADED_DISPATCH
+	#define OP(CODE) op_##CODE
+	#define CB(CODE) cb_##CODE
+	#define CB_LINE_OP(START, N) cb_##START##_##N
+
+	// NOTE: Each handler ends with its own jump to the next one, so the branch predictor learns
+	//  which op follows which. The CB table still ends with a break out of the do-while
+	#define DISPATCH(TABLE, CODE) goto *TABLE[CODE]; do
+	#define DISPATCH_NEXT goto *table[opcode]
+	#define DISPATCH_END while (0)
+
+	#define OP_ENTRY(CODE) [CODE] = &&op_##CODE,
+	#define OP_ROW(H) \
+		OP_ENTRY(H##0) OP_ENTRY(H##1) OP_ENTRY(H##2) OP_ENTRY(H##3) \
+		OP_ENTRY(H##4) OP_ENTRY(H##5) OP_ENTRY(H##6) OP_ENTRY(H##7) \
+		OP_ENTRY(H##8) OP_ENTRY(H##9) OP_ENTRY(H##A) OP_ENTRY(H##B) \
+		OP_ENTRY(H##C) OP_ENTRY(H##D) OP_ENTRY(H##E) OP_ENTRY(H##F)
+
+	#define CB_ENTRY(CODE) [CODE] = &&cb_##CODE,
+	#define CB_ROW(H) \
+		CB_ENTRY(H##0) CB_ENTRY(H##1) CB_ENTRY(H##2) CB_ENTRY(H##3) \
+		CB_ENTRY(H##4) CB_ENTRY(H##5) CB_ENTRY(H##6) CB_ENTRY(H##7) \
+		CB_ENTRY(H##8) CB_ENTRY(H##9) CB_ENTRY(H##A) CB_ENTRY(H##B) \
+		CB_ENTRY(H##C) CB_ENTRY(H##D) CB_ENTRY(H##E) CB_ENTRY(H##F)
+	#define CB_LINE_ENTRY(START, N) [START + N] = &&cb_##START##_##N,
+	#define CB_LINE(START) \
+		CB_LINE_ENTRY(START, 0) CB_LINE_ENTRY(START, 1) CB_LINE_ENTRY(START, 2) CB_LINE_ENTRY(START, 3) \
+		CB_LINE_ENTRY(START, 4) CB_LINE_ENTRY(START, 5) CB_LINE_ENTRY(START, 6) CB_LINE_ENTRY(START, 7)
+#else
+	#define OP(CODE) case CODE
+	#define CB(CODE) case CODE
+	#define CB_LINE_OP(START, N) case START + N
+
+	#define DISPATCH(TABLE, CODE) switch (CODE)
+	#define DISPATCH_NEXT goto dispatch
+	#define DISPATCH_END
+#endif
 
-#define FLAG_C ((emu->cpu.f >> 4) & 1)
-#define FLAG_H ((emu->cpu.f >> 5) & 1)
-#define FLAG_N ((emu->cpu.f >> 6) & 1)
-#define FLAG_Z ((emu->cpu.f >> 7) & 1)
 
 static inline void prefix_opcodes(Emulator* emu);
 
-void opcode_execute(Emulator* emu, uint8_t opcode) {
-	switch (opcode) {
-	case 0x00: LEN(1); CYCLE(4); break; // NOP
-	case 0x10: // STOP
+// NOTE: Finishes the op that just ran in a block run, and fetches the next op of the block.
+//  Returns -1 when the block is over, or cpu_step has to check something first
+static inline int block_fetch(Emulator *emu, BlockRun *run) {
+	BlockCache *cache = emu->block_cache;
+	CPU *cpu = &emu->cpu;
+	// NOTE: Writing to the block's own code or switching its bank drops current, and any IO write
+	//  may have moved the deadline, so both are checked again after every op
+	if (cache->current == NULL || cpu->pc != cache->next_pc || cache->next_op >= cache->current->size)
+		return -1;
+	if (emu->scheduler.clock >= scheduler_next_deadline(&emu->scheduler))
+		return -1;
+	// NOTE: cpu_can_run_ahead, spelled out so it inlines into every handler
+	if (cpu->ime_scheduled || cpu->is_halted || cpu->is_halt_bugged || emu->interrupt.state != INTERRUPT_STATE_IDLE)
+		return -1;
+	if (emu->interrupt.ime && (emu->interrupt.flag & emu->interrupt.enable) != 0)
+		return -1;
+
+	const DecodedOp *op = &cache->current->ops[cache->next_op++];
+	cache->next_pc += op->length;
+	run->last_pc = cpu->pc;
+	cpu->opcode_length = 0;
+	cpu->cycles = 0;
+	cpu->operand = op->operand;
+	return op->opcode;
+}
+
+static inline int block_advance(Emulator *emu, BlockRun *run) {
+	CPU *cpu = &emu->cpu;
+	cpu->pc += cpu->opcode_length;
+	emu->scheduler.clock += cpu->cycles;
+	run->cycles += cpu->cycles;
+	run->steps++;
+	return block_fetch(emu, run);
+}
+
+
+// NOTE: Without a run, a handler returns right after its op. Within a run, it fetches the next
+//  op of the block and jumps to its handler itself, see DISPATCH_NEXT
+#define NEXT do { \
+	if (run == NULL) \
+		return; \
+	int next = block_advance(emu, run); \
+	if (next < 0) \
+		return; \
+	opcode = next; \
+	DISPATCH_NEXT; \
+} while (0)
+
+
+static void dispatch(Emulator* emu, uint8_t opcode, BlockRun *run) {
+#ifdef THREADED_DISPATCH
+	static const void *const table[256] = {
+		OP_ROW(0x0) OP_ROW(0x1) OP_ROW(0x2) OP_ROW(0x3)
+		OP_ROW(0x4) OP_ROW(0x5) OP_ROW(0x6) OP_ROW(0x7)
+		OP_ROW(0x8) OP_ROW(0x9) OP_ROW(0xA) OP_ROW(0xB)
+		OP_ROW(0xC) OP_ROW(0xD) OP_ROW(0xE) OP_ROW(0xF)
+	};
+#else
+dispatch:
+#endif
+	DISPATCH(table, opcode) {
+	OP(0x00): LEN(1); CYCLE(4); NEXT; // NOP
+	OP(0x10): // STOP
 		LEN(2); CYCLE(4); 
 		emu->cpu.is_stopped = true; 
 		timer_div_reset(emu);
-	break;
-	case 0x76: // HALT
+	NEXT;
+	OP(0x76): // HALT
 		LEN(1); CYCLE(4);
 		if (!emu->interrupt.ime && interrupt_pending(emu) != 0) {
 			emu->cpu.is_halt_bugged = true;
 		} else {
 			emu->cpu.is_halted = true;
 		}
-	break;
-	case 0xF3: LEN(1); CYCLE(4); emu->interrupt.ime = false; break; // DI
-	case 0xFB: LEN(1); CYCLE(4); emu->cpu.ime_scheduled = true; break; // EI
-	case 0xCB: prefix_opcodes(emu); break;
+	NEXT;
+	OP(0xF3): LEN(1); CYCLE(4); emu->interrupt.ime = false; NEXT; // DI
+	OP(0xFB): LEN(1); CYCLE(4); emu->cpu.ime_scheduled = true; NEXT; // EI
+	OP(0xCB): prefix_opcodes(emu); NEXT;
 
 	// ===========================
 	// ========== STACK ==========
@@ -46,227 +219,227 @@ void opcode_execute(Emulator* emu, uint8_t opcode) {
 	
 	#define POP(TARGET, ...) \
 		LEN(1); CYCLE(12); emu->cpu.TARGET = memory_read_16(emu, emu->cpu.sp); \
-		emu->cpu.sp += 2; __VA_ARGS__; break
+		emu->cpu.sp += 2; __VA_ARGS__; NEXT
 
 	#define PUSH(SOURCE) \
 		LEN(1); CYCLE(16); emu->cpu.sp -= 2; \
 		memory_write_16(emu, emu->cpu.sp, emu->cpu.SOURCE); \
-		break
+		NEXT
 	
-	case 0xC1: POP(bc);
-	case 0xD1: POP(de);
-	case 0xE1: POP(hl);
-	case 0xF1: POP(af, MASK_FLAG);
+	OP(0xC1): POP(bc);
+	OP(0xD1): POP(de);
+	OP(0xE1): POP(hl);
+	OP(0xF1): POP(af, MASK_FLAG);
 
-	case 0xC5: PUSH(bc);
-	case 0xD5: PUSH(de);
-	case 0xE5: PUSH(hl);
-	case 0xF5: PUSH(af);
+	OP(0xC5): PUSH(bc);
+	OP(0xD5): PUSH(de);
+	OP(0xE5): PUSH(hl);
+	OP(0xF5): SYNC_FLAGS; PUSH(af);
 
 	// ========================
 	// ========== LD16 ==========
 	// ========================
 		
 	#define LD16_d16(TARGET) \
-		LEN(3); CYCLE(12); emu->cpu.TARGET = memory_read_16(emu, emu->cpu.pc + 1); \
-		break
+		LEN(3); CYCLE(12); emu->cpu.TARGET = OPERAND16; \
+		NEXT
 	// LD16
-	case 0x01: LD16_d16(bc);
-	case 0x11: LD16_d16(de);
-	case 0x21: LD16_d16(hl);
-	case 0x31: LD16_d16(sp);
-	case 0x08: // LD (a16), SP
+	OP(0x01): LD16_d16(bc);
+	OP(0x11): LD16_d16(de);
+	OP(0x21): LD16_d16(hl);
+	OP(0x31): LD16_d16(sp);
+	OP(0x08): // LD (a16), SP
 		LEN(3); CYCLE(20);
-		memory_write_16(emu, memory_read_16(emu, emu->cpu.pc + 1), emu->cpu.sp);
-		break;
-	case 0xF8: { // LD HL, SP+r8
+		memory_write_16(emu, OPERAND16, emu->cpu.sp);
+		NEXT;
+	OP(0xF8): { // LD HL, SP+r8
 		LEN(2); CYCLE(12);
-		int8_t offset = (int8_t)memory_read(emu, emu->cpu.pc + 1);
+		int8_t offset = (int8_t)OPERAND8;
 		uint8_t uoffset = (uint8_t)offset;
 		uint8_t sp_low = emu->cpu.sp & 0xFF;
 		bool hc = (sp_low & 0xF) + (uoffset & 0xF) > 0xF;
 		bool c = (sp_low + uoffset) > 0xFF;
 		SET_FLAG(0, 0, hc, c);
 		emu->cpu.hl = emu->cpu.sp + offset;
-	} break;
-	case 0xF9: // LD SP, HL
+	} NEXT;
+	OP(0xF9): // LD SP, HL
 		LEN(1); CYCLE(8);
 		emu->cpu.sp = emu->cpu.hl;
-		break;
+		NEXT;
 	
 	// ========================
 	// ========== LD ==========
 	// ========================
 
-	case 0xE0: { // LDH (a8), A
+	OP(0xE0): { // LDH (a8), A
 		LEN(2); CYCLE(12);
-		uint16_t address = 0xFF00 + (uint16_t)memory_read(emu, emu->cpu.pc + 1);
+		uint16_t address = 0xFF00 + (uint16_t)OPERAND8;
 		memory_write(emu, address, emu->cpu.a);
-	} break;
-	case 0xF0: { // LDH A, (a8)
+	} NEXT;
+	OP(0xF0): { // LDH A, (a8)
 		LEN(2); CYCLE(12);
-		uint16_t address = 0xFF00 + (uint16_t)memory_read(emu, emu->cpu.pc + 1);
+		uint16_t address = 0xFF00 + (uint16_t)OPERAND8;
 		emu->cpu.a = memory_read(emu, address);
-	} break;
-	case 0xE2: { // LD (C), A
+	} NEXT;
+	OP(0xE2): { // LD (C), A
 		LEN(1); CYCLE(8);
 		uint16_t address = 0xFF00 + emu->cpu.c;
 		memory_write(emu, address, emu->cpu.a);
-	} break;
-	case 0xF2: { // LD A, (C)
+	} NEXT;
+	OP(0xF2): { // LD A, (C)
 		LEN(1); CYCLE(8);
 		uint16_t address = 0xFF00 + emu->cpu.c;
 		emu->cpu.a = memory_read(emu, address);
-	} break;
-	case 0xEA: { // LD (a16), A
+	} NEXT;
+	OP(0xEA): { // LD (a16), A
 		LEN(3); CYCLE(16);
-		uint16_t address = memory_read_16(emu, emu->cpu.pc + 1);
+		uint16_t address = OPERAND16;
 		memory_write(emu, address, emu->cpu.a);
-	} break;
-	case 0xFA: { // LD A, (a16)
+	} NEXT;
+	OP(0xFA): { // LD A, (a16)
 		LEN(3); CYCLE(16);
-		uint16_t address = memory_read_16(emu, emu->cpu.pc + 1);
+		uint16_t address = OPERAND16;
 		emu->cpu.a = memory_read(emu, address);
-	} break;
-	case 0x02: // LD (BC), A
+	} NEXT;
+	OP(0x02): // LD (BC), A
 		LEN(1); CYCLE(8);
 		memory_write(emu, emu->cpu.bc, emu->cpu.a);
-		break;
-	case 0x12: // LD (DE), A
+		NEXT;
+	OP(0x12): // LD (DE), A
 		LEN(1); CYCLE(8);
 		memory_write(emu, emu->cpu.de, emu->cpu.a);
-		break;
-	case 0x0A: // LD A, (BC)
+		NEXT;
+	OP(0x0A): // LD A, (BC)
 		LEN(1); CYCLE(8);
 		emu->cpu.a = memory_read(emu, emu->cpu.bc);
-		break;
-	case 0x1A: // LD A, (DE)
+		NEXT;
+	OP(0x1A): // LD A, (DE)
 		LEN(1); CYCLE(8);
 		emu->cpu.a = memory_read(emu, emu->cpu.de);
-		break;
-	case 0x22: // LD (HL+), A
+		NEXT;
+	OP(0x22): // LD (HL+), A
 		LEN(1); CYCLE(8);
 		memory_write(emu, emu->cpu.hl, emu->cpu.a);
 		emu->cpu.hl++;
-		break;
-	case 0x32: // LD (HL-), A
+		NEXT;
+	OP(0x32): // LD (HL-), A
 		LEN(1); CYCLE(8);
 		memory_write(emu, emu->cpu.hl, emu->cpu.a);
 		emu->cpu.hl--;
-		break;
-	case 0x2A: // LD A, (HL+)
+		NEXT;
+	OP(0x2A): // LD A, (HL+)
 		LEN(1); CYCLE(8);
 		emu->cpu.a = memory_read(emu, emu->cpu.hl);
 		emu->cpu.hl++;
-		break;
-	case 0x3A: // LD A, (HL-)
+		NEXT;
+	OP(0x3A): // LD A, (HL-)
 		LEN(1); CYCLE(8);
 		emu->cpu.a = memory_read(emu, emu->cpu.hl);
 		emu->cpu.hl--;
-		break;
+		NEXT;
 
 
 	#define LDd8(TARGET) \
-		LEN(2); CYCLE(8); emu->cpu.TARGET = memory_read(emu, emu->cpu.pc + 1); \
-		break
+		LEN(2); CYCLE(8); emu->cpu.TARGET = OPERAND8; \
+		NEXT
 
 	// LD r, d8
-	case 0x06: LDd8(b);
-	case 0x16: LDd8(d);
-	case 0x26: LDd8(h);
-	case 0x36: // LD (HL), d8;
+	OP(0x06): LDd8(b);
+	OP(0x16): LDd8(d);
+	OP(0x26): LDd8(h);
+	OP(0x36): // LD (HL), d8;
 		LEN(2); CYCLE(12);
-		memory_write(emu, emu->cpu.hl, memory_read(emu, emu->cpu.pc + 1));
-		break;
-	case 0x0E: LDd8(c);
-	case 0x1E: LDd8(e);
-	case 0x2E: LDd8(l);
-	case 0x3E: LDd8(a);
+		memory_write(emu, emu->cpu.hl, OPERAND8);
+		NEXT;
+	OP(0x0E): LDd8(c);
+	OP(0x1E): LDd8(e);
+	OP(0x2E): LDd8(l);
+	OP(0x3E): LDd8(a);
 
 
 	#define LD(TARGET, SOURCE) \
 		LEN(1); CYCLE(4); emu->cpu.TARGET = emu->cpu.SOURCE;\
-		break
+		NEXT
 
 	#define LD_r_HL(TARGET) \
 		LEN(1); CYCLE(8); emu->cpu.TARGET = memory_read(emu, emu->cpu.hl); \
-		break
+		NEXT
 
 	#define LD_HL_r(SOURCE) \
 		LEN(1); CYCLE(8); memory_write(emu, emu->cpu.hl, emu->cpu.SOURCE); \
-		break
+		NEXT
 	
 	// LD r,r
-	case 0x40: LD(b, b);
-	case 0x41: LD(b, c);
-	case 0x42: LD(b, d);
-	case 0x43: LD(b, e);
-	case 0x44: LD(b, h);
-	case 0x45: LD(b, l);
-	case 0x46: LD_r_HL(b);
-	case 0x47: LD(b, a);
-
-	case 0x48: LD(c, b);
-	case 0x49: LD(c, c);
-	case 0x4A: LD(c, d);
-	case 0x4B: LD(c, e);
-	case 0x4C: LD(c, h);
-	case 0x4D: LD(c, l);
-	case 0x4E: LD_r_HL(c);
-	case 0x4F: LD(c, a);
-
-	case 0x50: LD(d, b);
-	case 0x51: LD(d, c);
-	case 0x52: LD(d, d);
-	case 0x53: LD(d, e);
-	case 0x54: LD(d, h);
-	case 0x55: LD(d, l);
-	case 0x56: LD_r_HL(d);
-	case 0x57: LD(d, a);
-
-	case 0x58: LD(e, b);
-	case 0x59: LD(e, c);
-	case 0x5A: LD(e, d);
-	case 0x5B: LD(e, e);
-	case 0x5C: LD(e, h);
-	case 0x5D: LD(e, l);
-	case 0x5E: LD_r_HL(e);
-	case 0x5F: LD(e, a);
-
-	case 0x60: LD(h, b);
-	case 0x61: LD(h, c);
-	case 0x62: LD(h, d);
-	case 0x63: LD(h, e);
-	case 0x64: LD(h, h);
-	case 0x65: LD(h, l);
-	case 0x66: LD_r_HL(h);
-	case 0x67: LD(h, a);
-
-	case 0x68: LD(l, b);
-	case 0x69: LD(l, c);
-	case 0x6A: LD(l, d);
-	case 0x6B: LD(l, e);
-	case 0x6C: LD(l, h);
-	case 0x6D: LD(l, l);
-	case 0x6E: LD_r_HL(l);
-	case 0x6F: LD(l, a);
-
-	case 0x70: LD_HL_r(b);
-	case 0x71: LD_HL_r(c);
-	case 0x72: LD_HL_r(d);
-	case 0x73: LD_HL_r(e);
-	case 0x74: LD_HL_r(h);
-	case 0x75: LD_HL_r(l);
-	case 0x77: LD_HL_r(a);
-
-	case 0x78: LD(a, b);
-	case 0x79: LD(a, c);
-	case 0x7A: LD(a, d);
-	case 0x7B: LD(a, e);
-	case 0x7C: LD(a, h);
-	case 0x7D: LD(a, l);
-	case 0x7E: LD_r_HL(a);
-	case 0x7F: LD(a, a);
+	OP(0x40): LD(b, b);
+	OP(0x41): LD(b, c);
+	OP(0x42): LD(b, d);
+	OP(0x43): LD(b, e);
+	OP(0x44): LD(b, h);
+	OP(0x45): LD(b, l);
+	OP(0x46): LD_r_HL(b);
+	OP(0x47): LD(b, a);
+
+	OP(0x48): LD(c, b);
+	OP(0x49): LD(c, c);
+	OP(0x4A): LD(c, d);
+	OP(0x4B): LD(c, e);
+	OP(0x4C): LD(c, h);
+	OP(0x4D): LD(c, l);
+	OP(0x4E): LD_r_HL(c);
+	OP(0x4F): LD(c, a);
+
+	OP(0x50): LD(d, b);
+	OP(0x51): LD(d, c);
+	OP(0x52): LD(d, d);
+	OP(0x53): LD(d, e);
+	OP(0x54): LD(d, h);
+	OP(0x55): LD(d, l);
+	OP(0x56): LD_r_HL(d);
+	OP(0x57): LD(d, a);
+
+	OP(0x58): LD(e, b);
+	OP(0x59): LD(e, c);
+	OP(0x5A): LD(e, d);
+	OP(0x5B): LD(e, e);
+	OP(0x5C): LD(e, h);
+	OP(0x5D): LD(e, l);
+	OP(0x5E): LD_r_HL(e);
+	OP(0x5F): LD(e, a);
+
+	OP(0x60): LD(h, b);
+	OP(0x61): LD(h, c);
+	OP(0x62): LD(h, d);
+	OP(0x63): LD(h, e);
+	OP(0x64): LD(h, h);
+	OP(0x65): LD(h, l);
+	OP(0x66): LD_r_HL(h);
+	OP(0x67): LD(h, a);
+
+	OP(0x68): LD(l, b);
+	OP(0x69): LD(l, c);
+	OP(0x6A): LD(l, d);
+	OP(0x6B): LD(l, e);
+	OP(0x6C): LD(l, h);
+	OP(0x6D): LD(l, l);
+	OP(0x6E): LD_r_HL(l);
+	OP(0x6F): LD(l, a);
+
+	OP(0x70): LD_HL_r(b);
+	OP(0x71): LD_HL_r(c);
+	OP(0x72): LD_HL_r(d);
+	OP(0x73): LD_HL_r(e);
+	OP(0x74): LD_HL_r(h);
+	OP(0x75): LD_HL_r(l);
+	OP(0x77): LD_HL_r(a);
+
+	OP(0x78): LD(a, b);
+	OP(0x79): LD(a, c);
+	OP(0x7A): LD(a, d);
+	OP(0x7B): LD(a, e);
+	OP(0x7C): LD(a, h);
+	OP(0x7D): LD(a, l);
+	OP(0x7E): LD_r_HL(a);
+	OP(0x7F): LD(a, a);
 	
 	// ===========================
 	// ========== ARITH ==========
@@ -274,189 +447,186 @@ void opcode_execute(Emulator* emu, uint8_t opcode) {
 
 	#define exec_add(value) \
 		uint8_t rhs = (value); \
-		uint16_t result = (uint16_t)emu->cpu.a + (uint16_t)rhs; \
-		bool hc = ((emu->cpu.a & 0xF) + (rhs & 0xF)) > 0xF; \
-		SET_FLAG(result == 0, 0, hc, result > 0xFF); \
-		emu->cpu.a = (uint8_t)result
+		uint8_t result = emu->cpu.a + rhs; \
+		ALU_FLAGS(FLAGS_ADD, emu->cpu.a, rhs, 0, result); \
+		emu->cpu.a = result
 
 	#define exec_adc(value) \
 		uint8_t rhs = (value); \
-		uint16_t result = (uint16_t)emu->cpu.a + (uint16_t)rhs + FLAG_C; \
-		bool hc = ((emu->cpu.a & 0xF) + (rhs & 0xF) + FLAG_C) > 0xF; \
-		SET_FLAG(result == 0, 0, hc, result > 0xFF); \
-		emu->cpu.a = (uint8_t)result
-
-	#define ADD(SOURCE) { LEN(1); CYCLE(4); exec_add(emu->cpu.SOURCE); } break
-	#define ADC(SOURCE) { LEN(1); CYCLE(4); exec_adc(emu->cpu.SOURCE); } break
-
-	case 0x80: ADD(b);
-	case 0x81: ADD(c);
-	case 0x82: ADD(d);
-	case 0x83: ADD(e);
-	case 0x84: ADD(h);
-	case 0x85: ADD(l);
-	case 0x86: { // ADD A, (HL)
+		uint8_t carry = FLAG_C; \
+		uint8_t result = emu->cpu.a + rhs + carry; \
+		ALU_FLAGS(FLAGS_ADD, emu->cpu.a, rhs, carry, result); \
+		emu->cpu.a = result
+
+	#define ADD(SOURCE) { LEN(1); CYCLE(4); exec_add(emu->cpu.SOURCE); } NEXT
+	#define ADC(SOURCE) { LEN(1); CYCLE(4); exec_adc(emu->cpu.SOURCE); } NEXT
+
+	OP(0x80): ADD(b);
+	OP(0x81): ADD(c);
+	OP(0x82): ADD(d);
+	OP(0x83): ADD(e);
+	OP(0x84): ADD(h);
+	OP(0x85): ADD(l);
+	OP(0x86): { // ADD A, (HL)
 		LEN(1); CYCLE(8);
 		exec_add(memory_read(emu, emu->cpu.hl));
-	} break;
-	case 0x87: ADD(a);
-
-	case 0x88: ADC(b);
-	case 0x89: ADC(c);
-	case 0x8A: ADC(d);
-	case 0x8B: ADC(e);
-	case 0x8C: ADC(h);
-	case 0x8D: ADC(l);
-	case 0x8E: { // ADC A, (HL)
+	} NEXT;
+	OP(0x87): ADD(a);
+
+	OP(0x88): ADC(b);
+	OP(0x89): ADC(c);
+	OP(0x8A): ADC(d);
+	OP(0x8B): ADC(e);
+	OP(0x8C): ADC(h);
+	OP(0x8D): ADC(l);
+	OP(0x8E): { // ADC A, (HL)
 		LEN(1); CYCLE(8);
 		exec_adc(memory_read(emu, emu->cpu.hl));
-	} break;
-	case 0x8F: ADC(a);
+	} NEXT;
+	OP(0x8F): ADC(a);
 
 	#define exec_sub(value) \
 		uint8_t rhs = (value); \
 		uint8_t result = emu->cpu.a - rhs; \
-		bool hc = (emu->cpu.a & 0xF) < (rhs & 0xF); \
-		SET_FLAG(result == 0, 1, hc, emu->cpu.a < rhs); \
+		ALU_FLAGS(FLAGS_SUB, emu->cpu.a, rhs, 0, result); \
 		emu->cpu.a = result
 
 	#define exec_sbc(value) \
 		uint8_t rhs = (value); \
-		uint8_t result = emu->cpu.a - rhs - FLAG_C; \
-		bool hc = (emu->cpu.a & 0xF) < (rhs & 0xF) + FLAG_C; \
-		SET_FLAG(result == 0, 1, hc, (uint16_t)emu->cpu.a < (uint16_t)rhs + FLAG_C); \
+		uint8_t carry = FLAG_C; \
+		uint8_t result = emu->cpu.a - rhs - carry; \
+		ALU_FLAGS(FLAGS_SUB, emu->cpu.a, rhs, carry, result); \
 		emu->cpu.a = result
 
-	#define SUB(SOURCE) { LEN(1); CYCLE(4); exec_sub(emu->cpu.SOURCE); } break
-	#define SBC(SOURCE) { LEN(1); CYCLE(4); exec_sbc(emu->cpu.SOURCE); } break
+	#define SUB(SOURCE) { LEN(1); CYCLE(4); exec_sub(emu->cpu.SOURCE); } NEXT
+	#define SBC(SOURCE) { LEN(1); CYCLE(4); exec_sbc(emu->cpu.SOURCE); } NEXT
 
-	case 0x90: SUB(b);
-	case 0x91: SUB(c);
-	case 0x92: SUB(d);
-	case 0x93: SUB(e);
-	case 0x94: SUB(h);
-	case 0x95: SUB(l);
-	case 0x96: { // SUB (HL)
+	OP(0x90): SUB(b);
+	OP(0x91): SUB(c);
+	OP(0x92): SUB(d);
+	OP(0x93): SUB(e);
+	OP(0x94): SUB(h);
+	OP(0x95): SUB(l);
+	OP(0x96): { // SUB (HL)
 		LEN(1); CYCLE(8);
 		exec_sub(memory_read(emu, emu->cpu.hl));
-	} break;
-	case 0x97: SUB(a);
-
-	case 0x98: SBC(b);
-	case 0x99: SBC(c);
-	case 0x9A: SBC(d);
-	case 0x9B: SBC(e);
-	case 0x9C: SBC(h);
-	case 0x9D: SBC(l);
-	case 0x9E: { // SBC (HL)
+	} NEXT;
+	OP(0x97): SUB(a);
+
+	OP(0x98): SBC(b);
+	OP(0x99): SBC(c);
+	OP(0x9A): SBC(d);
+	OP(0x9B): SBC(e);
+	OP(0x9C): SBC(h);
+	OP(0x9D): SBC(l);
+	OP(0x9E): { // SBC (HL)
 		LEN(1); CYCLE(8);
 		exec_sbc(memory_read(emu, emu->cpu.hl));
-	} break;
-	case 0x9F: SBC(a);
+	} NEXT;
+	OP(0x9F): SBC(a);
 
 	#define exec_and(value) \
 		uint8_t rhs = (value); \
 		emu->cpu.a = emu->cpu.a & rhs; \
-		SET_FLAG(emu->cpu.a == 0, 0, 1, 0)
+		ALU_FLAGS(FLAGS_AND, 0, rhs, 0, emu->cpu.a)
 
 	#define exec_xor(value) \
 		uint8_t rhs = (value); \
 		emu->cpu.a = emu->cpu.a ^ rhs; \
-		SET_FLAG(emu->cpu.a == 0, 0, 0, 0)
+		ALU_FLAGS(FLAGS_OR, 0, rhs, 0, emu->cpu.a)
 
 	#define exec_or(value) \
 		uint8_t rhs = (value); \
 		emu->cpu.a = emu->cpu.a | rhs; \
-		SET_FLAG(emu->cpu.a == 0, 0, 0, 0)
+		ALU_FLAGS(FLAGS_OR, 0, rhs, 0, emu->cpu.a)
 	
-	#define AND(SOURCE) { LEN(1); CYCLE(4); exec_and(emu->cpu.SOURCE); } break
-	#define XOR(SOURCE) { LEN(1); CYCLE(4); exec_xor(emu->cpu.SOURCE); } break
-	#define OR(SOURCE) { LEN(1); CYCLE(4); exec_or(emu->cpu.SOURCE); } break
+	#define AND(SOURCE) { LEN(1); CYCLE(4); exec_and(emu->cpu.SOURCE); } NEXT
+	#define XOR(SOURCE) { LEN(1); CYCLE(4); exec_xor(emu->cpu.SOURCE); } NEXT
+	#define OR(SOURCE) { LEN(1); CYCLE(4); exec_or(emu->cpu.SOURCE); } NEXT
 	
 	#define exec_cp(value) \
 		uint8_t rhs = (value); \
 		uint8_t result = emu->cpu.a - rhs; \
-		bool hc = (emu->cpu.a & 0xF) < (rhs & 0xF); \
-		SET_FLAG(result == 0, 1, hc, emu->cpu.a < rhs)
-
-	#define CP(SOURCE) { LEN(1); CYCLE(4); exec_cp(emu->cpu.SOURCE); } break
-
-	case 0xA0: AND(b);
-	case 0xA1: AND(c);
-	case 0xA2: AND(d);
-	case 0xA3: AND(e);
-	case 0xA4: AND(h);
-	case 0xA5: AND(l);
-	case 0xA6: { // AND (HL)
+		ALU_FLAGS(FLAGS_SUB, emu->cpu.a, rhs, 0, result)
+
+	#define CP(SOURCE) { LEN(1); CYCLE(4); exec_cp(emu->cpu.SOURCE); } NEXT
+
+	OP(0xA0): AND(b);
+	OP(0xA1): AND(c);
+	OP(0xA2): AND(d);
+	OP(0xA3): AND(e);
+	OP(0xA4): AND(h);
+	OP(0xA5): AND(l);
+	OP(0xA6): { // AND (HL)
 		LEN(1); CYCLE(8);
 		exec_and(memory_read(emu, emu->cpu.hl));
-	} break;
-	case 0xA7: AND(a);
-
-	case 0xA8: XOR(b);
-	case 0xA9: XOR(c);
-	case 0xAA: XOR(d);
-	case 0xAB: XOR(e);
-	case 0xAC: XOR(h);
-	case 0xAD: XOR(l);
-	case 0xAE: { // XOR (HL)
+	} NEXT;
+	OP(0xA7): AND(a);
+
+	OP(0xA8): XOR(b);
+	OP(0xA9): XOR(c);
+	OP(0xAA): XOR(d);
+	OP(0xAB): XOR(e);
+	OP(0xAC): XOR(h);
+	OP(0xAD): XOR(l);
+	OP(0xAE): { // XOR (HL)
 		LEN(1); CYCLE(8);
 		exec_xor(memory_read(emu, emu->cpu.hl));
-	} break;
-	case 0xAF: XOR(a);
-
-	case 0xB0: OR(b);
-	case 0xB1: OR(c);
-	case 0xB2: OR(d);
-	case 0xB3: OR(e);
-	case 0xB4: OR(h);
-	case 0xB5: OR(l);
-	case 0xB6: { // OR (HL)
+	} NEXT;
+	OP(0xAF): XOR(a);
+
+	OP(0xB0): OR(b);
+	OP(0xB1): OR(c);
+	OP(0xB2): OR(d);
+	OP(0xB3): OR(e);
+	OP(0xB4): OR(h);
+	OP(0xB5): OR(l);
+	OP(0xB6): { // OR (HL)
 		LEN(1); CYCLE(8);
 		exec_or(memory_read(emu, emu->cpu.hl));
-	} break;
-	case 0xB7: OR(a);
-
-	case 0xB8: CP(b);
-	case 0xB9: CP(c);
-	case 0xBA: CP(d);
-	case 0xBB: CP(e);
-	case 0xBC: CP(h);
-	case 0xBD: CP(l);
-	case 0xBE: { // CP (HL)
+	} NEXT;
+	OP(0xB7): OR(a);
+
+	OP(0xB8): CP(b);
+	OP(0xB9): CP(c);
+	OP(0xBA): CP(d);
+	OP(0xBB): CP(e);
+	OP(0xBC): CP(h);
+	OP(0xBD): CP(l);
+	OP(0xBE): { // CP (HL)
 		LEN(1); CYCLE(8);
 		exec_cp(memory_read(emu, emu->cpu.hl));
-	} break;
-	case 0xBF: CP(a);
+	} NEXT;
+	OP(0xBF): CP(a);
 	
-	case 0xC6: { // ADD A, d8
+	OP(0xC6): { // ADD A, d8
 		LEN(2); CYCLE(8);
-		exec_add(memory_read(emu, emu->cpu.pc + 1)); 
-	} break;
-	case 0xD6: { // SUB A, d8
-		LEN(2); CYCLE(8); exec_sub(memory_read(emu, emu->cpu.pc + 1));
-	} break;
-	case 0xE6: { // AND A, d8
-		LEN(2); CYCLE(8); exec_and(memory_read(emu, emu->cpu.pc + 1));
-	} break;
-	case 0xF6: { // OR A, d8
-		LEN(2); CYCLE(8); exec_or(memory_read(emu, emu->cpu.pc + 1));
-	} break;
-
-	case 0xCE: { // ADC A, d8
-		LEN(2); CYCLE(8); exec_adc(memory_read(emu, emu->cpu.pc + 1));
-	} break;
-	case 0xDE: { // SBC A, d8
-		LEN(2); CYCLE(8); exec_sbc(memory_read(emu, emu->cpu.pc + 1));
-	} break;
-	case 0xEE: { // XOR A, d8
-		LEN(2); CYCLE(8); exec_xor(memory_read(emu, emu->cpu.pc + 1));
-	} break;
-	case 0xFE: { // CP A, d8
-		LEN(2); CYCLE(8); exec_cp(memory_read(emu, emu->cpu.pc + 1));
-	} break;
+		exec_add(OPERAND8); 
+	} NEXT;
+	OP(0xD6): { // SUB A, d8
+		LEN(2); CYCLE(8); exec_sub(OPERAND8);
+	} NEXT;
+	OP(0xE6): { // AND A, d8
+		LEN(2); CYCLE(8); exec_and(OPERAND8);
+	} NEXT;
+	OP(0xF6): { // OR A, d8
+		LEN(2); CYCLE(8); exec_or(OPERAND8);
+	} NEXT;
+
+	OP(0xCE): { // ADC A, d8
+		LEN(2); CYCLE(8); exec_adc(OPERAND8);
+	} NEXT;
+	OP(0xDE): { // SBC A, d8
+		LEN(2); CYCLE(8); exec_sbc(OPERAND8);
+	} NEXT;
+	OP(0xEE): { // XOR A, d8
+		LEN(2); CYCLE(8); exec_xor(OPERAND8);
+	} NEXT;
+	OP(0xFE): { // CP A, d8
+		LEN(2); CYCLE(8); exec_cp(OPERAND8);
+	} NEXT;
 	
-	case 0x27: { // DAA
+	OP(0x27): { // DAA
 		LEN(1); CYCLE(4);
 		bool carry = FLAG_C;
 		uint8_t a = emu->cpu.a;
@@ -469,68 +639,67 @@ void opcode_execute(Emulator* emu, uint8_t opcode) {
 		}
 		emu->cpu.a = a;
 		SET_FLAG(emu->cpu.a == 0, FLAG_N, 0, carry);
-	} break;
-	case 0x37: // SCF
+	} NEXT;
+	OP(0x37): // SCF
 		LEN(1); CYCLE(4);
 		SET_FLAG(FLAG_Z, 0, 0, 1);
-		break;
-	case 0x2F: // CPL
+		NEXT;
+	OP(0x2F): // CPL
 		LEN(1); CYCLE(4); 
 		emu->cpu.a ^= 0xFF; 
 		SET_FLAG(FLAG_Z, 1, 1, FLAG_C);
-		break;
-	case 0x3F: // CCF
+		NEXT;
+	OP(0x3F): // CCF
 		LEN(1); CYCLE(4); 
 		SET_FLAG(FLAG_Z, 0, 0, !FLAG_C); 
-		break;
+		NEXT;
 
 	#define exec_inc(value) \
 		uint8_t rhs = (value); \
-		uint16_t result = (uint16_t)rhs + 1; \
-		bool hc = (rhs & 0xF) == 0xF; \
-		SET_FLAG(result == 0, 0, hc, FLAG_C); \
-	
+		uint8_t carry = FLAG_C; \
+		uint8_t result = rhs + 1; \
+		ALU_FLAGS(FLAGS_INC, rhs, 1, carry, result)
 
 	#define exec_dec(value) \
 		uint8_t rhs = (value); \
+		uint8_t carry = FLAG_C; \
 		uint8_t result = rhs - 1; \
-		bool hc = (rhs & 0xF) == 0x00; \
-		SET_FLAG(result == 0, 1, hc, FLAG_C); \
+		ALU_FLAGS(FLAGS_DEC, rhs, 1, carry, result)
 
 	#define INC(SOURCE) { \
 		LEN(1); CYCLE(4); exec_inc(emu->cpu.SOURCE); \
-		emu->cpu.SOURCE = (uint8_t)result; \
-	} break
+		emu->cpu.SOURCE = result; \
+	} NEXT
 	#define DEC(SOURCE) { \
 		LEN(1); CYCLE(4); exec_dec(emu->cpu.SOURCE); \
 		emu->cpu.SOURCE = result; \
-	} break
+	} NEXT
 
-	case 0x04: INC(b);
-	case 0x14: INC(d);
-	case 0x24: INC(h);
-	case 0x34: {
+	OP(0x04): INC(b);
+	OP(0x14): INC(d);
+	OP(0x24): INC(h);
+	OP(0x34): {
 		LEN(1); CYCLE(12);
 		exec_inc(memory_read(emu, emu->cpu.hl));
 		memory_write(emu, emu->cpu.hl, result);
-	} break;
-	case 0x0C: INC(c);
-	case 0x1C: INC(e);
-	case 0x2C: INC(l);
-	case 0x3C: INC(a);
-
-	case 0x05: DEC(b);
-	case 0x15: DEC(d);
-	case 0x25: DEC(h);
-	case 0x35: {
+	} NEXT;
+	OP(0x0C): INC(c);
+	OP(0x1C): INC(e);
+	OP(0x2C): INC(l);
+	OP(0x3C): INC(a);
+
+	OP(0x05): DEC(b);
+	OP(0x15): DEC(d);
+	OP(0x25): DEC(h);
+	OP(0x35): {
 		LEN(1); CYCLE(12);
 		exec_dec(memory_read(emu, emu->cpu.hl));
 		memory_write(emu, emu->cpu.hl, result);
-	} break;
-	case 0x0D: DEC(c);
-	case 0x1D: DEC(e);
-	case 0x2D: DEC(l);
-	case 0x3D: DEC(a);
+	} NEXT;
+	OP(0x0D): DEC(c);
+	OP(0x1D): DEC(e);
+	OP(0x2D): DEC(l);
+	OP(0x3D): DEC(a);
 
 
 	// =============================
@@ -538,8 +707,8 @@ void opcode_execute(Emulator* emu, uint8_t opcode) {
 	// =============================
 
 
-	#define INC16(TARGET) LEN(1); CYCLE(8); emu->cpu.TARGET += 1; break;
-	#define DEC16(TARGET) LEN(1); CYCLE(8); emu->cpu.TARGET -= 1; break;
+	#define INC16(TARGET) LEN(1); CYCLE(8); emu->cpu.TARGET += 1; NEXT;
+	#define DEC16(TARGET) LEN(1); CYCLE(8); emu->cpu.TARGET -= 1; NEXT;
 	#define ADD16(TARGET) { \
 		LEN(1); CYCLE(8); \
 		uint16_t rhs = (emu->cpu.TARGET); \
@@ -547,32 +716,32 @@ void opcode_execute(Emulator* emu, uint8_t opcode) {
 		bool hc = ((emu->cpu.hl & 0x0FFF) + (rhs & 0x0FFF)) > 0x0FFF; \
 		SET_FLAG(FLAG_Z, 0, hc, result > 0xFFFF); \
 		emu->cpu.hl = (uint16_t)result; \
-	} break
-
-	case 0x03: INC16(bc);
-	case 0x13: INC16(de);
-	case 0x23: INC16(hl);
-	case 0x33: INC16(sp);
-	case 0x0B: DEC16(bc);
-	case 0x1B: DEC16(de);
-	case 0x2B: DEC16(hl);
-	case 0x3B: DEC16(sp);
-
-	case 0x09: ADD16(bc);
-	case 0x19: ADD16(de);
-	case 0x29: ADD16(hl);
-	case 0x39: ADD16(sp);
-
-	case 0xE8: { // SP, r8;
+	} NEXT
+
+	OP(0x03): INC16(bc);
+	OP(0x13): INC16(de);
+	OP(0x23): INC16(hl);
+	OP(0x33): INC16(sp);
+	OP(0x0B): DEC16(bc);
+	OP(0x1B): DEC16(de);
+	OP(0x2B): DEC16(hl);
+	OP(0x3B): DEC16(sp);
+
+	OP(0x09): ADD16(bc);
+	OP(0x19): ADD16(de);
+	OP(0x29): ADD16(hl);
+	OP(0x39): ADD16(sp);
+
+	OP(0xE8): { // SP, r8;
 		LEN(2); CYCLE(16);
-		int8_t offset = (int8_t)memory_read(emu, emu->cpu.pc + 1);
+		int8_t offset = (int8_t)OPERAND8;
 		uint8_t uoffset = (uint8_t)offset;
 		uint8_t sp_low = emu->cpu.sp & 0xFF;
 		bool hc = (sp_low & 0xF) + (uoffset & 0xF) > 0xF;
 		bool c = (sp_low + uoffset) > 0xFF;
 		SET_FLAG(0, 0, hc, c);
 		emu->cpu.sp = emu->cpu.sp + offset;
-	} break;
+	} NEXT;
 
 
 	// =============================
@@ -583,16 +752,16 @@ void opcode_execute(Emulator* emu, uint8_t opcode) {
 		LEN(2); \
 		if (flag) { \
 			CYCLE(12); \
-			int8_t offset = (int8_t)memory_read(emu, emu->cpu.pc + 1); \
+			int8_t offset = (int8_t)OPERAND8; \
 			emu->cpu.pc += offset; \
 		}  else { CYCLE(8); } \
-	} break
+	} NEXT
 
-	case 0x20: JR(!FLAG_Z); // JR NZ, r8
-	case 0x30: JR(!FLAG_C); // JR NC, r8
-	case 0x18: JR(true); // JR r8
-	case 0x28: JR(FLAG_Z); // JR Z, r8
-	case 0x38: JR(FLAG_C); // JR C, r8
+	OP(0x20): JR(!FLAG_Z); // JR NZ, r8
+	OP(0x30): JR(!FLAG_C); // JR NC, r8
+	OP(0x18): JR(true); // JR r8
+	OP(0x28): JR(FLAG_Z); // JR Z, r8
+	OP(0x38): JR(FLAG_C); // JR C, r8
 	
 	#define do_return() \
 		emu->cpu.pc = memory_read_16(emu, emu->cpu.sp); \
@@ -601,112 +770,125 @@ void opcode_execute(Emulator* emu, uint8_t opcode) {
 	#define RET(flag) { \
 		if (flag) { LEN(0); CYCLE(20); do_return(); } \
 		else      { LEN(1); CYCLE(8); } \
-	} break
-	case 0xC0: RET(!FLAG_Z); // RET NZ
-	case 0xD0: RET(!FLAG_C); // RET NC
-	case 0xC8: RET(FLAG_Z); // RET Z
-	case 0xD8: RET(FLAG_C); // RET C
-	case 0xC9: { LEN(0); CYCLE(8); do_return(); } break; // RET
-	case 0xD9: { // RETI
+	} NEXT
+	OP(0xC0): RET(!FLAG_Z); // RET NZ
+	OP(0xD0): RET(!FLAG_C); // RET NC
+	OP(0xC8): RET(FLAG_Z); // RET Z
+	OP(0xD8): RET(FLAG_C); // RET C
+	OP(0xC9): { LEN(0); CYCLE(8); do_return(); } NEXT; // RET
+	OP(0xD9): { // RETI
 		LEN(0); CYCLE(16);
 		do_return();
 		emu->interrupt.ime = true;
-	} break;
+	} NEXT;
 	
 	#define do_jump(target) emu->cpu.pc = (target)
 	#define JP(flag) { \
-		if (flag) { CYCLE(16); LEN(0); do_jump(memory_read_16(emu, emu->cpu.pc + 1)); } \
+		if (flag) { CYCLE(16); LEN(0); do_jump(OPERAND16); } \
 			else {CYCLE(12); LEN(3); } \
-	} break
-
-	case 0xC2: JP(!FLAG_Z); // JP NZ, a16
-	case 0xD2: JP(!FLAG_C); // JP NC, a16
-	case 0xCA: JP(FLAG_Z); // JP Z, a16
-	case 0xDA: JP(FLAG_C); // JP C, a16
-	case 0xC3: JP(true);
-	case 0xE9: {
+	} NEXT
+
+	OP(0xC2): JP(!FLAG_Z); // JP NZ, a16
+	OP(0xD2): JP(!FLAG_C); // JP NC, a16
+	OP(0xCA): JP(FLAG_Z); // JP Z, a16
+	OP(0xDA): JP(FLAG_C); // JP C, a16
+	OP(0xC3): JP(true);
+	OP(0xE9): {
 		LEN(0); CYCLE(4); do_jump(emu->cpu.hl);
-	} break; // JP (HL)
+	} NEXT; // JP (HL)
 
 	#define do_call() \
 		emu->cpu.sp -= 2; \
 		memory_write_16(emu, emu->cpu.sp, emu->cpu.pc + 3); \
-		emu->cpu.pc = memory_read_16(emu, emu->cpu.pc + 1)
+		emu->cpu.pc = OPERAND16
 
 	#define CALL(flag) { \
 		if (flag) { CYCLE(24); LEN(0); do_call(); \
 		} else { CYCLE(12); LEN(3); } \
-	} break
+	} NEXT
 
-	case 0xC4: CALL(!FLAG_Z); // CALL NZ, a16
-	case 0xD4: CALL(!FLAG_C); // CALL NC, a16
-	case 0xCC: CALL(FLAG_Z); // CALL Z, a16
-	case 0xDC: CALL(FLAG_C); // CALL C, a16
-	case 0xCD: CALL(true); // CALL a16
+	OP(0xC4): CALL(!FLAG_Z); // CALL NZ, a16
+	OP(0xD4): CALL(!FLAG_C); // CALL NC, a16
+	OP(0xCC): CALL(FLAG_Z); // CALL Z, a16
+	OP(0xDC): CALL(FLAG_C); // CALL C, a16
+	OP(0xCD): CALL(true); // CALL a16
 	
 	#define RST(target) { \
 		LEN(0); CYCLE(16); \
 		emu->cpu.sp -= 2; \
 		memory_write_16(emu, emu->cpu.sp, emu->cpu.pc + 1); \
 		emu->cpu.pc = target; \
-	} break
+	} NEXT
 	
-	case 0xC7: RST(0x00); // RST 00H
-	case 0xD7: RST(0x10); // RST 10H
-	case 0xE7: RST(0x20); // RST 20H
-	case 0xF7: RST(0x30); // RST 30H
-	case 0xCF: RST(0x08); // RST 08H
-	case 0xDF: RST(0x18); // RST 18H
-	case 0xEF: RST(0x28); // RST 28H
-	case 0xFF: RST(0x38); // RST 38H
+	OP(0xC7): RST(0x00); // RST 00H
+	OP(0xD7): RST(0x10); // RST 10H
+	OP(0xE7): RST(0x20); // RST 20H
+	OP(0xF7): RST(0x30); // RST 30H
+	OP(0xCF): RST(0x08); // RST 08H
+	OP(0xDF): RST(0x18); // RST 18H
+	OP(0xEF): RST(0x28); // RST 28H
+	OP(0xFF): RST(0x38); // RST 38H
 	
 	// ============================
 	// ========== ROTATE ==========
 	// ============================
 	
-	case 0x07: { // RLCA
+	OP(0x07): { // RLCA
 		LEN(1); CYCLE(4);
 		uint8_t bit = emu->cpu.a >> 7;
 		emu->cpu.a = (emu->cpu.a << 1) | bit;
 		SET_FLAG(0, 0, 0, bit);
-	} break;
-	case 0x17: { // RLA
+	} NEXT;
+	OP(0x17): { // RLA
 		LEN(1); CYCLE(4);
 		uint8_t bit = emu->cpu.a >> 7;
 		emu->cpu.a = (emu->cpu.a << 1) | FLAG_C;
 		SET_FLAG(0, 0, 0, bit);
-	} break;
-	case 0x0F: { // RRCA
+	} NEXT;
+	OP(0x0F): { // RRCA
 		LEN(1); CYCLE(4);
 		uint8_t bit = emu->cpu.a & 0b1;
 		emu->cpu.a = (emu->cpu.a >> 1) | (bit << 7);
 		SET_FLAG(0, 0, 0, bit);
-	} break;
-	case 0x1F: { // RRA
+	} NEXT;
+	OP(0x1F): { // RRA
 		LEN(1); CYCLE(4);
 		uint8_t bit = emu->cpu.a & 0b1;
 		emu->cpu.a = (emu->cpu.a >> 1) | (FLAG_C << 7);
 		SET_FLAG(0, 0, 0, bit);
-	} break;
-
-
-	#define NO_INSTRUCTION LEN(1); CYCLE(4); DEBUG("%02X is an invalid opcode!", opcode); break
-	case 0xD3: NO_INSTRUCTION;
-	case 0xE3: NO_INSTRUCTION;
-	case 0xE4: NO_INSTRUCTION;
-	case 0xF4: NO_INSTRUCTION;
-	case 0xDB: NO_INSTRUCTION;
-	case 0xEB: NO_INSTRUCTION;
-	case 0xEC: NO_INSTRUCTION;
-	case 0xED: NO_INSTRUCTION;
-	case 0xFC: NO_INSTRUCTION;
-	case 0xFD: NO_INSTRUCTION;
-	case 0xDD: NO_INSTRUCTION;
+	} NEXT;
+
+
+	#define NO_INSTRUCTION LEN(1); CYCLE(4); DEBUG("%02X is an invalid opcode!", opcode); NEXT
+	OP(0xD3): NO_INSTRUCTION;
+	OP(0xE3): NO_INSTRUCTION;
+	OP(0xE4): NO_INSTRUCTION;
+	OP(0xF4): NO_INSTRUCTION;
+	OP(0xDB): NO_INSTRUCTION;
+	OP(0xEB): NO_INSTRUCTION;
+	OP(0xEC): NO_INSTRUCTION;
+	OP(0xED): NO_INSTRUCTION;
+	OP(0xFC): NO_INSTRUCTION;
+	OP(0xFD): NO_INSTRUCTION;
+	OP(0xDD): NO_INSTRUCTION;
 	
 
+#ifndef THREADED_DISPATCH
 	default:
 		DEBUG("Not implemented opcode %02X", opcode);
-	}
+		NEXT;
+#endif
+	} DISPATCH_END;
+}
+
+void opcode_execute(Emulator* emu, uint8_t opcode) {
+	dispatch(emu, opcode, NULL);
+}
+
+void opcode_run(Emulator* emu, BlockRun *run) {
+	int opcode = block_fetch(emu, run);
+	if (opcode >= 0)
+		dispatch(emu, opcode, run);
 }
 
 #define HL_OP(METHOD) { \
@@ -724,8 +906,20 @@ void opcode_execute(Emulator* emu, uint8_t opcode) {
 	emu->cpu.TARGET = result; \
 } break
 static inline void prefix_opcodes(Emulator* emu) {
-	uint8_t opcode = memory_read(emu, emu->cpu.pc + 1);
-	switch (opcode) {
+	uint8_t opcode = OPERAND8;
+#ifdef THREADED_DISPATCH
+	static const void *const table[256] = {
+		CB_ROW(0x0) CB_ROW(0x1) CB_ROW(0x2) CB_ROW(0x3)
+		CB_LINE(0x40) CB_LINE(0x48) CB_LINE(0x50) CB_LINE(0x58)
+		CB_LINE(0x60) CB_LINE(0x68) CB_LINE(0x70) CB_LINE(0x78)
+		CB_LINE(0x80) CB_LINE(0x88) CB_LINE(0x90) CB_LINE(0x98)
+		CB_LINE(0xA0) CB_LINE(0xA8) CB_LINE(0xB0) CB_LINE(0xB8)
+		CB_LINE(0xC0) CB_LINE(0xC8) CB_LINE(0xD0) CB_LINE(0xD8)
+		CB_LINE(0xE0) CB_LINE(0xE8) CB_LINE(0xF0) CB_LINE(0xF8)
+	};
+#endif
+
+	DISPATCH(table, opcode) {
 	
 	#define do_rlc() \
 		uint8_t bit = value >> 7; \
@@ -745,41 +939,41 @@ static inline void prefix_opcodes(Emulator* emu) {
 	#define RRC(TARGET) BIT_OP(TARGET, do_rrc)
 	#define RR(TARGET) BIT_OP(TARGET, do_rr)
 
-	case 0x00: RLC(b);
-	case 0x01: RLC(c);
-	case 0x02: RLC(d);
-	case 0x03: RLC(e);
-	case 0x04: RLC(h);
-	case 0x05: RLC(l);
-	case 0x07: RLC(a);
-	case 0x06: HL_OP(do_rlc);
-
-	case 0x08: RRC(b);
-	case 0x09: RRC(c);
-	case 0x0A: RRC(d);
-	case 0x0B: RRC(e);
-	case 0x0C: RRC(h);
-	case 0x0D: RRC(l);
-	case 0x0F: RRC(a);
-	case 0x0E: HL_OP(do_rrc);
+	CB(0x00): RLC(b);
+	CB(0x01): RLC(c);
+	CB(0x02): RLC(d);
+	CB(0x03): RLC(e);
+	CB(0x04): RLC(h);
+	CB(0x05): RLC(l);
+	CB(0x07): RLC(a);
+	CB(0x06): HL_OP(do_rlc);
+
+	CB(0x08): RRC(b);
+	CB(0x09): RRC(c);
+	CB(0x0A): RRC(d);
+	CB(0x0B): RRC(e);
+	CB(0x0C): RRC(h);
+	CB(0x0D): RRC(l);
+	CB(0x0F): RRC(a);
+	CB(0x0E): HL_OP(do_rrc);
 	
-	case 0x10: RL(b);
-	case 0x11: RL(c);
-	case 0x12: RL(d);
-	case 0x13: RL(e);
-	case 0x14: RL(h);
-	case 0x15: RL(l);
-	case 0x17: RL(a);
-	case 0x16: HL_OP(do_rl);
-
-	case 0x18: RR(b);
-	case 0x19: RR(c);
-	case 0x1A: RR(d);
-	case 0x1B: RR(e);
-	case 0x1C: RR(h);
-	case 0x1D: RR(l);
-	case 0x1F: RR(a);
-	case 0x1E: HL_OP(do_rr);
+	CB(0x10): RL(b);
+	CB(0x11): RL(c);
+	CB(0x12): RL(d);
+	CB(0x13): RL(e);
+	CB(0x14): RL(h);
+	CB(0x15): RL(l);
+	CB(0x17): RL(a);
+	CB(0x16): HL_OP(do_rl);
+
+	CB(0x18): RR(b);
+	CB(0x19): RR(c);
+	CB(0x1A): RR(d);
+	CB(0x1B): RR(e);
+	CB(0x1C): RR(h);
+	CB(0x1D): RR(l);
+	CB(0x1F): RR(a);
+	CB(0x1E): HL_OP(do_rr);
 
 	#define do_sla() \
 		uint8_t bit = value >> 7; \
@@ -801,50 +995,50 @@ static inline void prefix_opcodes(Emulator* emu) {
 	#define SRL(TARGET) BIT_OP(TARGET, do_srl)
 	#define SWAP(TARGET) BIT_OP(TARGET, do_swap)
 
-	case 0x20: SLA(b);
-	case 0x21: SLA(c);
-	case 0x22: SLA(d);
-	case 0x23: SLA(e);
-	case 0x24: SLA(h);
-	case 0x25: SLA(l);
-	case 0x27: SLA(a);
-	case 0x26: HL_OP(do_sla);
-	case 0x28: SRA(b);
-	case 0x29: SRA(c);
-	case 0x2A: SRA(d);
-	case 0x2B: SRA(e);
-	case 0x2C: SRA(h);
-	case 0x2D: SRA(l);
-	case 0x2F: SRA(a);
-	case 0x2E: HL_OP(do_sra);
-
-	case 0x30: SWAP(b);
-	case 0x31: SWAP(c);
-	case 0x32: SWAP(d);
-	case 0x33: SWAP(e);
-	case 0x34: SWAP(h);
-	case 0x35: SWAP(l);
-	case 0x37: SWAP(a);
-	case 0x36: HL_OP(do_swap);
-	case 0x38: SRL(b);
-	case 0x39: SRL(c);
-	case 0x3A: SRL(d);
-	case 0x3B: SRL(e);
-	case 0x3C: SRL(h);
-	case 0x3D: SRL(l);
-	case 0x3F: SRL(a);
-	case 0x3E: HL_OP(do_srl);
+	CB(0x20): SLA(b);
+	CB(0x21): SLA(c);
+	CB(0x22): SLA(d);
+	CB(0x23): SLA(e);
+	CB(0x24): SLA(h);
+	CB(0x25): SLA(l);
+	CB(0x27): SLA(a);
+	CB(0x26): HL_OP(do_sla);
+	CB(0x28): SRA(b);
+	CB(0x29): SRA(c);
+	CB(0x2A): SRA(d);
+	CB(0x2B): SRA(e);
+	CB(0x2C): SRA(h);
+	CB(0x2D): SRA(l);
+	CB(0x2F): SRA(a);
+	CB(0x2E): HL_OP(do_sra);
+
+	CB(0x30): SWAP(b);
+	CB(0x31): SWAP(c);
+	CB(0x32): SWAP(d);
+	CB(0x33): SWAP(e);
+	CB(0x34): SWAP(h);
+	CB(0x35): SWAP(l);
+	CB(0x37): SWAP(a);
+	CB(0x36): HL_OP(do_swap);
+	CB(0x38): SRL(b);
+	CB(0x39): SRL(c);
+	CB(0x3A): SRL(d);
+	CB(0x3B): SRL(e);
+	CB(0x3C): SRL(h);
+	CB(0x3D): SRL(l);
+	CB(0x3F): SRL(a);
+	CB(0x3E): HL_OP(do_srl);
 	
 
 	#define LINE(START, OFFSET, REG_METHOD, ADDR_METHOD) \
-		case START + 0: REG_METHOD(OFFSET, b); \
-		case START + 1: REG_METHOD(OFFSET, c); \
-		case START + 2: REG_METHOD(OFFSET, d); \
-		case START + 3: REG_METHOD(OFFSET, e); \
-		case START + 4: REG_METHOD(OFFSET, h); \
-		case START + 5: REG_METHOD(OFFSET, l); \
-		case START + 6: ADDR_METHOD(OFFSET); \
-		case START + 7: REG_METHOD(OFFSET, a)
+		CB_LINE_OP(START, 0): REG_METHOD(OFFSET, b); \
+		CB_LINE_OP(START, 1): REG_METHOD(OFFSET, c); \
+		CB_LINE_OP(START, 2): REG_METHOD(OFFSET, d); \
+		CB_LINE_OP(START, 3): REG_METHOD(OFFSET, e); \
+		CB_LINE_OP(START, 4): REG_METHOD(OFFSET, h); \
+		CB_LINE_OP(START, 5): REG_METHOD(OFFSET, l); \
+		CB_LINE_OP(START, 6): ADDR_METHOD(OFFSET); \
+		CB_LINE_OP(START, 7): REG_METHOD(OFFSET, a)
 
 
 	#define BIT(OFFSET, TARGET) { \
@@ -911,7 +1105,59 @@ static inline void prefix_opcodes(Emulator* emu) {
 	SETS(0xF0, 6);
 	SETS(0xF8, 7);
 
+#ifndef THREADED_DISPATCH
 	default:
 		DEBUG("Not implemented prefix opcode %x", opcode);
+#endif
+	} DISPATCH_END;
+}
+
+
+// NOTE: Byte length of every instruction, including the immediate operands.
+//  The CB prefix is counted as a 2 byte instruction
+static const uint8_t OPCODE_LENGTHS[256] = {
+	1, 3, 1, 1, 1, 1, 2, 1, 3, 1, 1, 1, 1, 1, 2, 1, // 0x00
+	2, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1, // 0x10
+	2, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1, // 0x20
+	2, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1, // 0x30
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x40
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x50
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x60
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x70
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x80
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x90
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0xA0
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0xB0
+	1, 1, 3, 3, 3, 1, 2, 1, 1, 1, 3, 2, 3, 3, 2, 1, // 0xC0
+	1, 1, 3, 1, 3, 1, 2, 1, 1, 1, 3, 1, 3, 1, 2, 1, // 0xD0
+	2, 1, 1, 1, 1, 1, 2, 1, 2, 1, 3, 1, 1, 1, 2, 1, // 0xE0
+	2, 1, 1, 1, 1, 1, 2, 1, 2, 1, 3, 1, 1, 1, 2, 1, // 0xF0
+};
+
+uint8_t opcode_length(uint8_t opcode) {
+	return OPCODE_LENGTHS[opcode];
+}
+
+
+bool opcode_ends_block(uint8_t opcode) {
+	switch (opcode) {
+	case 0x10: case 0x76: // STOP, HALT
+	case 0x18: case 0x20: case 0x28: case 0x30: case 0x38: // JR
+	case 0xC2: case 0xC3: case 0xCA: case 0xD2: case 0xDA: case 0xE9: // JP
+	case 0xC4: case 0xCC: case 0xCD: case 0xD4: case 0xDC: // CALL
+	case 0xC0: case 0xC8: case 0xC9: case 0xD0: case 0xD8: case 0xD9: // RET
+	case 0xC7: case 0xCF: case 0xD7: case 0xDF: case 0xE7: case 0xEF: case 0xF7: case 0xFF: // RST
+		return true;
+	default:
+		return false;
 	}
 }
+
+
+void opcode_sync_flags(Emulator *emu) {
+#ifdef CPU_LAZY_FLAGS
+	flags_sync(emu);
+#else
+	(void)emu;
+#endif
+}
@@ -3,8 +3,10 @@
 #include "emulator.h"
 #include "interrupts.h"
 #include "memory_map.h"
+#include "tile_decode.h"
 #include <assert.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -17,19 +19,41 @@ PPU ppu_create() {
 	PPU ppu = {0};
 	ppu.vram = malloc(sizeof(uint8_t) * VRAM_SIZE);
 	ppu.oam = malloc(sizeof(uint8_t) * OAM_SIZE);
+	ppu.tile_cache = malloc(sizeof(TileCache));
 	for (uint8_t i = 0; i < 10; i++)
 		ppu.objects_to_render[i] = OAM_EMPTY;
 	assert(ppu.vram);
 	assert(ppu.oam);
+	assert(ppu.tile_cache);
+	// NOTE: VRAM and OAM start out as garbage, indexed on first use
+	memset(ppu.tile_cache->dirty, true, sizeof(ppu.tile_cache->dirty));
+	ppu.object_index.is_dirty = true;
 	return ppu;
 }
 
 
+PPU ppu_clone(PPU *ppu) {
+	PPU clone = *ppu;
+	clone.vram = malloc(sizeof(uint8_t) * VRAM_SIZE);
+	clone.oam = malloc(sizeof(uint8_t) * OAM_SIZE);
+	clone.tile_cache = malloc(sizeof(TileCache));
+	assert(clone.vram);
+	assert(clone.oam);
+	assert(clone.tile_cache);
+	memcpy(clone.vram, ppu->vram, VRAM_SIZE);
+	memcpy(clone.oam, ppu->oam, OAM_SIZE);
+	memcpy(clone.tile_cache, ppu->tile_cache, sizeof(TileCache));
+	return clone;
+}
+
+
 void ppu_destroy(PPU *ppu) {
 	free(ppu->vram);
 	free(ppu->oam);
+	free(ppu->tile_cache);
 	ppu->vram = NULL;
 	ppu->oam = NULL;
+	ppu->tile_cache = NULL;
 }
 
 
@@ -37,15 +61,26 @@ static inline TileData* tile_data(PPU *ppu) { return (TileData*)ppu->vram; }
 static inline uint8_t* tile_map(PPU *ppu) { return &ppu->vram[0x1800]; }
 
 
-static inline uint8_t tile_color(TileData* tile, uint8_t lx, uint8_t ly) {
-	assert(lx < 8);
+static inline void tile_cache_fill(PPU *ppu, uint16_t tile_id) {
+	TileCache *cache = ppu->tile_cache;
+	tile_decode(tile_data(ppu)[tile_id].data, 8, PALETTE_IDENTITY, &cache->pixels[tile_id][0][0]);
+	for (uint8_t ly = 0; ly < 8; ly++) {
+		uint64_t row;
+		memcpy(&row, cache->pixels[tile_id][ly], 8);
+		row = __builtin_bswap64(row);
+		memcpy(cache->flipped[tile_id][ly], &row, 8);
+	}
+	cache->dirty[tile_id] = false;
+}
+
+
+// NOTE: The color indices of one row of the tile, decoded again only after VRAM changed it
+static inline const uint8_t* tile_row(PPU *ppu, uint16_t tile_id, uint8_t ly, bool is_flipped) {
+	assert(tile_id < TILE_COUNT);
 	assert(ly < 8);
-	uint8_t lower = tile->lines[ly].lower;
-	uint8_t higher = tile->lines[ly].higher;
-	uint8_t offset = 7 - lx;
-	uint8_t lower_bit = (lower >> offset) & 0b1;
-	uint8_t higher_bit = (higher >> offset) & 0b1;
-	return lower_bit | (higher_bit << 1);
+	if (ppu->tile_cache->dirty[tile_id])
+		tile_cache_fill(ppu, tile_id);
+	return is_flipped ? ppu->tile_cache->flipped[tile_id][ly] : ppu->tile_cache->pixels[tile_id][ly];
 }
 
 
@@ -54,13 +89,35 @@ static inline SpriteObject* get_sprite_object(PPU *ppu, uint8_t index) {
 }
 
 
+// NOTE: Row of the object on line `y`, mirrored when it is flipped
+static inline const uint8_t* object_row(PPU *ppu, SpriteObject *object, uint8_t y) {
+	uint8_t local_y = (y + 16) - object->y;
+	uint8_t tile_id = object->tile;
+
+	if (object->attr & OBJ_ATTR_FLIP_Y)
+		local_y = (ppu->lcdc.obj_size ? 15 : 7) - local_y;
+	if (ppu->lcdc.obj_size) {
+		tile_id = local_y < 8 ? (tile_id & 0xFE) : (tile_id | 0x01);
+		if (local_y >= 8)
+			local_y -= 8;
+	}
+	return tile_row(ppu, tile_id, local_y, object->attr & OBJ_ATTR_FLIP_X);
+}
+
+
+static inline bool is_covered(PPU *ppu, uint8_t x) {
+	return (ppu->object_coverage[x / 64] >> (x % 64)) & 0b1;
+}
+
+
 static inline GBColor object_pixel(Emulator *emu) {
 	PPU *ppu = &emu->ppu;
 	uint8_t x = ppu->x;
 	uint8_t y = ppu->line;
-	uint8_t selected_color_idx = 0;
-	uint8_t current_x = 0xFF;
+	if (!is_covered(ppu, x))
+		return 0;
 
+	// NOTE: The first opaque object wins, they are sorted by priority
 	for (uint8_t i = 0; i < 10; i++) {
 		if (emu->ppu.objects_to_render[i] == OAM_EMPTY)
 			break;
@@ -70,31 +127,13 @@ static inline GBColor object_pixel(Emulator *emu) {
 			continue;
 
 		uint8_t local_x = (x + 8) - object->x;
-		uint8_t local_y = (y + 16) - object->y;
-		uint8_t tile_id = object->tile;
-
-		if (emu->ppu.lcdc.obj_size) {
-			tile_id = local_y < 8 ? (tile_id & 0xFE) : (tile_id | 0x01);
-			if (local_y >= 8)
-				local_y -= 8;
-		}
 		assert(local_x < 8);
-		assert(local_y < 8);
-		TileData *tile = &tile_data(ppu)[tile_id];
-		uint8_t color_idx = tile_color(tile, local_x, local_y);
-		if (color_idx == 0)
-			continue;
-
-		// Already have an object, but found a higher prio one
-		if (selected_color_idx != 0 && current_x <= object->x)
-			continue;
-
-		selected_color_idx = color_idx;
-		current_x = object->x;
+		uint8_t color_idx = object_row(ppu, object, y)[local_x];
+		if (color_idx != 0)
+			// TODO: Lookup palette
+			return color_idx;
 	}
-
-	// TODO: Lookup palette
-	return selected_color_idx;
+	return 0;
 }
 
 static inline GBColor tile_pixel(Emulator *emu) {
@@ -106,11 +145,10 @@ static inline GBColor tile_pixel(Emulator *emu) {
 	uint8_t tile_y = y / 8;
 	uint16_t tile_idx = tile_y * 32 + tile_x;
 	uint8_t tile_id = tile_map(ppu)[tile_idx];
-	TileData *tile = &tile_data(ppu)[tile_id];
 
 	uint8_t local_x = x % 8;
 	uint8_t local_y = y % 8;
-	uint8_t color_idx = tile_color(tile, local_x, local_y);
+	uint8_t color_idx = tile_row(ppu, tile_id, local_y, false)[local_x];
 
 	// TODO: Lookup palette
 	return color_idx;
@@ -140,35 +178,121 @@ static inline void drawing_step(Emulator *emu) {
 
 
 
-static inline bool is_on_scanline(PPU *ppu, SpriteObject *object) {
-	uint8_t ly = ppu->line + 16;
-	uint8_t object_size = ppu->lcdc.obj_size ? 16 : 8;
-	uint8_t offset_y = ly - object->y;
-	return offset_y < object_size;
+// NOTE: Draws the whole line at once, when no one can look at the PPU while it is drawn.
+//  Gives the same pixels as drawing_step, one tile row fetch per 8 pixels
+static inline void line_render(Emulator *emu) {
+	PPU *ppu = &emu->ppu;
+	uint8_t y = ppu->line;
+	uint8_t line[DISPLAY_WIDTH];
+
+	uint8_t *map_row = &tile_map(ppu)[(y / 8) * 32];
+	for (uint8_t tile_x = 0; tile_x < DISPLAY_WIDTH / 8; tile_x++)
+		memcpy(&line[tile_x * 8], tile_row(ppu, map_row[tile_x], y % 8, false), 8);
+
+	// NOTE: Objects come by priority, so a pixel keeps the first opaque one
+	uint8_t object_line[DISPLAY_WIDTH] = {0};
+	for (uint8_t i = 0; i < 10; i++) {
+		if (ppu->objects_to_render[i] == OAM_EMPTY)
+			break;
+		assert(ppu->objects_to_render[i] < 40);
+		SpriteObject *object = get_sprite_object(ppu, ppu->objects_to_render[i]);
+		int16_t start = object->x - 8 < 0 ? 0 : object->x - 8;
+		int16_t end = object->x < DISPLAY_WIDTH ? object->x : DISPLAY_WIDTH;
+		if (start >= end)
+			continue;
+
+		const uint8_t *row = object_row(ppu, object, y);
+		for (int16_t x = start; x < end; x++) {
+			if (object_line[x] == 0)
+				object_line[x] = row[(x + 8) - object->x];
+		}
+	}
+
+	for (uint8_t x = 0; x < DISPLAY_WIDTH; x++) {
+		if (object_line[x] != 0)
+			line[x] = object_line[x];
+	}
+	display_set_line(emu, y, line);
 }
 
 
+// NOTE: Adds or removes the object from the lines it covers at its Y. The height is the one the
+//  index was built for, LCDC may have changed it since
+static inline void object_index_update(PPU *ppu, uint8_t index, uint8_t object_y, bool is_on) {
+	ObjectIndex *object_index = &ppu->object_index;
+	uint64_t bit = 1ull << index;
+	uint8_t height = object_index->is_tall ? 16 : 8;
+	for (uint8_t i = 0; i < height; i++) {
+		uint8_t line = object_y - 16 + i;
+		if (is_on)
+			object_index->lines[line] |= bit;
+		else
+			object_index->lines[line] &= ~bit;
+	}
+}
+
+
+static inline void object_index_rebuild(PPU *ppu) {
+	memset(ppu->object_index.lines, 0, sizeof(ppu->object_index.lines));
+	ppu->object_index.is_tall = ppu->lcdc.obj_size;
+	for (uint8_t i = 0; i < SPRITE_OBJECT_SIZE; i++)
+		object_index_update(ppu, i, get_sprite_object(ppu, i)->y, true);
+	ppu->object_index.is_dirty = false;
+}
+
+
+// NOTE: The lowest X comes first, and the lowest OAM index among equal X
+static inline void objects_sort(PPU *ppu) {
+	uint8_t *objects = ppu->objects_to_render;
+	for (uint8_t i = 1; i < 10 && objects[i] != OAM_EMPTY; i++) {
+		uint8_t object = objects[i];
+		uint8_t x = get_sprite_object(ppu, object)->x;
+		uint8_t j = i;
+		for (; j > 0 && get_sprite_object(ppu, objects[j - 1])->x > x; j--)
+			objects[j] = objects[j - 1];
+		objects[j] = object;
+	}
+
+	memset(ppu->object_coverage, 0, sizeof(ppu->object_coverage));
+	for (uint8_t i = 0; i < 10 && objects[i] != OAM_EMPTY; i++) {
+		uint8_t object_x = get_sprite_object(ppu, objects[i])->x;
+		for (int16_t x = object_x - 8; x < object_x; x++) {
+			if (x >= 0 && x < DISPLAY_WIDTH)
+				ppu->object_coverage[x / 64] |= 1ull << (x % 64);
+		}
+	}
+}
+
+
+static const uint16_t OAM_SCAN_LENGTH = 80;
 static inline void oam_scan_step(Emulator *emu) {
-	static const uint16_t OAM_SCAN_LENGTH = 80;
-	if (emu->ppu.dot_clock < OAM_SCAN_LENGTH)
+	PPU *ppu = &emu->ppu;
+	if (ppu->dot_clock < OAM_SCAN_LENGTH)
+		return;
+	ppu->mode = PPU_MODE_DRAWING;
+	if (ppu->line == 0)
+		ppu->is_frame_skipped = !emulator_should_render(emu);
+	if (ppu->is_frame_skipped)
 		return;
-	emu->ppu.mode = PPU_MODE_DRAWING;
+	if (ppu->object_index.is_dirty || ppu->object_index.is_tall != ppu->lcdc.obj_size)
+		object_index_rebuild(ppu);
+
+	// NOTE: The first 10 objects in OAM order
+	uint64_t objects = ppu->object_index.lines[ppu->line];
 	uint8_t size = 0;
-	for (uint8_t i = 0; i < SPRITE_OBJECT_SIZE; i++) {
-		SpriteObject *object = get_sprite_object(&emu->ppu, i);
-		if (!is_on_scanline(&emu->ppu, object))
-			continue;
-		emu->ppu.objects_to_render[size] = i;
-		size++;
-		if (size == 10)
-			return;
+	for (; objects != 0 && size < 10; size++) {
+		ppu->objects_to_render[size] = __builtin_ctzll(objects);
+		objects &= objects - 1;
 	}
 	if (size < 10)
-		emu->ppu.objects_to_render[size] = OAM_EMPTY;
+		ppu->objects_to_render[size] = OAM_EMPTY;
+	objects_sort(ppu);
 }
 
 
 static const uint16_t LINE_DOTS_LENGTH = 456;
+static const uint8_t VBLANK_START = 144;
+static const uint8_t VBLANK_END = 154;
 static inline void hblank_step(Emulator *emu) {
 	if (emu->ppu.dot_clock < LINE_DOTS_LENGTH)
 		return;
@@ -176,10 +300,11 @@ static inline void hblank_step(Emulator *emu) {
 	emu->ppu.line++;
 	emu->ppu.dot_clock -= 456;
 
-	static const uint8_t VBLANK_START = 144;
 	if (emu->ppu.line == VBLANK_START) {
 		interrupt_trigger(emu, INTERRUPT_VBLANK);
 		emu->ppu.mode = PPU_MODE_VBLANK;
+		if (!emu->ppu.is_frame_skipped)
+			emulator_frame_drawn(emu);
 	} else {
 		emu->ppu.mode = PPU_MODE_OAM_SCAN;
 	}
@@ -191,7 +316,6 @@ static inline void vblank_step(Emulator *emu) {
 		return;
 	emu->ppu.line++;
 	emu->ppu.dot_clock -= 456;
-	static const uint8_t VBLANK_END = 154;
 	if (emu->ppu.line == VBLANK_END) {
 		emu->ppu.line = 0;
 		emu->ppu.mode = PPU_MODE_OAM_SCAN;
@@ -199,21 +323,78 @@ static inline void vblank_step(Emulator *emu) {
 }
 
 
-void ppu_step(Emulator *emu, uint8_t cycles) {
+// NOTE: Only drawing does something every dot. The other modes wait for their last dot,
+//  so they are crossed in one go
+void ppu_step(Emulator *emu, uint16_t cycles) {
 	PPU *ppu = &emu->ppu;
-	for (uint8_t cycle = 0; cycle < cycles; cycle++) {
-		emu->ppu.dot_clock++;
+	while (cycles > 0) {
+		if (ppu->mode == PPU_MODE_DRAWING && !ppu->is_frame_skipped) {
+			// NOTE: Nothing touched the PPU during the line, otherwise it would have been synced
+			//  in the middle of it. Lines that were are drawn dot by dot
+			if (ppu->x == 0 && cycles >= DISPLAY_WIDTH) {
+				line_render(emu);
+				ppu->dot_clock += DISPLAY_WIDTH;
+				cycles -= DISPLAY_WIDTH;
+				ppu->mode = PPU_MODE_HBLANK;
+				continue;
+			}
+			ppu->dot_clock++;
+			drawing_step(emu);
+			cycles--;
+			continue;
+		}
+
+		// NOTE: A skipped frame crosses drawing like any other mode
+		uint32_t until_change = ppu_cycles_until_mode_change(ppu);
+		if (until_change > cycles) {
+			ppu->dot_clock += cycles;
+			return;
+		}
+		ppu->dot_clock += until_change;
+		cycles -= until_change;
 
 		switch (ppu->mode) {
 		case PPU_MODE_HBLANK: hblank_step(emu); break;
 		case PPU_MODE_VBLANK: vblank_step(emu); break;
-		case PPU_MODE_DRAWING: drawing_step(emu); break;
 		case PPU_MODE_OAM_SCAN: oam_scan_step(emu); break;
+		case PPU_MODE_DRAWING: ppu->mode = PPU_MODE_HBLANK; ppu->x = 0; break;
 		}
 	}
 }
 
 
+uint32_t ppu_cycles_until_line_change(PPU *ppu) {
+	if (ppu->dot_clock >= LINE_DOTS_LENGTH)
+		return 1;
+	return LINE_DOTS_LENGTH - ppu->dot_clock;
+}
+
+
+uint32_t ppu_cycles_until_mode_change(PPU *ppu) {
+	switch (ppu->mode) {
+	case PPU_MODE_OAM_SCAN:
+		return ppu->dot_clock < OAM_SCAN_LENGTH ? OAM_SCAN_LENGTH - ppu->dot_clock : 1;
+	case PPU_MODE_DRAWING:
+		return ppu->x < DISPLAY_WIDTH ? DISPLAY_WIDTH - ppu->x : 1;
+	default:
+		return ppu_cycles_until_line_change(ppu);
+	}
+}
+
+
+uint32_t ppu_cycles_until_vblank(PPU *ppu) {
+	// NOTE: Every line after the current one takes exactly LINE_DOTS_LENGTH dots
+	uint32_t lines;
+	if (ppu->line < VBLANK_START)
+		lines = VBLANK_START - ppu->line;
+	else if (ppu->line < VBLANK_END)
+		lines = VBLANK_END - ppu->line + VBLANK_START;
+	else
+		lines = 1;
+	return ppu_cycles_until_line_change(ppu) + (lines - 1) * LINE_DOTS_LENGTH;
+}
+
+
 uint8_t ppu_lcdc_read(PPU *ppu) {
 	return  (ppu->lcdc.ppu_enable << 7) |
 		(ppu->lcdc.window_tilemap_area << 6) |
@@ -249,6 +430,8 @@ void ppu_vram_write(PPU *ppu, uint16_t address, uint8_t value) {
 	// if (ppu->mode == PPU_MODE_DRAWING) return;
 	if (address >= VRAM_SIZE) return;
 	ppu->vram[address] = value;
+	if (address < TILE_COUNT * sizeof(TileData))
+		ppu->tile_cache->dirty[address / sizeof(TileData)] = true;
 }
 
 
@@ -259,7 +442,17 @@ uint8_t ppu_oam_read(PPU *ppu, uint16_t address) {
 
 void ppu_oam_write(PPU *ppu, uint16_t address, uint8_t value) {
 	if (address >= OAM_SIZE) return;
+	uint8_t index = address / sizeof(SpriteObject);
+	uint8_t field = address % sizeof(SpriteObject);
+	if (field == offsetof(SpriteObject, y) && !ppu->object_index.is_dirty) {
+		object_index_update(ppu, index, ppu->oam[address], false);
+		object_index_update(ppu, index, value, true);
+	}
 	ppu->oam[address] = value;
+
+	// NOTE: Moving an object of the line being drawn changes its priority
+	if (field == offsetof(SpriteObject, x) && ppu->mode == PPU_MODE_DRAWING)
+		objects_sort(ppu);
 }
 
 
@@ -269,7 +462,32 @@ void ppu_oam_dma_write(Emulator *emu, uint16_t value) {
 	// TODO: Cycles
 	uint16_t source = value << 8;
 	for (uint16_t i = 0; i < 160; i++) {
-		emu->ppu.oam[i] = memory_read(emu, source + i);
+		ppu_oam_write(&emu->ppu, i, memory_read(emu, source + i));
 	}
 }
 
+
+static uint8_t lcdc_read(Emulator *emu, uint16_t address) { (void)address; return ppu_lcdc_read(&emu->ppu); }
+static void lcdc_write(Emulator *emu, uint16_t address, uint8_t value) { (void)address; ppu_lcdc_write(&emu->ppu, value); }
+static uint8_t stat_read(Emulator *emu, uint16_t address) { (void)address; return emu->ppu.stat; }
+static void stat_write(Emulator *emu, uint16_t address, uint8_t value) { (void)address; emu->ppu.stat = value; }
+static uint8_t scy_read(Emulator *emu, uint16_t address) { (void)address; return emu->ppu.scy; }
+static void scy_write(Emulator *emu, uint16_t address, uint8_t value) { (void)address; emu->ppu.scy = value; }
+static uint8_t scx_read(Emulator *emu, uint16_t address) { (void)address; return emu->ppu.scx; }
+static void scx_write(Emulator *emu, uint16_t address, uint8_t value) { (void)address; emu->ppu.scx = value; }
+static uint8_t ly_read(Emulator *emu, uint16_t address) { (void)address; return emu->ppu.line; }
+static void ly_write(Emulator *emu, uint16_t address, uint8_t value) { (void)address; emu->ppu.line = value; }
+static void dma_write(Emulator *emu, uint16_t address, uint8_t value) { (void)address; ppu_oam_dma_write(emu, value); }
+static uint8_t bgp_read(Emulator *emu, uint16_t address) { (void)address; return emu->ppu.bgp; }
+static void bgp_write(Emulator *emu, uint16_t address, uint8_t value) { (void)address; emu->ppu.bgp = value; }
+
+// NOTE: DMA is write only
+void ppu_register_io(IOBus *io) {
+	io_register(io, 0xFF40, lcdc_read, lcdc_write, IO_SYNC_PPU);
+	io_register(io, 0xFF41, stat_read, stat_write, IO_SYNC_PPU);
+	io_register(io, 0xFF42, scy_read, scy_write, IO_SYNC_PPU);
+	io_register(io, 0xFF43, scx_read, scx_write, IO_SYNC_PPU);
+	io_register(io, 0xFF44, ly_read, ly_write, IO_SYNC_PPU);
+	io_register(io, 0xFF46, NULL, dma_write, IO_SYNC_PPU);
+	io_register(io, 0xFF47, bgp_read, bgp_write, IO_SYNC_PPU);
+}
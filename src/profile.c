@@ -0,0 +1,26 @@
+#include "profile.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+
+Profile profile = {0};
+
+
+void profile_reset() {
+	memset(&profile, 0, sizeof(Profile));
+}
+
+
+void profile_start() {
+	profile_reset();
+	profile.is_enabled = true;
+	profile.last = profile_now();
+}
+
+
+void profile_stop() {
+	profile.ticks[profile_current()] += profile_now() - profile.last;
+	profile.is_enabled = false;
+	profile.depth = 0;
+}
@@ -0,0 +1,112 @@
+#include "rtc.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+static const uint8_t REGISTER_MASKS[RTC_REGISTER_COUNT] = {
+	0x3F, 0x3F, 0x1F, 0xFF, RTC_DAY_HIGH_BIT | RTC_HALT_BIT | RTC_CARRY_BIT,
+};
+
+
+RTC rtc_create() {
+	RTC rtc = {0};
+	return rtc;
+}
+
+
+static inline uint64_t ticks_per_second(RTC *rtc) {
+	return rtc->is_host_time ? 1 : RTC_CYCLES_PER_SECOND;
+}
+
+
+// NOTE: Out of range values are carried like in range ones, the real chip lets them
+//  count up to their mask before wrapping to 0
+static void advance(RTC *rtc, uint64_t seconds) {
+	uint8_t *r = rtc->registers;
+	uint64_t total = r[RTC_SECONDS] + seconds;
+	r[RTC_SECONDS] = total % 60;
+	total = r[RTC_MINUTES] + total / 60;
+	r[RTC_MINUTES] = total % 60;
+	total = r[RTC_HOURS] + total / 60;
+	r[RTC_HOURS] = total % 24;
+	uint64_t days = (r[RTC_DAY_LOW] | (uint64_t)(r[RTC_DAY_HIGH] & RTC_DAY_HIGH_BIT) << 8) + total / 24;
+	if (days > 0x1FF)
+		r[RTC_DAY_HIGH] |= RTC_CARRY_BIT;
+	r[RTC_DAY_LOW] = days & 0xFF;
+	r[RTC_DAY_HIGH] = (r[RTC_DAY_HIGH] & ~RTC_DAY_HIGH_BIT) | ((days >> 8) & RTC_DAY_HIGH_BIT);
+}
+
+
+void rtc_sync(RTC *rtc, uint64_t now) {
+	if (now <= rtc->base)
+		return;
+	if (rtc->registers[RTC_DAY_HIGH] & RTC_HALT_BIT) {
+		rtc->base = now;
+		return;
+	}
+	// NOTE: The part of a second that is left over stays in the base
+	uint64_t seconds = (now - rtc->base) / ticks_per_second(rtc);
+	if (seconds == 0)
+		return;
+	advance(rtc, seconds);
+	rtc->base += seconds * ticks_per_second(rtc);
+}
+
+
+void rtc_latch(RTC *rtc, uint64_t now) {
+	rtc_sync(rtc, now);
+	memcpy(rtc->latched, rtc->registers, sizeof(rtc->latched));
+}
+
+
+void rtc_write(RTC *rtc, RTCRegister reg, uint8_t value, uint64_t now) {
+	rtc_sync(rtc, now);
+	rtc->registers[reg] = value & REGISTER_MASKS[reg];
+	// NOTE: Writing the seconds restarts the second that was counting
+	if (reg == RTC_SECONDS)
+		rtc->base = now;
+}
+
+
+static inline void write_u32(uint8_t *bytes, uint32_t value) {
+	for (uint8_t i = 0; i < 4; i++)
+		bytes[i] = value >> (i * 8);
+}
+
+static inline uint64_t read_u64(const uint8_t *bytes) {
+	uint64_t value = 0;
+	for (uint8_t i = 0; i < 8; i++)
+		value |= (uint64_t)bytes[i] << (i * 8);
+	return value;
+}
+
+
+// NOTE: Five 32 bit registers, the five latched ones, then a 64 bit UNIX timestamp. All little endian
+void rtc_store(RTC *rtc, uint8_t *trailer, uint64_t now) {
+	rtc_sync(rtc, now);
+	for (uint8_t i = 0; i < RTC_REGISTER_COUNT; i++) {
+		write_u32(&trailer[i * 4], rtc->registers[i]);
+		write_u32(&trailer[(RTC_REGISTER_COUNT + i) * 4], rtc->latched[i]);
+	}
+	uint64_t timestamp = time(NULL);
+	for (uint8_t i = 0; i < 8; i++)
+		trailer[40 + i] = timestamp >> (i * 8);
+}
+
+
+void rtc_load(RTC *rtc, const uint8_t *trailer, uint64_t now) {
+	for (uint8_t i = 0; i < RTC_REGISTER_COUNT; i++) {
+		rtc->registers[i] = trailer[i * 4] & REGISTER_MASKS[i];
+		rtc->latched[i] = trailer[(RTC_REGISTER_COUNT + i) * 4] & REGISTER_MASKS[i];
+	}
+	rtc->base = now;
+	// NOTE: Emulated time does not pass between runs, so the same save always loads the same clock.
+	//  A save without a clock has no timestamp
+	uint64_t timestamp = read_u64(&trailer[40]);
+	uint64_t host = time(NULL);
+	bool is_counting = !(rtc->registers[RTC_DAY_HIGH] & RTC_HALT_BIT);
+	if (rtc->is_host_time && is_counting && timestamp != 0 && host > timestamp)
+		advance(rtc, host - timestamp);
+}
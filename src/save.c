@@ -0,0 +1,230 @@
+#include "save.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+
+static void* flush_loop(void *arg) {
+	SaveFile *save = arg;
+	pthread_mutex_lock(&save->lock);
+	while (save->is_running) {
+		struct timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += SAVE_FLUSH_INTERVAL_MS / 1000;
+		deadline.tv_nsec += (SAVE_FLUSH_INTERVAL_MS % 1000) * 1000000l;
+		if (deadline.tv_nsec >= 1000000000l) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000l;
+		}
+		int status = 0;
+		while (save->is_running && !save->is_flush_requested && status != ETIMEDOUT)
+			status = pthread_cond_timedwait(&save->wake, &save->lock, &deadline);
+		save->is_flush_requested = false;
+
+		pthread_mutex_unlock(&save->lock);
+		save_flush(save);
+		pthread_mutex_lock(&save->lock);
+	}
+	pthread_mutex_unlock(&save->lock);
+	return NULL;
+}
+
+
+#ifdef _WIN32
+
+// NOTE: A view larger than the file grows it, like ftruncate
+static bool map_file(SaveFile *save, const char *filename, bool *is_new) {
+	HANDLE file = CreateFileA(filename, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL,
+		OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER length;
+	if (!GetFileSizeEx(file, &length)) {
+		CloseHandle(file);
+		return false;
+	}
+	*is_new = length.QuadPart == 0;
+	// NOTE: Longer files are kept as they are, e.g. a clock saved after the RAM
+	DWORD mapping_size = (size_t)length.QuadPart < save->size ? save->size : 0;
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READWRITE, 0, mapping_size, NULL);
+	if (mapping == NULL) {
+		CloseHandle(file);
+		return false;
+	}
+	uint8_t *data = MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, save->size);
+	if (data == NULL) {
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+	save->data = data;
+	save->file = file;
+	save->mapping = mapping;
+	return true;
+}
+
+static void unmap_file(SaveFile *save) {
+	UnmapViewOfFile(save->data);
+	CloseHandle(save->mapping);
+	CloseHandle(save->file);
+}
+
+static inline size_t host_page_size() {
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwPageSize;
+}
+
+// NOTE: FlushViewOfFile only hands the pages to the system, FlushFileBuffers waits for the disk
+static inline void sync_range(SaveFile *save, size_t start, size_t end) {
+	FlushViewOfFile(&save->data[start], end - start);
+}
+
+static inline void sync_file(SaveFile *save) {
+	FlushFileBuffers(save->file);
+}
+
+#else
+
+static bool map_file(SaveFile *save, const char *filename, bool *is_new) {
+	int fd = open(filename, O_RDWR | O_CREAT, 0644);
+	if (fd < 0)
+		return false;
+	struct stat info;
+	// NOTE: Longer files are kept as they are, e.g. a clock saved after the RAM
+	if (fstat(fd, &info) != 0 || ((size_t)info.st_size < save->size && ftruncate(fd, save->size) != 0)) {
+		close(fd);
+		return false;
+	}
+	*is_new = info.st_size == 0;
+	uint8_t *data = mmap(NULL, save->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+		return false;
+	save->data = data;
+	return true;
+}
+
+static void unmap_file(SaveFile *save) {
+	munmap(save->data, save->size);
+}
+
+static inline size_t host_page_size() {
+	return sysconf(_SC_PAGESIZE);
+}
+
+static inline void sync_range(SaveFile *save, size_t start, size_t end) {
+	msync(&save->data[start], end - start, MS_SYNC);
+}
+
+static inline void sync_file(SaveFile *save) {
+	(void)save;
+}
+
+#endif
+
+
+SaveFile* save_open(const char *filename, size_t size, const uint8_t *initial) {
+	if (size == 0 || size > SAVE_MAX_SIZE)
+		return NULL;
+	SaveFile *save = malloc(sizeof(SaveFile));
+	assert(save);
+	memset(save, 0, sizeof(SaveFile));
+	save->size = size;
+	bool is_new = false;
+	if (!map_file(save, filename, &is_new)) {
+		free(save);
+		return NULL;
+	}
+	if (is_new && initial != NULL)
+		memcpy(save->data, initial, size);
+
+	save->is_running = true;
+	pthread_mutex_init(&save->lock, NULL);
+	pthread_cond_init(&save->wake, NULL);
+	if (pthread_create(&save->thread, NULL, flush_loop, save) != 0) {
+		// NOTE: Without the thread, everything gets flushed when the file is closed
+		save->is_running = false;
+	}
+	return save;
+}
+
+
+void save_close(SaveFile *save) {
+	if (save == NULL)
+		return;
+	pthread_mutex_lock(&save->lock);
+	bool is_running = save->is_running;
+	save->is_running = false;
+	pthread_cond_signal(&save->wake);
+	pthread_mutex_unlock(&save->lock);
+	if (is_running)
+		pthread_join(save->thread, NULL);
+
+	save_hand_over(save);
+	save_flush(save);
+	unmap_file(save);
+	pthread_mutex_destroy(&save->lock);
+	pthread_cond_destroy(&save->wake);
+	free(save);
+}
+
+
+bool save_hand_over(SaveFile *save) {
+	bool is_dirty = false;
+	for (uint8_t i = 0; i < SAVE_DIRTY_WORDS; i++) {
+		if (save->dirty[i] == 0)
+			continue;
+		atomic_fetch_or(&save->pending[i], save->dirty[i]);
+		save->dirty[i] = 0;
+		is_dirty = true;
+	}
+	return is_dirty;
+}
+
+
+void save_request_flush(SaveFile *save) {
+	pthread_mutex_lock(&save->lock);
+	save->is_flush_requested = true;
+	pthread_cond_signal(&save->wake);
+	pthread_mutex_unlock(&save->lock);
+}
+
+
+// NOTE: Syncs work on whole host pages, neighbouring chunks are merged into one call
+void save_flush(SaveFile *save) {
+	size_t host_page = host_page_size();
+	size_t start = 0;
+	size_t end = 0;
+	for (uint8_t i = 0; i < SAVE_DIRTY_WORDS; i++) {
+		uint64_t bits = atomic_exchange(&save->pending[i], 0);
+		while (bits != 0) {
+			size_t chunk = i * 64 + __builtin_ctzll(bits);
+			bits &= bits - 1;
+			size_t offset = chunk * MEMORY_PAGE_SIZE / host_page * host_page;
+			if (offset <= end && end != 0) {
+				end = chunk * MEMORY_PAGE_SIZE + MEMORY_PAGE_SIZE;
+				continue;
+			}
+			if (end != 0)
+				sync_range(save, start, end);
+			start = offset;
+			end = chunk * MEMORY_PAGE_SIZE + MEMORY_PAGE_SIZE;
+		}
+	}
+	if (end == 0)
+		return;
+	sync_range(save, start, end);
+	sync_file(save);
+}
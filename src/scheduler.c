@@ -0,0 +1,136 @@
+#include "scheduler.h"
+#include "emulator.h"
+#include "ppu.h"
+#include "profile.h"
+#include "timer.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+
+static inline void heap_place(Scheduler *scheduler, uint8_t index, Event event) {
+	scheduler->heap[index] = event;
+	scheduler->position[event.type] = index + 1;
+}
+
+static inline void heap_up(Scheduler *scheduler, uint8_t index) {
+	Event event = scheduler->heap[index];
+	while (index > 0) {
+		uint8_t parent = (index - 1) / 2;
+		if (scheduler->heap[parent].deadline <= event.deadline)
+			break;
+		heap_place(scheduler, index, scheduler->heap[parent]);
+		index = parent;
+	}
+	heap_place(scheduler, index, event);
+}
+
+static inline void heap_down(Scheduler *scheduler, uint8_t index) {
+	Event event = scheduler->heap[index];
+	for (;;) {
+		uint8_t child = index * 2 + 1;
+		if (child >= scheduler->size)
+			break;
+		if (child + 1 < scheduler->size && scheduler->heap[child + 1].deadline < scheduler->heap[child].deadline)
+			child++;
+		if (event.deadline <= scheduler->heap[child].deadline)
+			break;
+		heap_place(scheduler, index, scheduler->heap[child]);
+		index = child;
+	}
+	heap_place(scheduler, index, event);
+}
+
+static inline void heap_remove(Scheduler *scheduler, uint8_t index) {
+	scheduler->position[scheduler->heap[index].type] = 0;
+	scheduler->size--;
+	if (index == scheduler->size)
+		return;
+	heap_place(scheduler, index, scheduler->heap[scheduler->size]);
+	heap_down(scheduler, index);
+	heap_up(scheduler, index);
+}
+
+
+void scheduler_schedule(Scheduler *scheduler, EventType type, uint64_t deadline) {
+	assert(type < EVENT_COUNT);
+	Event event = { .deadline = deadline, .type = type };
+	uint8_t position = scheduler->position[type];
+	if (position == 0) {
+		heap_place(scheduler, scheduler->size, event);
+		heap_up(scheduler, scheduler->size++);
+		return;
+	}
+	heap_place(scheduler, position - 1, event);
+	heap_down(scheduler, position - 1);
+	heap_up(scheduler, scheduler->position[type] - 1);
+}
+
+
+void scheduler_cancel(Scheduler *scheduler, EventType type) {
+	assert(type < EVENT_COUNT);
+	if (scheduler->position[type] != 0)
+		heap_remove(scheduler, scheduler->position[type] - 1);
+}
+
+
+bool scheduler_pop_due(Scheduler *scheduler, Event *event) {
+	if (scheduler->size == 0 || scheduler->heap[0].deadline > scheduler->clock)
+		return false;
+	*event = scheduler->heap[0];
+	heap_remove(scheduler, 0);
+	return true;
+}
+
+
+void scheduler_sync_timer(Emulator *emu) {
+	Scheduler *scheduler = &emu->scheduler;
+	uint64_t cycles = scheduler->clock - scheduler->timer_synced;
+	scheduler->timer_synced = scheduler->clock;
+	PROFILE_ENTER(PROFILE_TIMER);
+	while (cycles > 0) {
+		uint16_t step = cycles > UINT16_MAX ? UINT16_MAX : cycles;
+		timer_step(emu, step);
+		cycles -= step;
+	}
+	PROFILE_LEAVE();
+}
+
+
+void scheduler_sync_ppu(Emulator *emu) {
+	Scheduler *scheduler = &emu->scheduler;
+	uint64_t cycles = scheduler->clock - scheduler->ppu_synced;
+	scheduler->ppu_synced = scheduler->clock;
+	PROFILE_ENTER(PROFILE_PPU);
+	while (cycles > 0) {
+		uint16_t step = cycles > UINT16_MAX ? UINT16_MAX : cycles;
+		ppu_step(emu, step);
+		cycles -= step;
+	}
+	PROFILE_LEAVE();
+}
+
+
+void scheduler_sync(Emulator *emu) {
+	scheduler_sync_timer(emu);
+	scheduler_sync_ppu(emu);
+}
+
+
+void scheduler_reschedule_timer(Emulator *emu) {
+	Scheduler *scheduler = &emu->scheduler;
+	scheduler_sync_timer(emu);
+	uint32_t cycles = timer_cycles_until_interrupt(emu);
+	if (cycles == UINT32_MAX)
+		scheduler_cancel(scheduler, EVENT_TIMER);
+	else
+		scheduler_schedule(scheduler, EVENT_TIMER, scheduler->clock + cycles);
+}
+
+
+void scheduler_reschedule_ppu(Emulator *emu) {
+	Scheduler *scheduler = &emu->scheduler;
+	scheduler_sync_ppu(emu);
+	scheduler_schedule(scheduler, EVENT_PPU, scheduler->clock + ppu_cycles_until_vblank(&emu->ppu));
+}
@@ -0,0 +1,162 @@
+#include "tile_decode.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define TILE_DECODE_X86
+#include <immintrin.h>
+#endif
+
+
+static inline uint8_t palette_color(uint8_t palette, uint8_t color_idx) {
+	return (palette >> (color_idx * 2)) & 0b11;
+}
+
+
+static void decode_scalar(const uint8_t *planes, uint16_t rows, uint8_t palette, uint8_t *out) {
+	for (uint16_t row = 0; row < rows; row++) {
+		uint8_t lower = planes[row * 2];
+		uint8_t higher = planes[row * 2 + 1];
+		for (uint8_t x = 0; x < 8; x++) {
+			uint8_t offset = 7 - x;
+			uint8_t color_idx = ((lower >> offset) & 0b1) | (((higher >> offset) & 0b1) << 1);
+			out[row * 8 + x] = palette_color(palette, color_idx);
+		}
+	}
+}
+
+
+#ifdef TILE_DECODE_X86
+
+static const uint64_t BYTES_LOW_BIT = 0x0101010101010101ull;
+// NOTE: Bit of each pixel in a plane byte, pixel 0 being the highest bit
+static const uint64_t PIXEL_BITS = 0x0102040810204080ull;
+
+
+// NOTE: PDEP spreads each plane bit into its own byte, then every byte picks its palette
+//  color with masks, eight pixels per 64 bit word
+__attribute__((target("bmi2")))
+static void decode_bmi2(const uint8_t *planes, uint16_t rows, uint8_t palette, uint8_t *out) {
+	uint64_t colors[4];
+	for (uint8_t i = 0; i < 4; i++)
+		colors[i] = palette_color(palette, i) * BYTES_LOW_BIT;
+
+	for (uint16_t row = 0; row < rows; row++) {
+		uint64_t lower = _pdep_u64(planes[row * 2], BYTES_LOW_BIT) * 0xFF;
+		uint64_t higher = _pdep_u64(planes[row * 2 + 1], BYTES_LOW_BIT) * 0xFF;
+		uint64_t low_colors = (lower & colors[1]) | (~lower & colors[0]);
+		uint64_t high_colors = (lower & colors[3]) | (~lower & colors[2]);
+		// NOTE: PDEP puts the lowest bit, the last pixel, in the first byte
+		uint64_t pixels = __builtin_bswap64((higher & high_colors) | (~higher & low_colors));
+		memcpy(&out[row * 8], &pixels, 8);
+	}
+}
+
+
+__attribute__((target("sse2")))
+static inline __m128i sse2_select(__m128i mask, __m128i set, __m128i unset) {
+	return _mm_or_si128(_mm_and_si128(mask, set), _mm_andnot_si128(mask, unset));
+}
+
+// NOTE: Two rows per register. Each plane byte is copied into all eight lanes of its row,
+//  and compared against the pixel bits to get a mask per pixel
+__attribute__((target("sse2")))
+static void decode_sse2(const uint8_t *planes, uint16_t rows, uint8_t palette, uint8_t *out) {
+	const __m128i bits = _mm_set1_epi64x(PIXEL_BITS);
+	__m128i colors[4];
+	for (uint8_t i = 0; i < 4; i++)
+		colors[i] = _mm_set1_epi8(palette_color(palette, i));
+
+	uint16_t row = 0;
+	for (; row + 2 <= rows; row += 2) {
+		const uint8_t *pair = &planes[row * 2];
+		__m128i lower = _mm_set_epi64x(pair[2] * BYTES_LOW_BIT, pair[0] * BYTES_LOW_BIT);
+		__m128i higher = _mm_set_epi64x(pair[3] * BYTES_LOW_BIT, pair[1] * BYTES_LOW_BIT);
+		lower = _mm_cmpeq_epi8(_mm_and_si128(lower, bits), bits);
+		higher = _mm_cmpeq_epi8(_mm_and_si128(higher, bits), bits);
+
+		__m128i pixels = sse2_select(higher,
+			sse2_select(lower, colors[3], colors[2]),
+			sse2_select(lower, colors[1], colors[0]));
+		_mm_storeu_si128((__m128i*)&out[row * 8], pixels);
+	}
+	decode_scalar(&planes[row * 2], rows - row, palette, &out[row * 8]);
+}
+
+
+__attribute__((target("avx2")))
+static inline __m256i avx2_select(__m256i mask, __m256i set, __m256i unset) {
+	return _mm256_blendv_epi8(unset, set, mask);
+}
+
+// NOTE: Same as the SSE2 kernel, with four rows per register
+__attribute__((target("avx2")))
+static void decode_avx2(const uint8_t *planes, uint16_t rows, uint8_t palette, uint8_t *out) {
+	const __m256i bits = _mm256_set1_epi64x(PIXEL_BITS);
+	__m256i colors[4];
+	for (uint8_t i = 0; i < 4; i++)
+		colors[i] = _mm256_set1_epi8(palette_color(palette, i));
+
+	uint16_t row = 0;
+	for (; row + 4 <= rows; row += 4) {
+		const uint8_t *quad = &planes[row * 2];
+		__m256i lower = _mm256_set_epi64x(
+			quad[6] * BYTES_LOW_BIT, quad[4] * BYTES_LOW_BIT,
+			quad[2] * BYTES_LOW_BIT, quad[0] * BYTES_LOW_BIT);
+		__m256i higher = _mm256_set_epi64x(
+			quad[7] * BYTES_LOW_BIT, quad[5] * BYTES_LOW_BIT,
+			quad[3] * BYTES_LOW_BIT, quad[1] * BYTES_LOW_BIT);
+		lower = _mm256_cmpeq_epi8(_mm256_and_si256(lower, bits), bits);
+		higher = _mm256_cmpeq_epi8(_mm256_and_si256(higher, bits), bits);
+
+		__m256i pixels = avx2_select(higher,
+			avx2_select(lower, colors[3], colors[2]),
+			avx2_select(lower, colors[1], colors[0]));
+		_mm256_storeu_si256((__m256i*)&out[row * 8], pixels);
+	}
+	decode_scalar(&planes[row * 2], rows - row, palette, &out[row * 8]);
+}
+
+#endif // TILE_DECODE_X86
+
+
+TileDecodeFn tile_decode_kernel(TileDecodeKernel kernel) {
+	switch (kernel) {
+	case TILE_DECODE_SCALAR: return decode_scalar;
+#ifdef TILE_DECODE_X86
+	case TILE_DECODE_BMI2: return __builtin_cpu_supports("bmi2") ? decode_bmi2 : NULL;
+	case TILE_DECODE_SSE2: return __builtin_cpu_supports("sse2") ? decode_sse2 : NULL;
+	case TILE_DECODE_AVX2: return __builtin_cpu_supports("avx2") ? decode_avx2 : NULL;
+#endif
+	default: return NULL;
+	}
+}
+
+
+const char* tile_decode_kernel_name(TileDecodeKernel kernel) {
+	switch (kernel) {
+	case TILE_DECODE_SCALAR: return "scalar";
+	case TILE_DECODE_BMI2: return "bmi2";
+	case TILE_DECODE_SSE2: return "sse2";
+	case TILE_DECODE_AVX2: return "avx2";
+	default: return "unknown";
+	}
+}
+
+
+// NOTE: From the most to the least preferred. PDEP is microcoded on some AMD CPUs,
+//  so the vector kernels come first
+static const TileDecodeKernel KERNEL_PREFERENCE[] = {
+	TILE_DECODE_AVX2, TILE_DECODE_SSE2, TILE_DECODE_BMI2, TILE_DECODE_SCALAR,
+};
+
+void tile_decode(const uint8_t *planes, uint16_t rows, uint8_t palette, uint8_t *out) {
+	static TileDecodeFn decode = NULL;
+	if (decode == NULL) {
+		for (uint8_t i = 0; decode == NULL; i++)
+			decode = tile_decode_kernel(KERNEL_PREFERENCE[i]);
+	}
+	decode(planes, rows, palette, out);
+}
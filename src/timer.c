@@ -3,16 +3,6 @@
 #include "interrupts.h"
 #include <stdbool.h>
 #include <stdint.h>
-#include <stdio.h>
-
-static inline void tima_step(Emulator* emu);
-
-void timer_step(Emulator* emu, uint16_t t_cycles) {
-	for (uint16_t t_cycle = 0; t_cycle < t_cycles; t_cycle++) {
-		emu->timer.internal_timer++;
-		tima_step(emu);
-	}
-}
 
 
 static const uint16_t TAC_BITS[] = {
@@ -22,63 +12,126 @@ static const uint16_t TAC_BITS[] = {
 	[0b11] = 0b0010000000,
 };
 
-static inline bool should_time_step(Emulator* emu) {
-	Timer *timer = &emu->timer;
-
-	bool is_tima_enabled = timer->tac_enabled;
-	uint16_t selected_bit = TAC_BITS[timer->tac_clock_select];
 
-	bool was_bit_set = timer->tac_selected_bit_state;
-	bool is_bit_set = (timer->internal_timer & selected_bit) != 0;
-
-	// NOTE: On DMG, the enabled flag is before the falling edge detector
-	//  Therefore we need to apply it before detecting the falling edge
+// NOTE: On DMG, the enabled flag is before the falling edge detector
+//  Therefore we need to apply it before detecting the falling edge
+static inline bool selected_bit_state(Timer *timer, uint16_t internal_timer) {
+	bool is_bit_set = (internal_timer & TAC_BITS[timer->tac_clock_select]) != 0;
 	if (!timer->is_cgb)
-		is_bit_set = is_bit_set && is_tima_enabled;
-
-	timer->tac_selected_bit_state = is_bit_set;
+		is_bit_set = is_bit_set && timer->tac_enabled;
+	return is_bit_set;
+}
 
-	bool is_falling_edge = was_bit_set && !is_bit_set;
-	if (timer->debug)
-		printf("was: %d is: %d falling: %d\n", was_bit_set, is_bit_set, is_falling_edge);
-	if (!is_falling_edge)
-		return false;
 
+// NOTE: Cycles until the falling edge of the selected bit that ticks TIMA, UINT32_MAX when there is none.
+//  `period` gets the distance between the following ticks, or 0 when there are none
+static inline uint32_t next_tima_tick(Timer *timer, uint32_t *period) {
+	*period = 0;
 	// NOTE: On CGB, the enabled flag is checked after the falling edge detector
-	if (timer->is_cgb && !is_tima_enabled)
-		return false;
+	if (timer->is_cgb && !timer->tac_enabled)
+		return UINT32_MAX;
+
+	// NOTE: The stored state can be out of phase with the bit after a TAC write or a DIV reset
+	bool is_edge_next = timer->tac_selected_bit_state &&
+		!selected_bit_state(timer, timer->internal_timer + 1);
+	if (!timer->is_cgb && !timer->tac_enabled)
+		return is_edge_next ? 1 : UINT32_MAX;
+
+	*period = TAC_BITS[timer->tac_clock_select] * 2;
+	if (is_edge_next)
+		return 1;
+	// NOTE: Otherwise the bit falls when the internal timer reaches a multiple of the period
+	uint32_t cycles = *period - (timer->internal_timer & (*period - 1));
+	return cycles == 1 ? cycles + *period : cycles;
+}
 
-	return true;
+
+static inline void tima_tick(Timer *timer) {
+	if (timer->tima == 0xFF) {
+		timer->tima_state = TIMA_STATE_WILL_OVERFLOW;
+	} else {
+		timer->tima += 1;
+	}
 }
 
-#define clock_select(tac) ((tac) & 0b11)
-static inline void tima_step(Emulator* emu) {
-	Timer *timer = &emu->timer;
 
-	switch (timer->tima_state) {
-	case TIMA_STATE_JUST_OVERFLOWED:
+// NOTE: The two cycles after TIMA overflows do not look at the falling edge detector
+static inline void overflow_step(Emulator* emu) {
+	Timer *timer = &emu->timer;
+	timer->internal_timer++;
+	if (timer->tima_state == TIMA_STATE_JUST_OVERFLOWED) {
 		timer->tima = timer->tma;
 		timer->tima_state = TIMA_STATE_COUNTING;
 		interrupt_trigger(emu, INTERRUPT_TIMER);
-		break;
-	case TIMA_STATE_WILL_OVERFLOW:
+	} else {
 		timer->tima = 0;
 		timer->tima_state = TIMA_STATE_JUST_OVERFLOWED;
-		break;
-	case TIMA_STATE_COUNTING:
-	default:
-		if (!should_time_step(emu))
+	}
+}
+
+
+// NOTE: Between two falling edges the timer only counts, so whole spans are skipped at once
+void timer_step(Emulator* emu, uint16_t t_cycles) {
+	Timer *timer = &emu->timer;
+	while (t_cycles > 0) {
+		if (timer->tima_state != TIMA_STATE_COUNTING) {
+			overflow_step(emu);
+			t_cycles--;
+			continue;
+		}
+
+		uint32_t period;
+		uint32_t tick = next_tima_tick(timer, &period);
+		if (tick > t_cycles) {
+			timer->internal_timer += t_cycles;
+			timer->tac_selected_bit_state = selected_bit_state(timer, timer->internal_timer);
 			return;
-		if (timer->tima == 0xFF) {
-			timer->tima_state = TIMA_STATE_WILL_OVERFLOW;
-		} else {
-			timer->tima += 1;
 		}
-		break;
+		timer->internal_timer += tick;
+		timer->tac_selected_bit_state = false;
+		tima_tick(timer);
+		t_cycles -= tick;
 	}
 }
 
 
+uint32_t timer_cycles_until_div_change(Emulator *emu) {
+	return 0x100 - (emu->timer.internal_timer & 0xFF);
+}
+
+uint32_t timer_cycles_until_tima_change(Emulator *emu) {
+	if (emu->timer.tima_state != TIMA_STATE_COUNTING)
+		return 1;
+	uint32_t period;
+	return next_tima_tick(&emu->timer, &period);
+}
+
+uint32_t timer_cycles_until_interrupt(Emulator *emu) {
+	Timer *timer = &emu->timer;
+	if (timer->tima_state == TIMA_STATE_JUST_OVERFLOWED)
+		return 1;
+	if (timer->tima_state == TIMA_STATE_WILL_OVERFLOW)
+		return 2;
+
+	// NOTE: The last tick only arms the overflow, reload and interrupt follow on the next two cycles
+	uint32_t period;
+	uint32_t tick = next_tima_tick(timer, &period);
+	uint32_t ticks_left = 0xFF - timer->tima;
+	if (tick == UINT32_MAX)
+		return UINT32_MAX;
+	if (ticks_left == 0)
+		return tick + 2;
+	if (period == 0)
+		return UINT32_MAX;
+
+	// NOTE: The first tick may come from an out of phase edge, the next ones fall on multiples of the period
+	uint32_t second_tick = period - ((uint16_t)(timer->internal_timer + tick) & (period - 1));
+	if (second_tick == 1)
+		second_tick += period;
+	return tick + second_tick + (ticks_left - 1) * period + 2;
+}
+
+
 void timer_tac_write(Emulator *emu, uint8_t value) {
 	emu->timer.tac_clock_select = value & 0b11;
 	emu->timer.tac_enabled = value & 0b100;
@@ -107,3 +160,19 @@ void timer_tma_write(Emulator *emu, uint8_t value) {
 	emu->timer.tima_state = TIMA_STATE_COUNTING;
 }
 
+
+static uint8_t div_read(Emulator *emu, uint16_t address) { (void)address; return timer_div_read(emu); }
+static void div_write(Emulator *emu, uint16_t address, uint8_t value) { (void)address; (void)value; timer_div_reset(emu); }
+static uint8_t tima_read(Emulator *emu, uint16_t address) { (void)address; return emu->timer.tima; }
+static void tima_write(Emulator *emu, uint16_t address, uint8_t value) { (void)address; timer_tima_write(emu, value); }
+static uint8_t tma_read(Emulator *emu, uint16_t address) { (void)address; return emu->timer.tma; }
+static void tma_write(Emulator *emu, uint16_t address, uint8_t value) { (void)address; timer_tma_write(emu, value); }
+static uint8_t tac_read(Emulator *emu, uint16_t address) { (void)address; return timer_tac_read(emu); }
+static void tac_write(Emulator *emu, uint16_t address, uint8_t value) { (void)address; timer_tac_write(emu, value); }
+
+void timer_register_io(IOBus *io) {
+	io_register(io, 0xFF04, div_read, div_write, IO_SYNC_TIMER);
+	io_register(io, 0xFF05, tima_read, tima_write, IO_SYNC_TIMER);
+	io_register(io, 0xFF06, tma_read, tma_write, IO_SYNC_TIMER);
+	io_register(io, 0xFF07, tac_read, tac_write, IO_SYNC_TIMER);
+}
@@ -0,0 +1,140 @@
+#include "block_cache.h"
+#include "./unit.h"
+#include "cpu.h"
+#include "emulator.h"
+#include "memory_map.h"
+#include "scheduler.h"
+#include <stdint.h>
+
+
+int test_self_modifying_wram() {
+	Emulator emu = emulator_create();
+	uint16_t start_pc = 0xC000;
+
+	static const uint8_t LD_A_d8 = 0x3E;
+	static const uint8_t INC_A = 0x3C;
+	memory_write(&emu, start_pc, LD_A_d8);
+	memory_write(&emu, start_pc + 1, 0x01);
+	memory_write(&emu, start_pc + 2, INC_A);
+
+	emu.cpu.pc = start_pc;
+	cpu_step(&emu);
+	cpu_step(&emu);
+	assert_eq(emu.cpu.a, 2, "%d");
+	assert(emu.block_cache->wram_code[0] > 0, "The block should be cached");
+
+	// Patch the immediate operand of the cached LD A, d8
+	memory_write(&emu, start_pc + 1, 0x10);
+	assert_eq(emu.block_cache->wram_code[1], 0, "%d");
+
+	emu.cpu.pc = start_pc;
+	cpu_step(&emu);
+	assertm_eq(emu.cpu.a, 0x10, "%02X", "Stale decoded operand was executed");
+	cpu_step(&emu);
+	assert_eq(emu.cpu.a, 0x11, "%02X");
+
+	return SUCCESS;
+}
+
+
+int test_self_modifying_next_instruction() {
+	Emulator emu = emulator_create();
+	uint16_t start_pc = 0xFF80;
+
+	static const uint8_t LD_HL_d16 = 0x21;
+	static const uint8_t LD_HL_A = 0x77;
+	static const uint8_t NOP = 0x00;
+	static const uint8_t INC_B = 0x04;
+
+	memory_write(&emu, start_pc, LD_HL_d16);
+	memory_write_16(&emu, start_pc + 1, start_pc + 4);
+	memory_write(&emu, start_pc + 3, LD_HL_A);
+	memory_write(&emu, start_pc + 4, NOP);
+
+	emu.cpu.a = INC_B;
+	emu.cpu.b = 0;
+	emu.cpu.pc = start_pc;
+
+	cpu_step(&emu); // LD HL, 0xFF84
+	cpu_step(&emu); // LD (HL), A overwrites the NOP of the running block
+	cpu_step(&emu);
+
+	assertm_eq(emu.cpu.b, 1, "%d", "The patched instruction should have been executed");
+	assert_eq(emu.cpu.pc, start_pc + 5, "%04X");
+
+	return SUCCESS;
+}
+
+
+int test_run_block_to_deadline() {
+	Emulator emu = emulator_create();
+	uint16_t start_pc = 0xC000;
+
+	static const uint8_t INC_A = 0x3C;
+	static const uint8_t HALT = 0x76;
+	for (uint16_t i = 0; i < 10; i++)
+		memory_write(&emu, start_pc + i, INC_A);
+	memory_write(&emu, start_pc + 10, HALT);
+
+	emu.cpu.a = 0;
+	emu.cpu.pc = start_pc;
+	emu.interrupt.enable = 0;
+	scheduler_schedule(&emu.scheduler, EVENT_FRAME_END, emu.scheduler.clock + 12);
+
+	BlockRun run = cpu_run_block(&emu);
+	assertm_eq(run.steps, 3, "%d", "The block should stop at the deadline");
+	assert_eq(run.cycles, 12, "%d");
+	assert_eq(emu.cpu.a, 3, "%d");
+	assert_eq(emu.cpu.pc, start_pc + 3, "%04X");
+
+	scheduler_cancel(&emu.scheduler, EVENT_FRAME_END);
+	run = cpu_run_block(&emu);
+	assertm_eq(run.steps, 8, "%d", "The rest of the block should run in one go");
+	assert_eq(run.last_pc, start_pc + 10, "%04X");
+	assert_eq(emu.cpu.a, 10, "%d");
+	assert(emu.cpu.is_halted, "The block ends with its HALT");
+
+	return SUCCESS;
+}
+
+
+int test_run_block_self_modifying() {
+	Emulator emu = emulator_create();
+	uint16_t start_pc = 0xFF80;
+
+	static const uint8_t LD_HL_d16 = 0x21;
+	static const uint8_t LD_HL_A = 0x77;
+	static const uint8_t NOP = 0x00;
+	static const uint8_t INC_B = 0x04;
+
+	memory_write(&emu, start_pc, LD_HL_d16);
+	memory_write_16(&emu, start_pc + 1, start_pc + 4);
+	memory_write(&emu, start_pc + 3, LD_HL_A);
+	memory_write(&emu, start_pc + 4, NOP);
+	memory_write(&emu, start_pc + 5, NOP);
+
+	emu.cpu.a = INC_B;
+	emu.cpu.b = 0;
+	emu.cpu.pc = start_pc;
+
+	BlockRun run = cpu_run_block(&emu);
+	assertm_eq(run.steps, 2, "%d", "Patching the running block should stop it");
+	assert_eq(emu.cpu.b, 0, "%d");
+
+	cpu_run_block(&emu);
+	assertm_eq(emu.cpu.b, 1, "%d", "The patched instruction should have been executed");
+
+	return SUCCESS;
+}
+
+
+int main() {
+	TEST_SETUP();
+
+	TEST_RUN(test_self_modifying_wram);
+	TEST_RUN(test_self_modifying_next_instruction);
+	TEST_RUN(test_run_block_to_deadline);
+	TEST_RUN(test_run_block_self_modifying);
+
+	TEST_FINISH();
+}
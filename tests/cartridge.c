@@ -0,0 +1,112 @@
+#include "cartridge.h"
+#include "./unit.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define ROM_SIZE 0x8000
+
+
+static void fill_rom(uint8_t *rom) {
+	for (uint32_t i = 0; i < ROM_SIZE; i++)
+		rom[i] = (i * 31) ^ (i >> 8);
+	memcpy(&rom[0x134], "TESTROM", 8);
+}
+
+
+int test_load_regular_file() {
+	static uint8_t rom[ROM_SIZE];
+	fill_rom(rom);
+	char filename[] = "/tmp/gbemu_cartridge_XXXXXX";
+	int fd = mkstemp(filename);
+	assert(fd >= 0, "Could not create a temporary file");
+	assert_eq(write(fd, rom, ROM_SIZE), (ssize_t)ROM_SIZE, "%zd");
+	close(fd);
+
+	Cartridge cart = cartridge_load(filename);
+	unlink(filename);
+	assert(cart.is_load_success, "The ROM should load");
+	assert(cart.is_mapped, "A regular file should be mapped");
+	assert_eq(cart.size, (size_t)ROM_SIZE, "%zu");
+	assert(memcmp(cart.content, rom, ROM_SIZE) == 0, "The content should match the file");
+	assert(strcmp(cart.title, "TESTROM") == 0, "The title should be read from the header");
+
+	cartridge_free(&cart);
+	assert(cart.content == NULL, "The content should be released");
+	return SUCCESS;
+}
+
+
+// NOTE: A pipe has no size and can not be mapped
+int test_load_pipe() {
+	static uint8_t rom[ROM_SIZE];
+	fill_rom(rom);
+	int fds[2];
+	assert(pipe(fds) == 0, "Could not create a pipe");
+	assert_eq(write(fds[1], rom, ROM_SIZE), (ssize_t)ROM_SIZE, "%zd");
+	close(fds[1]);
+
+	char filename[64];
+	snprintf(filename, sizeof(filename), "/dev/fd/%d", fds[0]);
+	Cartridge cart = cartridge_load(filename);
+	close(fds[0]);
+	assert(cart.is_load_success, "The ROM should load");
+	assert(!cart.is_mapped, "A pipe should be read into a buffer");
+	assert_eq(cart.size, (size_t)ROM_SIZE, "%zu");
+	assert(memcmp(cart.content, rom, ROM_SIZE) == 0, "The content should match what went through the pipe");
+
+	cartridge_free(&cart);
+	return SUCCESS;
+}
+
+
+int test_load_failures() {
+	Cartridge cart = cartridge_load("/tmp/gbemu_no_such_rom.gb");
+	assert(!cart.is_load_success, "A missing file should not load");
+
+	char filename[] = "/tmp/gbemu_cartridge_XXXXXX";
+	int fd = mkstemp(filename);
+	assert(fd >= 0, "Could not create a temporary file");
+	assert_eq(write(fd, "short", 5), (ssize_t)5, "%zd");
+	close(fd);
+	cart = cartridge_load(filename);
+	unlink(filename);
+	assert(!cart.is_load_success, "A file without a full header should not load");
+
+	return SUCCESS;
+}
+
+
+// NOTE: A file that ends right after the header, with no \0 in or after the title
+int test_full_length_title() {
+	static uint8_t rom[0x150];
+	memset(rom, 'A', sizeof(rom));
+	char filename[] = "/tmp/gbemu_cartridge_XXXXXX";
+	int fd = mkstemp(filename);
+	assert(fd >= 0, "Could not create a temporary file");
+	assert_eq(write(fd, rom, sizeof(rom)), (ssize_t)sizeof(rom), "%zd");
+	close(fd);
+
+	Cartridge cart = cartridge_load(filename);
+	unlink(filename);
+	assert(cart.is_load_success, "A file with just the header should load");
+	assert_eq(strlen(cart.title), (size_t)16, "%zu");
+	assert(strcmp(cart.title, "AAAAAAAAAAAAAAAA") == 0, "The title should keep all 16 chars");
+
+	cartridge_free(&cart);
+	return SUCCESS;
+}
+
+
+int main() {
+	TEST_SETUP();
+
+	TEST_RUN(test_load_regular_file);
+	TEST_RUN(test_load_pipe);
+	TEST_RUN(test_load_failures);
+	TEST_RUN(test_full_length_title);
+
+	TEST_FINISH();
+}
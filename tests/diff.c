@@ -0,0 +1,51 @@
+#include "diff.h"
+#include "./unit.h"
+#include "cartridge.h"
+#include "emulator.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+static const uint8_t PROGRAM[] = {
+	0x21, 0x00, 0xC0, // LD HL, 0xC000
+	0x3C,             // INC A
+	0x22,             // LD (HL+), A
+	0xCB, 0x10,       // RL B
+	0x80,             // ADD A, B
+	0x18, 0xF9,       // JR -7
+};
+
+
+int test_diff_matches_interpreter() {
+	Cartridge cart = {0};
+	cart.size = 0x8000;
+	cart.content = calloc(cart.size, 1);
+	memcpy(&cart.content[0x100], PROGRAM, sizeof(PROGRAM));
+
+	Emulator emu = emulator_create();
+	emulator_insert_cartridge(&emu, &cart);
+	emu.cpu.pc = 0x100;
+
+	assert(diff_enable(&emu), "Differential mode should start");
+	emulator_run_frame(&emu);
+	assert(!emu.diff->has_diverged, "Block cache and interpreter should agree");
+	assert(emu.diff->instructions > 0, "Shadow should have executed");
+
+	emu.cpu.b ^= 0xFF;
+	emulator_run_frame(&emu);
+	assert(emu.diff->has_diverged, "Tampered register should be reported");
+
+	emulator_destroy(&emu);
+	free(cart.content);
+	return SUCCESS;
+}
+
+
+int main() {
+	TEST_SETUP();
+
+	TEST_RUN(test_diff_matches_interpreter);
+
+	TEST_FINISH();
+}
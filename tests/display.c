@@ -0,0 +1,77 @@
+#include "display.h"
+#include "./unit.h"
+#include "emulator.h"
+#include "ppu.h"
+#include <stdint.h>
+#include <string.h>
+
+
+int test_only_changed_pixels_dirty_lines() {
+	Emulator emu = emulator_create();
+	assert(!display_is_changed(&emu.display), "A new display should be clean");
+
+	display_set(&emu, 10, 5, 0);
+	assert(!display_is_changed(&emu.display), "Setting the same color should not dirty the line");
+
+	display_set(&emu, 10, 5, 3);
+	uint8_t line[DISPLAY_WIDTH] = {0};
+	line[159] = 2;
+	display_set_line(&emu, 6, line);
+	display_set_line(&emu, 100, line);
+	display_set(&emu, 10, 100, 1);
+	assert(display_is_changed(&emu.display), "Changed pixels should dirty their line");
+	assert_eq(emu.display.dirty_lines, 3, "%d");
+
+	uint8_t start = 0;
+	uint8_t end;
+	assert(display_next_dirty_range(&emu.display, &start, &end), "There should be a first range");
+	assert_eq(start, 5, "%d");
+	assert_eq(end, 7, "%d");
+	start = end;
+	assert(display_next_dirty_range(&emu.display, &start, &end), "There should be a second range");
+	assert_eq(start, 100, "%d");
+	assert_eq(end, 101, "%d");
+	start = end;
+	assert(!display_next_dirty_range(&emu.display, &start, &end), "There should be no third range");
+
+	display_clear_dirty(&emu.display);
+	assert(!display_is_changed(&emu.display), "Clearing should leave the display clean");
+	assert(!display_is_line_dirty(&emu.display, 100), "Clearing should leave every line clean");
+
+	emulator_destroy(&emu);
+	return SUCCESS;
+}
+
+
+int test_static_frame_is_unchanged() {
+	Emulator emu = emulator_create();
+	memset(emu.ppu.vram, 0, VRAM_SIZE);
+	memset(emu.ppu.oam, 0, OAM_SIZE);
+	emu.ppu.mode = PPU_MODE_OAM_SCAN;
+	// NOTE: Only the tile at the top left is drawn
+	ppu_vram_write(&emu.ppu, 0x1800, 1);
+	ppu_vram_write(&emu.ppu, 0x0010, 0xFF);
+
+	for (uint16_t line = 0; line < 154; line++)
+		ppu_step(&emu, 456);
+	assert_eq(emu.display.dirty_lines, 1, "%d");
+	assert(display_is_line_dirty(&emu.display, 0), "The first line should have changed");
+
+	display_clear_dirty(&emu.display);
+	for (uint16_t line = 0; line < 154; line++)
+		ppu_step(&emu, 456);
+	assert(!display_is_changed(&emu.display), "Drawing the same frame again should change nothing");
+
+	emulator_destroy(&emu);
+	return SUCCESS;
+}
+
+
+int main() {
+	TEST_SETUP();
+
+	TEST_RUN(test_only_changed_pixels_dirty_lines);
+	TEST_RUN(test_static_frame_is_unchanged);
+
+	TEST_FINISH();
+}
@@ -0,0 +1,181 @@
+#include "idle.h"
+#include "./unit.h"
+#include "cartridge.h"
+#include "cpu.h"
+#include "emulator.h"
+#include "interrupts.h"
+#include "memory_map.h"
+#include "opcode.h"
+#include "ppu.h"
+#include "timer.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+static const uint8_t POLLING_PROGRAM[] = {
+	0xF0, 0x44,       // LDH A, (LY)
+	0xFE, 0x90,       // CP 144
+	0x20, 0xFA,       // JR NZ, -6
+	0x3C,             // INC A
+	0xF0, 0x04,       // LDH A, (DIV)
+	0xFE, 0x40,       // CP 0x40
+	0x20, 0xFA,       // JR NZ, -6
+	0x3C,             // INC A
+	0xF0, 0x05,       // LDH A, (TIMA)
+	0xB7,             // OR A
+	0x28, 0xFB,       // JR Z, -5
+	0x3C,             // INC A
+	0x18, 0xFE,       // JR -2
+};
+
+static const uint8_t WRITING_PROGRAM[] = {
+	0xF0, 0x44,       // LDH A, (LY)
+	0xE0, 0x80,       // LDH (0x80), A
+	0x18, 0xFA,       // JR -6
+};
+
+static const uint8_t INTERRUPT_PROGRAM[] = {
+	0xFB,             // EI
+	0x18, 0xFE,       // JR -2
+};
+static const uint8_t HALT_PROGRAM[] = {
+	0xFB,             // EI
+	0x76,             // HALT
+	0x04,             // INC B
+	0x18, 0xFC,       // JR -4
+};
+
+static const uint8_t VBLANK_HANDLER[] = {
+	0x3C,             // INC A
+	0xD9,             // RETI
+};
+static const uint8_t TIMER_HANDLER[] = {
+	0x0C,             // INC C
+	0xD9,             // RETI
+};
+
+
+static Emulator emulator_with_program(Cartridge *cart, const uint8_t *program, size_t size) {
+	cart->size = 0x8000;
+	cart->content = calloc(cart->size, 1);
+	memcpy(&cart->content[0x100], program, size);
+	memcpy(&cart->content[0x40], VBLANK_HANDLER, sizeof(VBLANK_HANDLER));
+	memcpy(&cart->content[0x50], TIMER_HANDLER, sizeof(TIMER_HANDLER));
+
+	Emulator emu = emulator_create();
+	emulator_insert_cartridge(&emu, cart);
+	emu.cpu.pc = 0x100;
+	emu.cpu.sp = 0xFFFE;
+	return emu;
+}
+
+
+// NOTE: emulator_run_frame, without any of the shortcuts
+static void reference_run_frame(Emulator *emu) {
+	uint32_t cycles = 0;
+	while (cycles < 70224) {
+		uint8_t t_cycle = cpu_step(emu);
+		timer_step(emu, t_cycle);
+		ppu_step(emu, t_cycle);
+		cycles += t_cycle;
+	}
+	interrupt_trigger(emu, INTERRUPT_VBLANK);
+}
+
+
+// NOTE: Runs the same frames with and without skipping, which have to end in the same state
+static int check_against_interpreter(Emulator *emu, uint8_t frames) {
+	Emulator reference = emulator_clone(emu);
+
+	for (uint8_t frame = 0; frame < frames; frame++) {
+		emulator_run_frame(emu);
+		reference_run_frame(&reference);
+		opcode_sync_flags(emu);
+		opcode_sync_flags(&reference);
+
+		assertm_eq(emu->cpu.pc, reference.cpu.pc, "%04X", "[FRAME %d] PC", frame);
+		assertm_eq(emu->cpu.af, reference.cpu.af, "%04X", "[FRAME %d] AF", frame);
+		assertm_eq(emu->cpu.bc, reference.cpu.bc, "%04X", "[FRAME %d] BC", frame);
+		assertm_eq(emu->ppu.line, reference.ppu.line, "%d", "[FRAME %d] LY", frame);
+		assertm_eq(emu->ppu.dot_clock, reference.ppu.dot_clock, "%d", "[FRAME %d] Dots", frame);
+		assertm_eq(emu->timer.internal_timer, reference.timer.internal_timer, "%04X", "[FRAME %d] Timer", frame);
+		assertm_eq(emu->timer.tima, reference.timer.tima, "%02X", "[FRAME %d] TIMA", frame);
+		assertm_eq(emu->interrupt.flag, reference.interrupt.flag, "%02X", "[FRAME %d] IF", frame);
+		assert(memcmp(emu->memory, reference.memory, sizeof(Memory)) == 0, "[FRAME %d] Memory", frame);
+	}
+
+	emulator_destroy(&reference);
+	return SUCCESS;
+}
+
+
+int test_polling_loops_are_skipped() {
+	Cartridge cart = {0};
+	Emulator emu = emulator_with_program(&cart, POLLING_PROGRAM, sizeof(POLLING_PROGRAM));
+	memory_write(&emu, 0xFF07, 0b101);
+
+	assert(check_against_interpreter(&emu, 3) == SUCCESS, "Skipping should not change the emulation");
+	assert(emu.idle->skipped_cycles > 0, "Polling loops should be skipped");
+	assertm_eq(emu.cpu.pc, 0x100 + sizeof(POLLING_PROGRAM) - 2, "%04X", "Every loop should have been left");
+
+	emulator_destroy(&emu);
+	free(cart.content);
+	return SUCCESS;
+}
+
+
+int test_writing_loop_is_not_skipped() {
+	Cartridge cart = {0};
+	Emulator emu = emulator_with_program(&cart, WRITING_PROGRAM, sizeof(WRITING_PROGRAM));
+
+	assert(check_against_interpreter(&emu, 2) == SUCCESS, "Skipping should not change the emulation");
+	assert(emu.idle->skipped_cycles == 0, "A loop writing to memory should never be skipped");
+
+	emulator_destroy(&emu);
+	free(cart.content);
+	return SUCCESS;
+}
+
+
+int test_interrupts_end_the_skip() {
+	Cartridge cart = {0};
+	Emulator emu = emulator_with_program(&cart, INTERRUPT_PROGRAM, sizeof(INTERRUPT_PROGRAM));
+	memory_write(&emu, 0xFFFF, INTERRUPT_VBLANK);
+
+	assert(check_against_interpreter(&emu, 3) == SUCCESS, "Skipping should not change the emulation");
+	assert(emu.idle->skipped_cycles > 0, "Waiting for the interrupt should be skipped");
+	assert(emu.cpu.a > 0, "The VBlank handler should have run");
+
+	emulator_destroy(&emu);
+	free(cart.content);
+	return SUCCESS;
+}
+
+
+int test_halt_fast_forward() {
+	Cartridge cart = {0};
+	Emulator emu = emulator_with_program(&cart, HALT_PROGRAM, sizeof(HALT_PROGRAM));
+	memory_write(&emu, 0xFF07, 0b101);
+	memory_write(&emu, 0xFFFF, INTERRUPT_VBLANK | INTERRUPT_TIMER);
+
+	assert(check_against_interpreter(&emu, 3) == SUCCESS, "Fast-forwarding should not change the emulation");
+	assert(emu.cpu.a > 0, "The VBlank handler should have run");
+	assert(emu.cpu.c > 0, "The timer handler should have run");
+
+	emulator_destroy(&emu);
+	free(cart.content);
+	return SUCCESS;
+}
+
+
+int main() {
+	TEST_SETUP();
+
+	TEST_RUN(test_polling_loops_are_skipped);
+	TEST_RUN(test_writing_loop_is_not_skipped);
+	TEST_RUN(test_interrupts_end_the_skip);
+	TEST_RUN(test_halt_fast_forward);
+
+	TEST_FINISH();
+}
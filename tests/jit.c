@@ -0,0 +1,219 @@
+#include "jit.h"
+#include "./unit.h"
+#include "cartridge.h"
+#include "cpu.h"
+#include "diff.h"
+#include "emulator.h"
+#include "memory_map.h"
+#include "opcode.h"
+#include "scheduler.h"
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// NOTE: Mixes translated ops with ones that fall back, while the timer interrupts it
+static const uint8_t PROGRAM[] = {
+	0x31, 0xF0, 0xDF, // LD SP, 0xDFF0
+	0x3E, 0x05,       // LD A, 0x05
+	0xE0, 0x07,       // LDH (TAC), A
+	0x3E, 0x04,       // LD A, 0x04
+	0xE0, 0xFF,       // LDH (IE), A
+	0x21, 0x00, 0xC0, // LD HL, 0xC000
+	0x01, 0x34, 0x12, // LD BC, 0x1234
+	0x11, 0x78, 0x56, // LD DE, 0x5678
+	0xFB,             // EI
+	0xAF,             // XOR A
+	// 0x0116
+	0x80,             // ADD A, B
+	0x89,             // ADC A, C
+	0x92,             // SUB D
+	0x9B,             // SBC A, E
+	0x04,             // INC B
+	0x0D,             // DEC C
+	0x14,             // INC D
+	0x1D,             // DEC E
+	0x22,             // LD (HL+), A
+	0x26, 0xC0,       // LD H, 0xC0
+	0xE6, 0xF7,       // AND 0xF7
+	0xB0,             // OR B
+	0xA9,             // XOR C
+	0xBB,             // CP E
+	0x58,             // LD E, B
+	0x2F,             // CPL
+	0x37,             // SCF
+	0xCE, 0x35,       // ADC A, 0x35
+	0x3F,             // CCF
+	0xDE, 0x11,       // SBC A, 0x11
+	0xE0, 0x80,       // LDH (0x80), A
+	0x86,             // ADD A, (HL)
+	0x56,             // LD D, (HL)
+	0x73,             // LD (HL), E
+	0x34,             // INC (HL)
+	0xC5,             // PUSH BC
+	0xD1,             // POP DE
+	0x07,             // RLCA
+	0xCB, 0x37,       // SWAP A
+	0x03,             // INC BC
+	0x1B,             // DEC DE
+	0xF0, 0x80,       // LDH A, (0x80)
+	0xEA, 0x00, 0xC8, // LD (0xC800), A
+	0xFA, 0x00, 0xC8, // LD A, (0xC800)
+	0x3C,             // INC A
+	0xFE, 0x40,       // CP 0x40
+	0x38, 0x02,       // JR C, +2
+	0xC6, 0x07,       // ADD A, 7
+	0xC2, 0x16, 0x01, // JP NZ, 0x0116
+	0xC3, 0x16, 0x01, // JP 0x0116
+};
+// NOTE: Counts the timer interrupts at 0xC910
+static const uint8_t TIMER_HANDLER[] = {
+	0xF5,             // PUSH AF
+	0xFA, 0x10, 0xC9, // LD A, (0xC910)
+	0x3C,             // INC A
+	0xEA, 0x10, 0xC9, // LD (0xC910), A
+	0xF1,             // POP AF
+	0xD9,             // RETI
+};
+
+static Emulator emulator_program(Cartridge *cart, const uint8_t *program, size_t size) {
+	cart->size = 0x8000;
+	cart->content = calloc(cart->size, 1);
+	memcpy(&cart->content[0x100], program, size);
+	memcpy(&cart->content[0x50], TIMER_HANDLER, sizeof(TIMER_HANDLER));
+
+	Emulator emu = emulator_create();
+	emulator_insert_cartridge(&emu, cart);
+	emu.cpu.pc = 0x100;
+	emu.interrupt.enable = 0;
+	return emu;
+}
+
+
+int test_jit_matches_interpreter() {
+	Cartridge cart = {0};
+	Cartridge reference_cart = {0};
+	Emulator emu = emulator_program(&cart, PROGRAM, sizeof(PROGRAM));
+	Emulator reference = emulator_program(&reference_cart, PROGRAM, sizeof(PROGRAM));
+	if (!jit_enable(&emu))
+		skip("%s: the JIT needs JIT=on on x86-64", __func__);
+
+	for (uint8_t frame = 0; frame < 60; frame++) {
+		emulator_run_frame(&emu);
+		emulator_run_frame(&reference);
+	}
+	assert(emu.jit->blocks_translated > 0, "The loop should have been translated");
+	assert(emu.jit->blocks_run > 0, "The loop should have run natively");
+	assert(emu.memory->wram[0x910] > 0, "The timer should have interrupted the loop");
+
+	opcode_sync_flags(&emu);
+	opcode_sync_flags(&reference);
+	assert_eq(emu.scheduler.clock, reference.scheduler.clock, "%" PRIu64);
+	assert_eq(emu.cpu.pc, reference.cpu.pc, "%04X");
+	assert_eq(emu.cpu.sp, reference.cpu.sp, "%04X");
+	assert_eq(emu.cpu.af, reference.cpu.af, "%04X");
+	assert_eq(emu.cpu.bc, reference.cpu.bc, "%04X");
+	assert_eq(emu.cpu.de, reference.cpu.de, "%04X");
+	assert_eq(emu.cpu.hl, reference.cpu.hl, "%04X");
+	assert(memcmp(emu.memory, reference.memory, sizeof(Memory)) == 0, "WRAM and HRAM should match");
+
+	emulator_destroy(&emu);
+	emulator_destroy(&reference);
+	free(cart.content);
+	free(reference_cart.content);
+	return SUCCESS;
+}
+
+
+int test_jit_against_diff() {
+	Cartridge cart = {0};
+	Emulator emu = emulator_program(&cart, PROGRAM, sizeof(PROGRAM));
+	if (!jit_enable(&emu))
+		skip("%s: the JIT needs JIT=on on x86-64", __func__);
+
+	assert(diff_enable(&emu), "Differential mode should start");
+	for (uint8_t frame = 0; frame < 20; frame++)
+		emulator_run_frame(&emu);
+	assert(emu.jit->blocks_run > 0, "The loop should have run natively");
+	assert(!emu.diff->has_diverged, "The native code and the interpreter should agree");
+
+	emulator_destroy(&emu);
+	free(cart.content);
+	return SUCCESS;
+}
+
+
+int test_jit_exits_at_deadline() {
+	uint8_t program[22];
+	memset(program, 0x3C, 20); // INC A
+	program[20] = 0x18;        // JR -22
+	program[21] = 0xEA;
+
+	Cartridge cart = {0};
+	Emulator emu = emulator_program(&cart, program, sizeof(program));
+	if (!jit_enable(&emu))
+		skip("%s: the JIT needs JIT=on on x86-64", __func__);
+
+	for (uint8_t i = 0; i < 2 * JIT_HOT_RUNS && emu.jit->blocks_run == 0; i++)
+		cpu_run_block(&emu);
+	assertm_eq(emu.jit->blocks_run, UINT64_C(1), "%" PRIu64, "The block should be translated once hot");
+	assert_eq(emu.cpu.pc, 0x100, "%04X");
+
+	emu.cpu.a = 0;
+	scheduler_schedule(&emu.scheduler, EVENT_FRAME_END, emu.scheduler.clock + 12);
+	BlockRun run = cpu_run_block(&emu);
+	assertm_eq(emu.jit->blocks_run, UINT64_C(2), "%" PRIu64, "The block should run natively");
+	assertm_eq(run.steps, 3, "%d", "The native code should stop at the deadline");
+	assert_eq(run.cycles, 12, "%d");
+	assert_eq(run.last_pc, 0x102, "%04X");
+	assert_eq(emu.cpu.a, 3, "%d");
+	assert_eq(emu.cpu.pc, 0x103, "%04X");
+
+	scheduler_cancel(&emu.scheduler, EVENT_FRAME_END);
+	run = cpu_run_block(&emu);
+	assertm_eq(emu.jit->blocks_run, UINT64_C(2), "%" PRIu64, "The rest of the block should run on the block cache");
+	assert_eq(run.steps, 18, "%d");
+	assert_eq(emu.cpu.a, 20, "%d");
+	assert_eq(emu.cpu.pc, 0x100, "%04X");
+
+	emulator_destroy(&emu);
+	free(cart.content);
+	return SUCCESS;
+}
+
+
+int test_jit_leaves_ram_code() {
+	Cartridge cart = {0};
+	Emulator emu = emulator_program(&cart, PROGRAM, sizeof(PROGRAM));
+	if (!jit_enable(&emu))
+		skip("%s: the JIT needs JIT=on on x86-64", __func__);
+
+	static const uint16_t START = 0xC000;
+	for (uint16_t i = 0; i < 10; i++)
+		memory_write(&emu, START + i, 0x3C); // INC A
+	memory_write(&emu, START + 10, 0x18);    // JR -12
+	memory_write(&emu, START + 11, 0xF4);
+
+	emu.cpu.pc = START;
+	for (uint8_t i = 0; i < 4 * JIT_HOT_RUNS; i++)
+		cpu_run_block(&emu);
+	assertm_eq(emu.jit->blocks_translated, UINT64_C(0), "%" PRIu64, "RAM code should stay on the block cache");
+	assert_eq(emu.cpu.pc, START, "%04X");
+
+	emulator_destroy(&emu);
+	free(cart.content);
+	return SUCCESS;
+}
+
+
+int main() {
+	TEST_SETUP();
+
+	TEST_RUN(test_jit_matches_interpreter);
+	TEST_RUN(test_jit_against_diff);
+	TEST_RUN(test_jit_exits_at_deadline);
+	TEST_RUN(test_jit_leaves_ram_code);
+
+	TEST_FINISH();
+}
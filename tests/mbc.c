@@ -0,0 +1,262 @@
+#include "mbc.h"
+#include "./unit.h"
+#include "cartridge.h"
+#include "cpu.h"
+#include "emulator.h"
+#include "memory_map.h"
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+
+// NOTE: Every bank starts with its own number, low byte then high byte
+static Cartridge banked_cartridge(CartridgeType type, uint16_t banks, RAMSize ram_size) {
+	Cartridge cart = {0};
+	cart.is_load_success = true;
+	cart.type = type;
+	cart.ram_size = ram_size;
+	cart.size = (size_t)banks * ROM_BANK_SIZE;
+	cart.content = calloc(cart.size, 1);
+	for (uint16_t bank = 0; bank < banks; bank++) {
+		cart.content[bank * ROM_BANK_SIZE + 0x1000] = bank & 0xFF;
+		cart.content[bank * ROM_BANK_SIZE + 0x1001] = bank >> 8;
+	}
+	return cart;
+}
+
+static uint16_t bank_at(Emulator *emu, uint16_t window) {
+	return memory_read(emu, window + 0x1000) | memory_read(emu, window + 0x1001) << 8;
+}
+
+
+int test_mbc1_rom_banks() {
+	Cartridge cart = banked_cartridge(CARTRIDGE_TYPE_1_MBC1, 64, RAM_SIZE_NONE);
+	Emulator emu = emulator_create();
+	emulator_insert_cartridge(&emu, &cart);
+	assert_eq(bank_at(&emu, 0x4000), 1, "%d");
+
+	memory_write(&emu, 0x2000, 5);
+	assert_eq(bank_at(&emu, 0x4000), 5, "%d");
+	assert_eq(bank_at(&emu, 0x0000), 0, "%d");
+
+	// NOTE: Bank 0 can not be selected, and the 2 bit register extends the bank
+	memory_write(&emu, 0x2000, 0);
+	assert_eq(bank_at(&emu, 0x4000), 1, "%d");
+	memory_write(&emu, 0x4000, 1);
+	assert_eq(bank_at(&emu, 0x4000), 0x21, "%02X");
+
+	// NOTE: Advanced mode also moves the first window
+	assert_eq(bank_at(&emu, 0x0000), 0, "%d");
+	memory_write(&emu, 0x6000, 1);
+	assert_eq(bank_at(&emu, 0x0000), 0x20, "%02X");
+
+	emulator_destroy(&emu);
+	cartridge_free(&cart);
+	return SUCCESS;
+}
+
+
+int test_mbc1_ram_banks() {
+	Cartridge cart = banked_cartridge(CARTRIDGE_TYPE_3_MBC1_RAM_BATTERY, 4, RAM_SIZE_256KBIT);
+	Emulator emu = emulator_create();
+	emulator_insert_cartridge(&emu, &cart);
+
+	memory_write(&emu, 0xA000, 0x12);
+	assertm_eq(memory_read(&emu, 0xA000), 0xFF, "%02X", "Disabled RAM reads open bus");
+
+	memory_write(&emu, 0x0000, 0x0A);
+	memory_write(&emu, 0x6000, 1);
+	memory_write(&emu, 0xA000, 0x12);
+	memory_write(&emu, 0x4000, 2);
+	memory_write(&emu, 0xA000, 0x34);
+	assert_eq(memory_read(&emu, 0xA000), 0x34, "%02X");
+	memory_write(&emu, 0x4000, 0);
+	assert_eq(memory_read(&emu, 0xA000), 0x12, "%02X");
+	assert_eq(emu.mbc.ram[2 * RAM_BANK_SIZE], 0x34, "%02X");
+
+	memory_write(&emu, 0x0000, 0x00);
+	assertm_eq(memory_read(&emu, 0xA000), 0xFF, "%02X", "RAM should be disabled again");
+
+	emulator_destroy(&emu);
+	cartridge_free(&cart);
+	return SUCCESS;
+}
+
+
+int test_mbc2() {
+	Cartridge cart = banked_cartridge(CARTRIDGE_TYPE_6_MBC2_BATTERY, 16, RAM_SIZE_NONE);
+	Emulator emu = emulator_create();
+	emulator_insert_cartridge(&emu, &cart);
+
+	// NOTE: Bit 8 of the address picks between RAM enable and the ROM bank
+	memory_write(&emu, 0x2100, 7);
+	assert_eq(bank_at(&emu, 0x4000), 7, "%d");
+	memory_write(&emu, 0x0000, 0x0A);
+	assert_eq(bank_at(&emu, 0x4000), 7, "%d");
+
+	memory_write(&emu, 0xA005, 0x3C);
+	assertm_eq(memory_read(&emu, 0xA005), 0xFC, "%02X", "Only the lower nibble is stored");
+	assertm_eq(memory_read(&emu, 0xA205), 0xFC, "%02X", "The 512 nibbles repeat through the window");
+	assert_eq(memory_read(&emu, 0xBE05), 0xFC, "%02X");
+
+	emulator_destroy(&emu);
+	cartridge_free(&cart);
+	return SUCCESS;
+}
+
+
+int test_mbc3() {
+	Cartridge cart = banked_cartridge(CARTRIDGE_TYPE_13_MBC3_RAM_BATTERY, 128, RAM_SIZE_256KBIT);
+	Emulator emu = emulator_create();
+	emulator_insert_cartridge(&emu, &cart);
+
+	memory_write(&emu, 0x2000, 0x7F);
+	assert_eq(bank_at(&emu, 0x4000), 0x7F, "%02X");
+	memory_write(&emu, 0x2000, 0x00);
+	assert_eq(bank_at(&emu, 0x4000), 1, "%d");
+
+	memory_write(&emu, 0x0000, 0x0A);
+	memory_write(&emu, 0x4000, 3);
+	memory_write(&emu, 0xBFFF, 0x56);
+	assert_eq(emu.mbc.ram[4 * RAM_BANK_SIZE - 1], 0x56, "%02X");
+
+	emulator_destroy(&emu);
+	cartridge_free(&cart);
+	return SUCCESS;
+}
+
+
+int test_mbc5() {
+	Cartridge cart = banked_cartridge(CARTRIDGE_TYPE_19_MBC5, 512, RAM_SIZE_NONE);
+	Emulator emu = emulator_create();
+	emulator_insert_cartridge(&emu, &cart);
+
+	memory_write(&emu, 0x2000, 0x00);
+	assertm_eq(bank_at(&emu, 0x4000), 0, "%d", "MBC5 maps bank 0 as asked");
+	memory_write(&emu, 0x2000, 0x23);
+	memory_write(&emu, 0x3000, 0x01);
+	assert_eq(bank_at(&emu, 0x4000), 0x123, "%03X");
+
+	emulator_destroy(&emu);
+	cartridge_free(&cart);
+	return SUCCESS;
+}
+
+
+// NOTE: The same code address decodes to different blocks in different banks
+int test_block_cache_follows_banks() {
+	static const uint8_t LD_A_d8 = 0x3E;
+	static const uint8_t JR = 0x18;
+	Cartridge cart = banked_cartridge(CARTRIDGE_TYPE_1_MBC1, 4, RAM_SIZE_NONE);
+	for (uint8_t bank = 1; bank < 4; bank++) {
+		uint8_t *code = &cart.content[bank * ROM_BANK_SIZE];
+		code[0] = LD_A_d8;
+		code[1] = bank * 0x10;
+		code[2] = JR;
+		code[3] = 0xFC;
+	}
+
+	Emulator emu = emulator_create();
+	emulator_insert_cartridge(&emu, &cart);
+	for (uint8_t bank = 1; bank < 4; bank++) {
+		memory_write(&emu, 0x2000, bank);
+		emu.cpu.pc = 0x4000;
+		cpu_step(&emu);
+		assertm_eq(emu.cpu.a, bank * 0x10, "%02X", "Ran code from the wrong bank");
+	}
+
+	emulator_destroy(&emu);
+	cartridge_free(&cart);
+	return SUCCESS;
+}
+
+
+// NOTE: Pages are write protected until their first write, and again once the frame hands them over
+int test_save_dirty_pages() {
+	char filename[] = "/tmp/gbemu_save_XXXXXX";
+	int fd = mkstemp(filename);
+	assert(fd >= 0, "Could not create a temporary file");
+	close(fd);
+
+	Cartridge cart = banked_cartridge(CARTRIDGE_TYPE_3_MBC1_RAM_BATTERY, 4, RAM_SIZE_256KBIT);
+	Emulator emu = emulator_create();
+	emulator_insert_cartridge(&emu, &cart);
+	assert(mbc_attach_save(&emu, filename), "The save should attach");
+	memory_write(&emu, 0x0000, 0x0A);
+	assert(emu.memory_map.read[0xA0] != NULL, "A saved page should still be readable directly");
+	assert(emu.memory_map.write[0xA0] == NULL, "A clean page should be protected");
+
+	memory_write(&emu, 0xA010, 0x42);
+	assert(emu.memory_map.write[0xA0] != NULL, "A dirty page should be writable");
+	assert(emu.memory_map.write[0xA1] == NULL, "The next page should still be clean");
+	assert_eq(memory_read(&emu, 0xA010), 0x42, "%02X");
+
+	mbc_end_frame(&emu);
+	assert(emu.memory_map.write[0xA0] == NULL, "The page should be protected after the hand over");
+	assert(!save_is_dirty(emu.mbc.save, 0x10), "The page should be queued for the flush thread");
+
+	emulator_destroy(&emu);
+	cartridge_free(&cart);
+	unlink(filename);
+	return SUCCESS;
+}
+
+
+int test_save_persists() {
+	char filename[] = "/tmp/gbemu_save_XXXXXX";
+	int fd = mkstemp(filename);
+	assert(fd >= 0, "Could not create a temporary file");
+	close(fd);
+
+	Cartridge cart = banked_cartridge(CARTRIDGE_TYPE_3_MBC1_RAM_BATTERY, 4, RAM_SIZE_256KBIT);
+	Emulator emu = emulator_create();
+	emulator_insert_cartridge(&emu, &cart);
+	assert(mbc_attach_save(&emu, filename), "The save should attach");
+	memory_write(&emu, 0x0000, 0x0A);
+	memory_write(&emu, 0x6000, 1);
+	memory_write(&emu, 0x4000, 3);
+	memory_write(&emu, 0xB234, 0x99);
+	memory_write(&emu, 0xB235, 0x66);
+	memory_write(&emu, 0x0000, 0x00);
+	emulator_destroy(&emu);
+
+	uint8_t bytes[2];
+	fd = open(filename, O_RDONLY);
+	assert(fd >= 0, "The save should exist");
+	assert_eq(lseek(fd, 0, SEEK_END), (off_t)0x8000, "%ld");
+	assert_eq(pread(fd, bytes, 2, 3 * RAM_BANK_SIZE + 0x1234), (ssize_t)2, "%zd");
+	close(fd);
+	assert_eq(bytes[0], 0x99, "%02X");
+	assert_eq(bytes[1], 0x66, "%02X");
+
+	// NOTE: A new emulator picks the RAM back up
+	emu = emulator_create();
+	emulator_insert_cartridge(&emu, &cart);
+	assert(mbc_attach_save(&emu, filename), "The save should attach again");
+	memory_write(&emu, 0x0000, 0x0A);
+	memory_write(&emu, 0x6000, 1);
+	memory_write(&emu, 0x4000, 3);
+	assert_eq(memory_read(&emu, 0xB234), 0x99, "%02X");
+
+	emulator_destroy(&emu);
+	cartridge_free(&cart);
+	unlink(filename);
+	return SUCCESS;
+}
+
+
+int main() {
+	TEST_SETUP();
+
+	TEST_RUN(test_mbc1_rom_banks);
+	TEST_RUN(test_mbc1_ram_banks);
+	TEST_RUN(test_mbc2);
+	TEST_RUN(test_mbc3);
+	TEST_RUN(test_mbc5);
+	TEST_RUN(test_block_cache_follows_banks);
+	TEST_RUN(test_save_dirty_pages);
+	TEST_RUN(test_save_persists);
+
+	TEST_FINISH();
+}
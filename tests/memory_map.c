@@ -0,0 +1,127 @@
+#include "memory_map.h"
+#include "./unit.h"
+#include "cartridge.h"
+#include "cpu.h"
+#include "emulator.h"
+#include "io.h"
+#include <stdint.h>
+#include <stdlib.h>
+
+
+int test_echo_mirrors_wram() {
+	Emulator emu = emulator_create();
+
+	memory_write(&emu, 0xC123, 0x42);
+	assert_eq(memory_read(&emu, 0xE123), 0x42, "%02X");
+	memory_write(&emu, 0xFDFF, 0x24);
+	assert_eq(memory_read(&emu, 0xDDFF), 0x24, "%02X");
+	assert_eq(emu.memory->wram[0x1DFF], 0x24, "%02X");
+
+	// NOTE: OAM follows the echo, it must not be mapped as WRAM
+	assert(emu.memory_map.read[0xFE] == NULL, "OAM should go through the handlers");
+
+	emulator_destroy(&emu);
+	return SUCCESS;
+}
+
+
+int test_rom_pages_follow_cartridge() {
+	Emulator emu = emulator_create();
+	assert(emu.memory_map.read[0x01] == NULL, "No cartridge, nothing to map");
+
+	Cartridge cart = {0};
+	cart.is_load_success = true;
+	cart.size = 0x8000;
+	cart.content = calloc(cart.size, 1);
+	cart.content[0x0150] = 0xAB;
+	cart.content[0x7FFF] = 0xCD;
+
+	emulator_insert_cartridge(&emu, &cart);
+	assert_eq(memory_read(&emu, 0x0150), 0xAB, "%02X");
+	assert_eq(memory_read(&emu, 0x7FFF), 0xCD, "%02X");
+
+	// NOTE: Writes to ROM are mapper commands, never stores
+	assert(emu.memory_map.write[0x01] == NULL, "ROM should not be writable");
+	memory_write(&emu, 0x0150, 0x00);
+	assert_eq(memory_read(&emu, 0x0150), 0xAB, "%02X");
+
+	emulator_destroy(&emu);
+	cartridge_free(&cart);
+	return SUCCESS;
+}
+
+
+int test_code_pages_are_write_protected() {
+	Emulator emu = emulator_create();
+	uint16_t start_pc = 0xC200;
+
+	static const uint8_t LD_A_d8 = 0x3E;
+	static const uint8_t INC_A = 0x3C;
+	memory_write(&emu, start_pc, LD_A_d8);
+	memory_write(&emu, start_pc + 1, 0x01);
+	memory_write(&emu, start_pc + 2, INC_A);
+	assert(emu.memory_map.write[0xC2] != NULL, "A page without code should be writable");
+
+	emu.cpu.pc = start_pc;
+	cpu_step(&emu);
+	cpu_step(&emu);
+	assert_eq(emu.cpu.a, 2, "%d");
+	assert(emu.memory_map.write[0xC2] == NULL, "The page with the block should be protected");
+	assert(emu.memory_map.write[0xE2] == NULL, "The echo of the page should be protected too");
+	assert(emu.memory_map.write[0xC3] != NULL, "The next page has no code");
+
+	// NOTE: Patching the code through the echo evicts the block and frees the page
+	memory_write(&emu, start_pc + 0x2000 + 1, 0x10);
+	assert(emu.memory_map.write[0xC2] != NULL, "The page should be writable again");
+
+	emu.cpu.pc = start_pc;
+	cpu_step(&emu);
+	assertm_eq(emu.cpu.a, 0x10, "%02X", "Stale decoded operand was executed");
+
+	emulator_destroy(&emu);
+	return SUCCESS;
+}
+
+
+int test_dma_leaves_bgp_alone() {
+	Emulator emu = emulator_create();
+
+	memory_write(&emu, 0xFF47, 0b11100100);
+	memory_write(&emu, 0xFF46, 0xC0);
+	assertm_eq(memory_read(&emu, 0xFF47), 0b11100100, "%02X", "The DMA write fell through to BGP");
+
+	emulator_destroy(&emu);
+	return SUCCESS;
+}
+
+
+static uint8_t serial_data = 0;
+static uint8_t serial_read(Emulator *emu, uint16_t address) { (void)emu; (void)address; return serial_data; }
+static void serial_write(Emulator *emu, uint16_t address, uint8_t value) { (void)emu; (void)address; serial_data = value; }
+
+int test_io_registration() {
+	Emulator emu = emulator_create();
+	assertm_eq(memory_read(&emu, 0xFF01), 0xFF, "%02X", "Unregistered registers read 0xFF");
+	memory_write(&emu, 0xFF01, 0x12);
+
+	io_register(&emu.io, 0xFF01, serial_read, serial_write, IO_SYNC_NONE);
+	memory_write(&emu, 0xFF01, 0x34);
+	assert_eq(serial_data, 0x34, "%02X");
+	assert_eq(memory_read(&emu, 0xFF01), 0x34, "%02X");
+
+	emulator_destroy(&emu);
+	return SUCCESS;
+}
+
+
+int main() {
+	TEST_SETUP();
+
+	TEST_RUN(test_echo_mirrors_wram);
+	TEST_RUN(test_rom_pages_follow_cartridge);
+	TEST_RUN(test_code_pages_are_write_protected);
+	TEST_RUN(test_dma_leaves_bgp_alone);
+	TEST_RUN(test_io_registration);
+
+	TEST_FINISH();
+}
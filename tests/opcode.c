@@ -50,6 +50,7 @@ int test_ld() {
 		uint8_t result = emu.cpu.a OPERATOR *registers[i];\
 		int opcode = (OPCODE) + i;\
 		opcode_execute(&emu, opcode);\
+		opcode_sync_flags(&emu);\
 		assertm_eq(emu.cpu.a, result, "%02X", "[OPCODE %x] "LABEL" b, %s", opcode, registers_labels[i]);\
 	}
 int test_arith() {
@@ -73,12 +74,14 @@ int test_arith_flags() {
 
 	memset(&emu, 0, sizeof(Emulator));
 	opcode_execute(&emu, 0x80);
+	opcode_sync_flags(&emu);
 	assertm_eq(emu.cpu.f, Z, "%02X", "ADD Z invalid flags!");
 
 	// Full/Half carry
 	emu.cpu.a = 0b10001000;
 	emu.cpu.b = 0b10001000;
 	opcode_execute(&emu, 0x80);
+	opcode_sync_flags(&emu);
 	assertm_eq(emu.cpu.f, H | C, "%02X", "ADC H C invalid flags!");
 
 	// Full/Half carry ADC
@@ -86,20 +89,36 @@ int test_arith_flags() {
 	emu.cpu.a = 0b10001000;
 	emu.cpu.b = 0b10000111;
 	opcode_execute(&emu, 0x88);
+	opcode_sync_flags(&emu);
 	assertm_eq(emu.cpu.f, H | C, "%02X", "ADC Full/Half carry not set!");
 
 	// SUB
 	emu.cpu.a = 0b10010000;
 	emu.cpu.b = 0b10010001;
 	opcode_execute(&emu, 0x90);
+	opcode_sync_flags(&emu);
 	assertm_eq(emu.cpu.f, N | H | C, "%02X", "SUB ZNHC invalid flags!");
 
 	emu.cpu.f = C;
 	emu.cpu.a = 0b10010000;
 	emu.cpu.b = 0b10010000;
 	opcode_execute(&emu, 0x98);
+	opcode_sync_flags(&emu);
 	assertm_eq(emu.cpu.f, N | H | C, "%02X", "SBC ZNHC invalid flags!");
 
+	// Z comes from the 8 bit result
+	emu.cpu.a = 0x80;
+	emu.cpu.b = 0x80;
+	opcode_execute(&emu, 0x80);
+	opcode_sync_flags(&emu);
+	assertm_eq(emu.cpu.f, Z | C, "%02X", "ADD overflowing to 0 should set Z!");
+
+	emu.cpu.f = 0;
+	emu.cpu.b = 0xFF;
+	opcode_execute(&emu, 0x04);
+	opcode_sync_flags(&emu);
+	assertm_eq(emu.cpu.f, Z | H, "%02X", "INC overflowing to 0 should set Z!");
+
 	return SUCCESS;
 }
 
@@ -0,0 +1,419 @@
+#include "ppu.h"
+#include "./unit.h"
+#include "cartridge.h"
+#include "display.h"
+#include "emulator.h"
+#include "interrupts.h"
+#include "memory_map.h"
+#include "scheduler.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// NOTE: Color index of a pixel, found back from its palette color
+static uint8_t screen_color(Emulator *emu, uint8_t x, uint8_t y) {
+	for (uint8_t i = 0; i < 4; i++) {
+		if (emu->display.framebuffer[y][x] == emu->display.palette[i])
+			return i;
+	}
+	return 0xFF;
+}
+
+
+static Emulator emulator_with_random_vram() {
+	Emulator emu = emulator_create();
+	srand(0x1234);
+	for (uint16_t i = 0; i < VRAM_SIZE; i++)
+		emu.ppu.vram[i] = rand() & 0xFF;
+	// NOTE: Objects crowd the left edge, so that they overlap and get clipped
+	for (uint16_t i = 0; i < OAM_SIZE; i += 4) {
+		emu.ppu.oam[i + 0] = 16 + rand() % DISPLAY_HEIGHT;
+		emu.ppu.oam[i + 1] = rand() % 24;
+		emu.ppu.oam[i + 2] = rand() & 0xFF;
+		emu.ppu.oam[i + 3] = rand() & 0xFF;
+	}
+	return emu;
+}
+
+
+static int check_against_dot_by_dot(Emulator *lazy) {
+	Emulator reference = emulator_clone(lazy);
+
+	// NOTE: Uneven chunks, so that they end in every mode
+	uint32_t cycles = 0;
+	while (cycles < 2 * 70224) {
+		uint16_t chunk = 1 + rand() % 2000;
+		ppu_step(lazy, chunk);
+		for (uint16_t i = 0; i < chunk; i++)
+			ppu_step(&reference, 1);
+		cycles += chunk;
+
+		assertm_eq(lazy->ppu.mode, reference.ppu.mode, "%d", "[CYCLE %d] Mode", cycles);
+		assertm_eq(lazy->ppu.line, reference.ppu.line, "%d", "[CYCLE %d] LY", cycles);
+		assertm_eq(lazy->ppu.dot_clock, reference.ppu.dot_clock, "%d", "[CYCLE %d] Dots", cycles);
+		assertm_eq(lazy->ppu.x, reference.ppu.x, "%d", "[CYCLE %d] X", cycles);
+		assertm_eq(lazy->interrupt.flag, reference.interrupt.flag, "%02X", "[CYCLE %d] IF", cycles);
+	}
+	assert(memcmp(&lazy->display, &reference.display, sizeof(Display)) == 0, "The frames should be the same");
+
+	emulator_destroy(&reference);
+	return SUCCESS;
+}
+
+
+int test_catch_up_matches_dot_by_dot() {
+	Emulator emu = emulator_with_random_vram();
+	assert(check_against_dot_by_dot(&emu) == SUCCESS, "Catching up should draw the same");
+	emulator_destroy(&emu);
+	return SUCCESS;
+}
+
+
+int test_catch_up_matches_dot_by_dot_with_tall_objects() {
+	Emulator emu = emulator_with_random_vram();
+	emu.ppu.lcdc.obj_size = true;
+	assert(check_against_dot_by_dot(&emu) == SUCCESS, "Catching up should draw the same");
+	emulator_destroy(&emu);
+	return SUCCESS;
+}
+
+
+int test_vram_write_lands_mid_scanline() {
+	Emulator emu = emulator_create();
+	memset(emu.ppu.vram, 0, VRAM_SIZE);
+	memset(emu.ppu.oam, 0, OAM_SIZE);
+	emu.ppu.mode = PPU_MODE_OAM_SCAN;
+
+	// NOTE: Pixel x of the first line is drawn on dot 81 + x
+	emu.scheduler.clock = 81 + 39;
+	memory_write(&emu, 0x8000, 0xFF);
+	emu.scheduler.clock = 456;
+	scheduler_sync_ppu(&emu);
+
+	assert_eq(screen_color(&emu, 39, 0), 0, "%d");
+	assert_eq(screen_color(&emu, 40, 0), 1, "%d");
+	assert_eq(screen_color(&emu, 159, 0), 1, "%d");
+
+	emulator_destroy(&emu);
+	return SUCCESS;
+}
+
+
+int test_flipped_objects() {
+	Emulator emu = emulator_create();
+	memset(emu.ppu.vram, 0, VRAM_SIZE);
+	memset(emu.ppu.oam, 0, OAM_SIZE);
+	emu.ppu.mode = PPU_MODE_OAM_SCAN;
+
+	// NOTE: Tile 1 only has its top left pixel set
+	memory_write(&emu, 0x8010, 0x80);
+	SpriteObject *objects = (SpriteObject*)emu.ppu.oam;
+	objects[0] = (SpriteObject){ .y = 16, .x = 8, .tile = 1, .attr = OBJ_ATTR_FLIP_X };
+	objects[1] = (SpriteObject){ .y = 24, .x = 24, .tile = 1, .attr = OBJ_ATTR_FLIP_Y };
+
+	emu.scheduler.clock = 70224;
+	scheduler_sync_ppu(&emu);
+
+	assert_eq(screen_color(&emu, 0, 0), 0, "%d");
+	assert_eq(screen_color(&emu, 7, 0), 1, "%d");
+	assert_eq(screen_color(&emu, 16, 8), 0, "%d");
+	assert_eq(screen_color(&emu, 16, 15), 1, "%d");
+
+	emulator_destroy(&emu);
+	return SUCCESS;
+}
+
+
+static Emulator emulator_with_solid_tiles() {
+	Emulator emu = emulator_create();
+	memset(emu.ppu.vram, 0, VRAM_SIZE);
+	memset(emu.ppu.oam, 0, OAM_SIZE);
+	emu.ppu.mode = PPU_MODE_OAM_SCAN;
+	// NOTE: Tile n is filled with color n
+	for (uint8_t color = 1; color < 4; color++) {
+		for (uint8_t i = 0; i < 16; i += 2) {
+			emu.ppu.vram[color * 16 + i] = color & 0b01 ? 0xFF : 0x00;
+			emu.ppu.vram[color * 16 + i + 1] = color & 0b10 ? 0xFF : 0x00;
+		}
+	}
+	return emu;
+}
+
+
+int test_object_priority() {
+	for (uint8_t is_dot_by_dot = 0; is_dot_by_dot < 2; is_dot_by_dot++) {
+		Emulator emu = emulator_with_solid_tiles();
+		SpriteObject *objects = (SpriteObject*)emu.ppu.oam;
+		objects[0] = (SpriteObject){ .y = 16, .x = 20, .tile = 1 };
+		objects[1] = (SpriteObject){ .y = 16, .x = 16, .tile = 2 };
+		objects[2] = (SpriteObject){ .y = 16, .x = 20, .tile = 3 };
+
+		if (is_dot_by_dot) {
+			for (uint16_t i = 0; i < 456; i++)
+				ppu_step(&emu, 1);
+		} else {
+			ppu_step(&emu, 456);
+		}
+
+		// NOTE: The lowest X wins, then the lowest OAM index
+		assertm_eq(screen_color(&emu, 11, 0), 2, "%d", "Dot by dot: %d", is_dot_by_dot);
+		assertm_eq(screen_color(&emu, 13, 0), 2, "%d", "Dot by dot: %d", is_dot_by_dot);
+		assertm_eq(screen_color(&emu, 17, 0), 1, "%d", "Dot by dot: %d", is_dot_by_dot);
+		assertm_eq(screen_color(&emu, 20, 0), 0, "%d", "Dot by dot: %d", is_dot_by_dot);
+		emulator_destroy(&emu);
+	}
+	return SUCCESS;
+}
+
+
+int test_object_index_follows_oam() {
+	Emulator emu = emulator_with_solid_tiles();
+	SpriteObject *objects = (SpriteObject*)emu.ppu.oam;
+	objects[0] = (SpriteObject){ .y = 16, .x = 8, .tile = 1 };
+
+	emu.scheduler.clock = 70224;
+	scheduler_sync_ppu(&emu);
+	assert_eq(screen_color(&emu, 0, 0), 1, "%d");
+
+	// NOTE: Moved down by a write, then moved to line 40 and swapped to tile 2 by a DMA in VBlank
+	memory_write(&emu, 0xFE00, 16 + 20);
+	emu.scheduler.clock += 70224;
+	scheduler_sync_ppu(&emu);
+	assert_eq(screen_color(&emu, 0, 0), 0, "%d");
+	assert_eq(screen_color(&emu, 0, 20), 1, "%d");
+
+	emu.scheduler.clock += 145 * 456;
+	const uint8_t dma[] = { 16 + 40, 8, 2, 0 };
+	for (uint8_t i = 0; i < sizeof(dma); i++)
+		memory_write(&emu, 0xC000 + i, dma[i]);
+	memory_write(&emu, 0xFF46, 0xC0);
+	emu.scheduler.clock += 70224;
+	scheduler_sync_ppu(&emu);
+	assert_eq(screen_color(&emu, 0, 20), 0, "%d");
+	assert_eq(screen_color(&emu, 0, 40), 2, "%d");
+
+	emulator_destroy(&emu);
+	return SUCCESS;
+}
+
+
+static void run_ppu_frame(Emulator *emu) {
+	for (uint16_t line = 0; line < 154; line++)
+		ppu_step(emu, 456);
+}
+
+
+// NOTE: A Y write while LCDC has 8x8 objects, into an index built for 8x16 ones
+int test_object_index_survives_size_toggle() {
+	Emulator emu = emulator_with_solid_tiles();
+	SpriteObject *objects = (SpriteObject*)emu.ppu.oam;
+	objects[0] = (SpriteObject){ .y = 16, .x = 8, .tile = 2 };
+	uint8_t lcdc = ppu_lcdc_read(&emu.ppu);
+	ppu_lcdc_write(&emu.ppu, lcdc | 0b100);
+	run_ppu_frame(&emu);
+	assert_eq(screen_color(&emu, 0, 12), 3, "%d");
+
+	ppu_lcdc_write(&emu.ppu, lcdc & ~0b100);
+	ppu_oam_write(&emu.ppu, 0, 16 + 40);
+	ppu_lcdc_write(&emu.ppu, lcdc | 0b100);
+	run_ppu_frame(&emu);
+	assertm_eq(screen_color(&emu, 0, 12), 0, "%d", "The old lines of a tall object should be cleared");
+	assert_eq(emu.ppu.object_index.lines[12], 0ull, "%llu");
+	assert_eq(screen_color(&emu, 0, 40), 2, "%d");
+	assert_eq(screen_color(&emu, 0, 52), 3, "%d");
+
+	emulator_destroy(&emu);
+	return SUCCESS;
+}
+
+
+int test_frameskip_keeps_timing() {
+	Emulator skipping = emulator_with_random_vram();
+	skipping.ppu.mode = PPU_MODE_OAM_SCAN;
+	emulator_set_frameskip(&skipping, 2);
+	Emulator reference = emulator_clone(&skipping);
+	emulator_set_frameskip(&reference, 0);
+	Display last_drawn = skipping.display;
+
+	for (uint8_t frame = 0; frame < 6; frame++) {
+		// NOTE: Every frame looks different
+		ppu_vram_write(&skipping.ppu, 0x1800 + frame, frame + 1);
+		ppu_vram_write(&reference.ppu, 0x1800 + frame, frame + 1);
+		run_ppu_frame(&skipping);
+		run_ppu_frame(&reference);
+
+		assertm_eq(skipping.ppu.mode, reference.ppu.mode, "%d", "[FRAME %d] Mode", frame);
+		assertm_eq(skipping.ppu.line, reference.ppu.line, "%d", "[FRAME %d] LY", frame);
+		assertm_eq(skipping.ppu.dot_clock, reference.ppu.dot_clock, "%d", "[FRAME %d] Dots", frame);
+		assertm_eq(skipping.interrupt.flag, reference.interrupt.flag, "%02X", "[FRAME %d] IF", frame);
+
+		bool is_drawn = frame % 3 == 0;
+		Display *expected = is_drawn ? &reference.display : &last_drawn;
+		assert(memcmp(&skipping.display, expected, sizeof(Display)) == 0,
+			"[FRAME %d] Frame should be %s", frame, is_drawn ? "drawn" : "skipped");
+		if (is_drawn)
+			last_drawn = skipping.display;
+	}
+
+	emulator_destroy(&skipping);
+	emulator_destroy(&reference);
+	return SUCCESS;
+}
+
+
+int test_render_on_demand() {
+	Emulator emu = emulator_with_random_vram();
+	emu.ppu.mode = PPU_MODE_OAM_SCAN;
+	emulator_set_render_on_demand(&emu, true);
+	Display blank = emu.display;
+
+	run_ppu_frame(&emu);
+	assert(memcmp(&emu.display, &blank, sizeof(Display)) == 0, "Frames should only be drawn on demand");
+
+	emulator_request_frame(&emu);
+	run_ppu_frame(&emu);
+	assert(memcmp(&emu.display, &blank, sizeof(Display)) != 0, "The requested frame should be drawn");
+
+	emulator_destroy(&emu);
+	return SUCCESS;
+}
+
+
+// NOTE: A request that comes in after line 0 waits for the next frame, and lasts until it is drawn
+int test_request_after_line_zero() {
+	Emulator emu = emulator_with_random_vram();
+	emu.ppu.mode = PPU_MODE_OAM_SCAN;
+	emulator_set_render_on_demand(&emu, true);
+	Display blank = emu.display;
+
+	for (uint16_t line = 0; line < 10; line++)
+		ppu_step(&emu, 456);
+	emulator_request_frame(&emu);
+	for (uint16_t line = 10; line < 154; line++)
+		ppu_step(&emu, 456);
+	assertm_eq(emu.render.frames_drawn, 0ull, "%llu", "The frame under way should not be drawn in part");
+	assert(memcmp(&emu.display, &blank, sizeof(Display)) == 0, "Nothing should be drawn yet");
+	assert(emu.render.is_requested, "The request should last until a frame is drawn");
+
+	run_ppu_frame(&emu);
+	assert_eq(emu.render.frames_drawn, 1ull, "%llu");
+	assert(!emu.render.is_requested, "The drawn frame should answer the request");
+	Display drawn = emu.display;
+	run_ppu_frame(&emu);
+	assert_eq(emu.render.frames_drawn, 1ull, "%llu");
+	assert(memcmp(&emu.display, &drawn, sizeof(Display)) == 0, "The frame should stay until the next request");
+
+	emulator_destroy(&emu);
+	return SUCCESS;
+}
+
+
+// NOTE: A busy loop, which overshoots the end of each frame by a different amount
+static const uint8_t COUNTING_PROGRAM[] = {
+	0x3E, 0x91,       // LD A, 0x91
+	0xE0, 0x40,       // LDH (LCDC), A
+	0x3E, 0x01,       // LD A, 0x01
+	0xE0, 0xFF,       // LDH (IE), A
+	0xFB,             // EI
+	0xC5,             // PUSH BC
+	0xC1,             // POP BC
+	0x18, 0xFC,       // JR -4
+};
+// NOTE: Adds one to every byte of tile 0 at each VBlank the PPU raises. The map only shows
+//  tile 0, so every frame is different and all the lines of a frame are the same
+static const uint8_t COUNTING_HANDLER[] = {
+	0xF5,             // PUSH AF
+	0xE5,             // PUSH HL
+	0xC5,             // PUSH BC
+	0xF0, 0x44,       // LDH A, (LY)
+	0xFE, 0x90,       // CP 144
+	0x38, 0x0A,       // JR C, +10
+	0x21, 0x00, 0x80, // LD HL, 0x8000
+	0x06, 0x10,       // LD B, 16
+	0x34,             // INC (HL)
+	0x23,             // INC HL
+	0x05,             // DEC B
+	0x20, 0xFB,       // JR NZ, -5
+	0xC1,             // POP BC
+	0xE1,             // POP HL
+	0xF1,             // POP AF
+	0xD9,             // RETI
+};
+
+static Emulator emulator_counting(Cartridge *cart) {
+	cart->size = 0x8000;
+	cart->content = calloc(cart->size, 1);
+	memcpy(&cart->content[0x100], COUNTING_PROGRAM, sizeof(COUNTING_PROGRAM));
+	memcpy(&cart->content[0x40], COUNTING_HANDLER, sizeof(COUNTING_HANDLER));
+
+	Emulator emu = emulator_create();
+	emulator_insert_cartridge(&emu, cart);
+	emu.cpu.pc = 0x100;
+	emu.cpu.sp = 0xFFFE;
+	memset(emu.ppu.vram, 0, VRAM_SIZE);
+	memset(emu.ppu.oam, 0, OAM_SIZE);
+	return emu;
+}
+
+
+// NOTE: The loop of the headless runner with --every 60, against an emulator drawing every frame
+int test_every_60th_frame_is_whole() {
+	static const long FRAMES = 1200;
+	static const long EVERY = 60;
+	Cartridge cart = {0};
+	Cartridge reference_cart = {0};
+	Emulator emu = emulator_counting(&cart);
+	Emulator reference = emulator_counting(&reference_cart);
+	emulator_set_render_on_demand(&emu, true);
+
+	uint64_t frames_drawn = emu.render.frames_drawn;
+	uint32_t dumps = 0;
+	RGBA last_line[DISPLAY_WIDTH] = {0};
+	for (long frame = 0; frame < FRAMES; frame++) {
+		if (frame % EVERY == 0)
+			emulator_request_frame(&emu);
+		emulator_run_frame(&emu);
+		emulator_run_frame(&reference);
+		if (emu.render.frames_drawn == frames_drawn)
+			continue;
+		frames_drawn = emu.render.frames_drawn;
+		dumps++;
+
+		assertm_eq(emu.ppu.line, 0, "%d", "[FRAME %ld] The frames should stay in step with the PPU", frame);
+		assert(memcmp(emu.display.framebuffer, reference.display.framebuffer, sizeof(emu.display.framebuffer)) == 0,
+			"[FRAME %ld] The dump should be the whole frame", frame);
+		for (uint8_t y = 1; y < DISPLAY_HEIGHT; y++)
+			assert(memcmp(emu.display.framebuffer[y], emu.display.framebuffer[0], sizeof(last_line)) == 0,
+				"[FRAME %ld] Line %d comes from another frame", frame, y);
+		assert(memcmp(emu.display.framebuffer[0], last_line, sizeof(last_line)) != 0,
+			"[FRAME %ld] The dump should be a new frame", frame);
+		memcpy(last_line, emu.display.framebuffer[0], sizeof(last_line));
+	}
+	assert_eq(dumps, (uint32_t)(FRAMES / EVERY), "%u");
+
+	emulator_destroy(&emu);
+	emulator_destroy(&reference);
+	free(cart.content);
+	free(reference_cart.content);
+	return SUCCESS;
+}
+
+
+int main() {
+	TEST_SETUP();
+
+	TEST_RUN(test_catch_up_matches_dot_by_dot);
+	TEST_RUN(test_catch_up_matches_dot_by_dot_with_tall_objects);
+	TEST_RUN(test_vram_write_lands_mid_scanline);
+	TEST_RUN(test_flipped_objects);
+	TEST_RUN(test_object_priority);
+	TEST_RUN(test_object_index_follows_oam);
+	TEST_RUN(test_object_index_survives_size_toggle);
+	TEST_RUN(test_frameskip_keeps_timing);
+	TEST_RUN(test_render_on_demand);
+	TEST_RUN(test_request_after_line_zero);
+	TEST_RUN(test_every_60th_frame_is_whole);
+
+	TEST_FINISH();
+}
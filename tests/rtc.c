@@ -0,0 +1,205 @@
+#include "rtc.h"
+#include "./unit.h"
+#include "cartridge.h"
+#include "emulator.h"
+#include "mbc.h"
+#include "memory_map.h"
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+
+static Cartridge clock_cartridge() {
+	Cartridge cart = {0};
+	cart.is_load_success = true;
+	cart.type = CARTRIDGE_TYPE_10_MBC3_TIMER_RAM_BATTERY;
+	cart.ram_size = RAM_SIZE_256KBIT;
+	cart.size = 0x8000;
+	cart.content = calloc(cart.size, 1);
+	return cart;
+}
+
+static void latch(Emulator *emu) {
+	memory_write(emu, 0x6000, 0x00);
+	memory_write(emu, 0x6000, 0x01);
+}
+
+static uint8_t read_register(Emulator *emu, RTCRegister reg) {
+	memory_write(emu, 0x4000, 0x08 + reg);
+	return memory_read(emu, 0xA000);
+}
+
+static void write_register(Emulator *emu, RTCRegister reg, uint8_t value) {
+	memory_write(emu, 0x4000, 0x08 + reg);
+	memory_write(emu, 0xA000, value);
+}
+
+
+int test_rtc_counts_cycles() {
+	Cartridge cart = clock_cartridge();
+	Emulator emu = emulator_create();
+	emulator_insert_cartridge(&emu, &cart);
+	memory_write(&emu, 0x0000, 0x0A);
+
+	// NOTE: One day, one hour, one minute and one second, the registers only move on a latch
+	emu.scheduler.clock += (uint64_t)(86400 + 3661) * RTC_CYCLES_PER_SECOND + 100;
+	assert_eq(read_register(&emu, RTC_SECONDS), 0, "%d");
+	latch(&emu);
+	assert_eq(read_register(&emu, RTC_SECONDS), 1, "%d");
+	assert_eq(read_register(&emu, RTC_MINUTES), 1, "%d");
+	assert_eq(read_register(&emu, RTC_HOURS), 1, "%d");
+	assert_eq(read_register(&emu, RTC_DAY_LOW), 1, "%d");
+
+	// NOTE: The part of a second left over still counts towards the next one
+	emu.scheduler.clock += RTC_CYCLES_PER_SECOND - 100;
+	latch(&emu);
+	assert_eq(read_register(&emu, RTC_SECONDS), 2, "%d");
+
+	memory_write(&emu, 0x6000, 0x01);
+	emu.scheduler.clock += RTC_CYCLES_PER_SECOND;
+	memory_write(&emu, 0x6000, 0x01);
+	assertm_eq(read_register(&emu, RTC_SECONDS), 2, "%d", "Latching needs a 0x00 first");
+
+	emulator_destroy(&emu);
+	cartridge_free(&cart);
+	return SUCCESS;
+}
+
+
+int test_rtc_halt_and_carry() {
+	Cartridge cart = clock_cartridge();
+	Emulator emu = emulator_create();
+	emulator_insert_cartridge(&emu, &cart);
+	memory_write(&emu, 0x0000, 0x0A);
+
+	write_register(&emu, RTC_DAY_HIGH, RTC_HALT_BIT | RTC_DAY_HIGH_BIT);
+	write_register(&emu, RTC_DAY_LOW, 0xFF);
+	write_register(&emu, RTC_HOURS, 23);
+	write_register(&emu, RTC_MINUTES, 59);
+	write_register(&emu, RTC_SECONDS, 59);
+	emu.scheduler.clock += 10ull * RTC_CYCLES_PER_SECOND;
+	latch(&emu);
+	assertm_eq(read_register(&emu, RTC_SECONDS), 59, "%d", "A halted clock should not count");
+
+	write_register(&emu, RTC_DAY_HIGH, RTC_DAY_HIGH_BIT);
+	emu.scheduler.clock += RTC_CYCLES_PER_SECOND;
+	latch(&emu);
+	assert_eq(read_register(&emu, RTC_SECONDS), 0, "%d");
+	assert_eq(read_register(&emu, RTC_HOURS), 0, "%d");
+	assert_eq(read_register(&emu, RTC_DAY_LOW), 0, "%d");
+	assertm_eq(read_register(&emu, RTC_DAY_HIGH), RTC_CARRY_BIT, "%02X", "Day 512 should wrap with the carry set");
+
+	emulator_destroy(&emu);
+	cartridge_free(&cart);
+	return SUCCESS;
+}
+
+
+int test_rtc_save_trailer() {
+	char filename[] = "/tmp/gbemu_rtc_XXXXXX";
+	int fd = mkstemp(filename);
+	assert(fd >= 0, "Could not create a temporary file");
+	close(fd);
+
+	Cartridge cart = clock_cartridge();
+	Emulator emu = emulator_create();
+	emulator_insert_cartridge(&emu, &cart);
+	assert(mbc_attach_save(&emu, filename), "The save should attach");
+	memory_write(&emu, 0x0000, 0x0A);
+	// NOTE: Halted, so the host time between the runs does not move it
+	write_register(&emu, RTC_DAY_HIGH, RTC_HALT_BIT);
+	write_register(&emu, RTC_HOURS, 13);
+	write_register(&emu, RTC_MINUTES, 37);
+	latch(&emu);
+	emulator_destroy(&emu);
+
+	uint8_t trailer[RTC_SAVE_SIZE];
+	fd = open(filename, O_RDONLY);
+	assert(fd >= 0, "The save should exist");
+	assert_eq(lseek(fd, 0, SEEK_END), (off_t)(0x8000 + RTC_SAVE_SIZE), "%ld");
+	assert_eq(pread(fd, trailer, RTC_SAVE_SIZE, 0x8000), (ssize_t)RTC_SAVE_SIZE, "%zd");
+	close(fd);
+	assert_eq(trailer[RTC_HOURS * 4], 13, "%d");
+	assert_eq(trailer[RTC_MINUTES * 4], 37, "%d");
+	assert_eq(trailer[(RTC_REGISTER_COUNT + RTC_HOURS) * 4], 13, "%d");
+	assert(trailer[40] != 0 || trailer[41] != 0, "The timestamp should be stored");
+
+	emu = emulator_create();
+	emulator_insert_cartridge(&emu, &cart);
+	assert(mbc_attach_save(&emu, filename), "The save should attach again");
+	memory_write(&emu, 0x0000, 0x0A);
+	assertm_eq(read_register(&emu, RTC_HOURS), 13, "%d", "The latched registers should come back");
+	latch(&emu);
+	assert_eq(read_register(&emu, RTC_MINUTES), 37, "%d");
+
+	emulator_destroy(&emu);
+	cartridge_free(&cart);
+	unlink(filename);
+	return SUCCESS;
+}
+
+
+// NOTE: A save of only the RAM and a trailer at 12:00:00 on day 3, stored `age` seconds ago
+static void write_old_save(char *filename, uint64_t age) {
+	uint8_t save[0x8000 + RTC_SAVE_SIZE] = {0};
+	uint8_t *trailer = &save[0x8000];
+	trailer[RTC_HOURS * 4] = 12;
+	trailer[RTC_DAY_LOW * 4] = 3;
+	uint64_t timestamp = time(NULL) - age;
+	for (uint8_t i = 0; i < 8; i++)
+		trailer[40 + i] = timestamp >> (i * 8);
+	int fd = mkstemp(filename);
+	write(fd, save, sizeof(save));
+	close(fd);
+}
+
+
+int test_rtc_load_catch_up() {
+	static const uint64_t TWO_DAYS = 2 * 86400;
+	Cartridge cart = clock_cartridge();
+
+	// NOTE: Emulated time only passes while running, the same save loads the same clock on any day
+	char filename[] = "/tmp/gbemu_rtc_XXXXXX";
+	write_old_save(filename, TWO_DAYS);
+	Emulator emu = emulator_create();
+	emulator_insert_cartridge(&emu, &cart);
+	assert(mbc_attach_save(&emu, filename), "The save should attach");
+	memory_write(&emu, 0x0000, 0x0A);
+	latch(&emu);
+	assertm_eq(read_register(&emu, RTC_DAY_LOW), 3, "%d", "Emulated time should not catch up on the host time");
+	assert_eq(read_register(&emu, RTC_HOURS), 12, "%d");
+	assert_eq(read_register(&emu, RTC_SECONDS), 0, "%d");
+	emulator_destroy(&emu);
+	unlink(filename);
+
+	strcpy(filename, "/tmp/gbemu_rtc_XXXXXX");
+	write_old_save(filename, TWO_DAYS);
+	emu = emulator_create();
+	emulator_insert_cartridge(&emu, &cart);
+	mbc_set_clock_source(&emu, true);
+	assert(mbc_attach_save(&emu, filename), "The save should attach");
+	memory_write(&emu, 0x0000, 0x0A);
+	latch(&emu);
+	assertm_eq(read_register(&emu, RTC_DAY_LOW), 5, "%d", "Host time should catch up on the days since the save");
+	assert_eq(read_register(&emu, RTC_HOURS), 12, "%d");
+	emulator_destroy(&emu);
+	unlink(filename);
+
+	cartridge_free(&cart);
+	return SUCCESS;
+}
+
+
+int main() {
+	TEST_SETUP();
+
+	TEST_RUN(test_rtc_counts_cycles);
+	TEST_RUN(test_rtc_halt_and_carry);
+	TEST_RUN(test_rtc_save_trailer);
+	TEST_RUN(test_rtc_load_catch_up);
+
+	TEST_FINISH();
+}
@@ -0,0 +1,62 @@
+#include "scheduler.h"
+#include "./unit.h"
+#include <stdint.h>
+
+
+int test_events_pop_in_deadline_order() {
+	Scheduler scheduler = {0};
+	scheduler_schedule(&scheduler, EVENT_PPU, 300);
+	scheduler_schedule(&scheduler, EVENT_FRAME_END, 500);
+	scheduler_schedule(&scheduler, EVENT_TIMER, 100);
+	assert_eq(scheduler_next_deadline(&scheduler), 100, "%lu");
+
+	Event event;
+	assert(!scheduler_pop_due(&scheduler, &event), "Nothing should be due at cycle 0");
+
+	scheduler.clock = 400;
+	assert(scheduler_pop_due(&scheduler, &event), "The timer event should be due");
+	assert_eq(event.type, EVENT_TIMER, "%d");
+	assert(scheduler_pop_due(&scheduler, &event), "The PPU event should be due");
+	assert_eq(event.type, EVENT_PPU, "%d");
+	assert(!scheduler_pop_due(&scheduler, &event), "The end of frame should not be due yet");
+	assert_eq(scheduler_next_deadline(&scheduler), 500, "%lu");
+
+	return SUCCESS;
+}
+
+
+int test_reschedule_and_cancel() {
+	Scheduler scheduler = {0};
+	scheduler_schedule(&scheduler, EVENT_FRAME_END, 500);
+	scheduler_schedule(&scheduler, EVENT_TIMER, 100);
+	scheduler_schedule(&scheduler, EVENT_PPU, 200);
+
+	// NOTE: Each type is scheduled at most once, scheduling again moves it
+	scheduler_schedule(&scheduler, EVENT_TIMER, 600);
+	assert_eq(scheduler.size, 3, "%d");
+	assert_eq(scheduler_next_deadline(&scheduler), 200, "%lu");
+
+	scheduler_schedule(&scheduler, EVENT_FRAME_END, 50);
+	assert_eq(scheduler_next_deadline(&scheduler), 50, "%lu");
+
+	scheduler_cancel(&scheduler, EVENT_FRAME_END);
+	scheduler_cancel(&scheduler, EVENT_FRAME_END);
+	assert_eq(scheduler.size, 2, "%d");
+	assert_eq(scheduler_next_deadline(&scheduler), 200, "%lu");
+
+	scheduler_cancel(&scheduler, EVENT_PPU);
+	scheduler_cancel(&scheduler, EVENT_TIMER);
+	assert_eq(scheduler_next_deadline(&scheduler), UINT64_MAX, "%lu");
+
+	return SUCCESS;
+}
+
+
+int main() {
+	TEST_SETUP();
+
+	TEST_RUN(test_events_pop_in_deadline_order);
+	TEST_RUN(test_reschedule_and_cancel);
+
+	TEST_FINISH();
+}
@@ -0,0 +1,91 @@
+#include "tile_decode.h"
+#include "./unit.h"
+#include "ppu.h"
+#include <stdint.h>
+
+
+// NOTE: One pixel at a time, the way the PPU used to read tiles
+static inline uint8_t tile_color(TileData* tile, uint8_t lx, uint8_t ly) {
+	uint8_t lower = tile->lines[ly].lower;
+	uint8_t higher = tile->lines[ly].higher;
+	uint8_t offset = 7 - lx;
+	uint8_t lower_bit = (lower >> offset) & 0b1;
+	uint8_t higher_bit = (higher >> offset) & 0b1;
+	return lower_bit | (higher_bit << 1);
+}
+
+static inline uint8_t reference_color(TileData *tile, uint8_t palette, uint8_t lx, uint8_t ly) {
+	return (palette >> (tile_color(tile, lx, ly) * 2)) & 0b11;
+}
+
+
+// NOTE: Every pair of plane bytes, 256 rows at a time
+int test_kernels_decode_every_row() {
+	for (uint8_t kernel = 0; kernel < TILE_DECODE_KERNEL_COUNT; kernel++) {
+		TileDecodeFn decode = tile_decode_kernel(kernel);
+		if (decode == NULL)
+			continue;
+
+		for (uint16_t higher = 0; higher < 256; higher++) {
+			TileData rows[32];
+			for (uint16_t lower = 0; lower < 256; lower++) {
+				rows[lower / 8].lines[lower % 8].lower = lower;
+				rows[lower / 8].lines[lower % 8].higher = higher;
+			}
+			uint8_t out[256][8];
+			decode(rows[0].data, 256, PALETTE_IDENTITY, &out[0][0]);
+
+			for (uint16_t lower = 0; lower < 256; lower++) {
+			for (uint8_t x = 0; x < 8; x++) {
+				uint8_t expected = tile_color(&rows[lower / 8], x, lower % 8);
+				assertm_eq(out[lower][x], expected, "%d", "[%s] %02X %02X, pixel %d",
+					tile_decode_kernel_name(kernel), lower, higher, x);
+			}}
+		}
+	}
+	return SUCCESS;
+}
+
+
+// NOTE: Every palette, on row counts that leave a tail for the scalar loop
+int test_kernels_apply_every_palette() {
+	TileData tile;
+	for (uint8_t i = 0; i < sizeof(TileData); i++)
+		tile.data[i] = (i * 0x35) ^ 0x5A;
+
+	for (uint8_t kernel = 0; kernel < TILE_DECODE_KERNEL_COUNT; kernel++) {
+		TileDecodeFn decode = tile_decode_kernel(kernel);
+		if (decode == NULL)
+			continue;
+
+		for (uint16_t palette = 0; palette < 256; palette++) {
+		for (uint8_t rows = 1; rows <= 8; rows++) {
+			uint8_t out[8][8] = {0};
+			decode(tile.data, rows, palette, &out[0][0]);
+			for (uint8_t y = 0; y < rows; y++)
+			for (uint8_t x = 0; x < 8; x++) {
+				uint8_t expected = reference_color(&tile, palette, x, y);
+				assertm_eq(out[y][x], expected, "%d", "[%s] Palette %02X, %d rows, pixel %d,%d",
+					tile_decode_kernel_name(kernel), palette, rows, x, y);
+			}
+		}}
+	}
+	return SUCCESS;
+}
+
+
+int test_scalar_is_always_available() {
+	assert(tile_decode_kernel(TILE_DECODE_SCALAR) != NULL, "The scalar kernel should always be there");
+	return SUCCESS;
+}
+
+
+int main() {
+	TEST_SETUP();
+
+	TEST_RUN(test_kernels_decode_every_row);
+	TEST_RUN(test_kernels_apply_every_palette);
+	TEST_RUN(test_scalar_is_always_available);
+
+	TEST_FINISH();
+}